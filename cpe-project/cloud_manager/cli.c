@@ -19,6 +19,7 @@
 #define METRIC_PORT 8083                // Port for Cloud Manager server (alarms)
 #define COMMAND_PORT 8081               // Port for Command Manager server
 #define MAX_MESSAGE_SIZE 2048           // Maximum size for messages
+#define MAX_ALARM_LINE 32768            // Longest alarm line (the Cloud Manager's largest request)
 #define DEFAULT_TIMEOUT 12              // Default timeout (10s server + 2s buffer)
 #define LONG_TIMEOUT 305                // Timeout for long-running(300s server + 5s buffer)
 
@@ -124,36 +125,117 @@ char *get_timestamp() {
     return timestamp;
 }
 
-// Extract alarm message from JSON
-// Parses JSON to extract the "message" field
-char *extract_alarm_message(const char *json) {
-    const char *message_key = "\"message\":\"";
-    char *start = strstr(json, message_key);    // Find message key
-    if (!start) {
-        return NULL;
+// Span of a JSON text, pointing into the received buffer (no copy)
+typedef struct {
+    const char *start;
+    size_t len;
+} JsonSpan;
+
+// Skip a JSON string starting at its opening quote
+// Returns the position after the closing quote, or NULL if the string is cut off
+static const char *skip_json_string(const char *p) {
+    for (p++; *p; p++) {
+        if (*p == '\\') {
+            if (!*++p) return NULL;
+        } else if (*p == '"') {
+            return p + 1;
+        }
     }
-    start += strlen(message_key);               // Move to message content
+    return NULL;
+}
 
-    char *end = strchr(start, '"');             // Find closing quote
-    if (!end) {
-        return NULL;
+// Skip one JSON value (string, object, array or scalar)
+// Returns the position after it, or NULL if the value is cut off
+static const char *skip_json_value(const char *p) {
+    if (*p == '"') return skip_json_string(p);
+    if (*p != '{' && *p != '[') {
+        while (*p && *p != ',' && *p != '}' && *p != ']') p++;
+        return p;
     }
+    int depth = 0;
+    for (; *p; p++) {
+        if (*p == '"') {
+            p = skip_json_string(p);
+            if (!p) return NULL;
+            p--;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if ((*p == '}' || *p == ']') && --depth == 0) {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
 
-    size_t len = end - start;
-    char *message = malloc(len + 1);            // Allocate memory for message
-    if (!message) {
-        fprintf(stderr, "Failed to allocate memory for alarm message\n");
-        return NULL;
+// Tokenize the next member of a top-level JSON object
+// *pos starts at the opening brace and advances past each member; string values are returned
+// without their quotes, still escaped. Nested values are skipped without being parsed
+// Returns 1 for a member, 0 at the end of the object or on malformed or truncated input
+int json_next_member(const char **pos, JsonSpan *key, JsonSpan *value) {
+    const char *p = *pos;
+    while (*p == '{' || *p == ',' || *p == ' ') p++;
+    if (*p != '"') return 0;
+    const char *end = skip_json_string(p);
+    if (!end || *end != ':') return 0;
+    key->start = p + 1;
+    key->len = end - p - 2;
+    p = end + 1;
+    while (*p == ' ') p++;
+    end = skip_json_value(p);
+    if (!end) return 0;
+    value->start = p;
+    value->len = end - p;
+    if (*p == '"') {
+        value->start++;
+        value->len -= 2;
     }
-    strncpy(message, start, len);               // Copy message
-    message[len] = '\0';                        // Null-terminate
-    return message;
+    *pos = end;
+    return 1;
 }
 
-// Check if message is a JSON alarm
-// Verifies if message is JSON and contains "type":"alarm"
-int is_json_alarm(const char *message) {
-    return message[0] == '{' && strstr(message, "\"type\":\"alarm\"");
+// 1 if span holds exactly text
+static int span_is(const JsonSpan *span, const char *text) {
+    return strlen(text) == span->len && strncmp(span->start, text, span->len) == 0;
+}
+
+// Parse an alarm line: {"type":"alarm",...,"message":"..."}
+// Stops at the message, so the metrics that follow it are never scanned
+// Returns 1 if the line is an alarm; message is empty when it has none
+int parse_alarm(const char *json, JsonSpan *message) {
+    JsonSpan key, value;
+    int is_alarm = 0;
+    message->start = "";
+    message->len = 0;
+    if (json[0] != '{') return 0;
+    while (json_next_member(&json, &key, &value)) {
+        if (span_is(&key, "type")) {
+            is_alarm = span_is(&value, "alarm");
+            if (!is_alarm) return 0;
+        } else if (span_is(&key, "message")) {
+            *message = value;
+        }
+        if (is_alarm && message->len > 0) break;
+    }
+    return is_alarm;
+}
+
+// Print the escaped contents of a JSON string span as text
+void print_json_string(const JsonSpan *span) {
+    const char *p = span->start;
+    const char *end = p + span->len;
+    for (; p < end; p++) {
+        if (*p != '\\' || p + 1 == end) {
+            putchar(*p);
+            continue;
+        }
+        switch (*++p) {
+        case 'n': putchar('\n'); break;
+        case 't': putchar('\t'); break;
+        case 'r': break;
+        case 'u': p += (end - p > 4) ? 4 : end - p - 1; putchar('?'); break;   // control characters
+        default: putchar(*p); break;                                          // \" \\ \/
+        }
+    }
 }
 
 // Check if command is long-running 
@@ -218,6 +300,9 @@ int main() {
     int timeout_seconds = DEFAULT_TIMEOUT;      // Current timeout
     time_t last_activity = time(NULL);          // Track last activity time
     char last_command[MAX_MESSAGE_SIZE] = "";   // Store last command
+    static char alarm_buf[MAX_ALARM_LINE];      // Alarm stream; a partial last line waits here for the next read
+    size_t alarm_used = 0;                      // Bytes of alarm_buf in use
+    int alarm_skip = 0;                         // Dropping the rest of a line longer than alarm_buf
 
     // Main event loop
     while (1) {
@@ -279,7 +364,7 @@ int main() {
             }
             while (1) {
                 // Read alarm message
-                ssize_t len = recv(metric_sock, buffer, MAX_MESSAGE_SIZE - 1, 0);
+                ssize_t len = recv(metric_sock, alarm_buf + alarm_used, sizeof(alarm_buf) - 1 - alarm_used, 0);
                 if (len < 0) {
                     if (errno == EAGAIN || errno == EWOULDBLOCK) {
                         break; // No more data
@@ -291,16 +376,29 @@ int main() {
                 if (len == 0) {
                     fprintf(stderr, "Alarm server closed connection\n");
                     restore_mode(&original);
+                    alarm_used = 0;                 // A partial line will never be completed
                     break;
                 }
-                buffer[len] = '\0';                 // Null-terminate message
-
-                // Process JSON alarm
-                if (is_json_alarm(buffer)) {
-                    char *message = extract_alarm_message(buffer);
-                    if (message) {
-                        printf("\n[%s] Alert: %s\n", get_timestamp(), message);
-                        free(message);
+                alarm_used += len;
+                alarm_buf[alarm_used] = '\0';       // Null-terminate message
+
+                // Process each complete JSON alarm line; a batch arrives as several lines in one
+                // read and a large alarm over several reads, so only lines ended by '\n' are parsed
+                char *line = alarm_buf;
+                char *end;
+                for (; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+                    *end = '\0';
+                    if (alarm_skip) {
+                        alarm_skip = 0;             // End of an oversized alarm
+                        continue;
+                    }
+
+                    JsonSpan message;
+                    if (!parse_alarm(line, &message)) continue;
+                    if (message.len > 0) {
+                        printf("\n[%s] Alert: ", get_timestamp());
+                        print_json_string(&message);
+                        printf("\n");
                     } else {
                         printf("\n[%s] Alert: Unknown alarm received\n", get_timestamp());
                     }
@@ -311,6 +409,14 @@ int main() {
                     }
                     alarms_processed++;
                 }
+                // Keep the partial last line for the next read
+                alarm_used -= line - alarm_buf;
+                memmove(alarm_buf, line, alarm_used);
+                if (alarm_used == sizeof(alarm_buf) - 1) {
+                    fprintf(stderr, "Alarm longer than %d bytes, dropped\n", MAX_ALARM_LINE - 1);
+                    alarm_used = 0;
+                    alarm_skip = 1;
+                }
             }
             // Restore blocking mode
             if (fcntl(metric_sock, F_SETFL, flags & ~O_NONBLOCK) == -1) {
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
@@ -15,17 +16,27 @@
 #define ALARM_PORT 8082
 #define CLIENT_PORT 8083
 #define MAX_MESSAGE_SIZE 2048
+#define MAX_REQUEST_SIZE 32768   // a batch of alarms with their metrics
 #define MAX_CLIENTS 10
+#define MAX_ALARM_CONNS 8        // device connections kept open between alarm posts
 #define METRIC_LOG_FILE "cloud_metrics.log"
 #define ALARM_LOG_FILE "cloud_alarms.log"
 #define ACCEPT_TIMEOUT 5
+#define RECENT_ALARM_IDS 256     // ids remembered to drop alarms a device sends again
 
 // Function Prototypes
 void log_message(const char *message, const char *log_file);
 void cleanup();
 void signal_handler(int sig);
 int create_server_socket(int port);
-void handle_http_request(int client_fd, char *buffer, ssize_t len);
+void send_http_response(int client_fd, const char *status, int keep_alive);
+int handle_http_request(int client_fd, char *buffer, ssize_t len, int keep_alive);
+ssize_t recv_http_request(int client_fd, char *buffer, size_t size);
+int serve_alarm_connection(int client_fd, int keep_alive);
+void close_alarm_connection(int slot);
+int dispatch_alarms(char *body, int exclude_fd);
+int is_duplicate_alarm(const char *alarm);
+void deliver_alarm(const char *alarm, int exclude_fd);
 void broadcast_to_clients(const char *message, int exclude_fd);
 
 // Global Variables
@@ -34,6 +45,7 @@ int alarm_server_fd = -1;
 int client_server_fd = -1;
 int client_fds[MAX_CLIENTS] = {-1}; // Array of connected CLI client sockets
 int num_clients = 0;
+int alarm_conn_fds[MAX_ALARM_CONNS]; // Alarm connections kept open for the device's next post
 
 // Signal handler
 void signal_handler(int sig) {
@@ -86,6 +98,11 @@ void cleanup() {
             fprintf(stderr, "Closed client socket %d\n", client_fds[i]);
         }
     }
+    for (int i = 0; i < MAX_ALARM_CONNS; i++) {
+        if (alarm_conn_fds[i] >= 0) {
+            close(alarm_conn_fds[i]);
+        }
+    }
 }
 
 // Create TCP server socket
@@ -139,39 +156,193 @@ int create_server_socket(int port) {
     return fd;
 }
 
+// Send a response with no body
+// Connection: close tells the client not to reuse a connection the server is about to close
+void send_http_response(int client_fd, const char *status, int keep_alive) {
+    char response[128];
+    int n = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: 0\r\n%s\r\n", status,
+                     keep_alive ? "" : "Connection: close\r\n");
+    send(client_fd, response, n, 0);
+}
+
 // Handle HTTP request for alarms
-void handle_http_request(int client_fd, char *buffer, ssize_t len) {
+// keep_alive says whether the server has room to keep the connection open for the next request
+// Returns 1 if the connection stays open, 0 if the caller must close it: the client asked to,
+// or the request was cut and the rest of it is still on the connection
+int handle_http_request(int client_fd, char *buffer, ssize_t len, int keep_alive) {
+    char *body = strstr(buffer, "\r\n\r\n");
+    char *close_header = strstr(buffer, "Connection: close");
+    if (close_header && (!body || close_header < body)) keep_alive = 0;
+
     if (strncmp(buffer, "POST /alarm", 11) != 0) {
         fprintf(stderr, "Invalid HTTP request: not POST /alarm\n");
-        const char *response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
-        send(client_fd, response, strlen(response), 0);
-        return;
+        send_http_response(client_fd, "404 Not Found", 0);
+        return 0;
     }
 
-    char *body = strstr(buffer, "\r\n\r\n");
     if (!body) {
         fprintf(stderr, "Invalid HTTP request: no body\n");
-        const char *response = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
-        send(client_fd, response, strlen(response), 0);
-        return;
+        send_http_response(client_fd, "400 Bad Request", 0);
+        return 0;
     }
     body += 4;
 
-    log_message(body, ALARM_LOG_FILE);
-    broadcast_to_clients(body, client_fd);
+    // A request cut at MAX_REQUEST_SIZE (or by the client) must not be half delivered
+    // Content-Length says how much body to expect; without it a full buffer means it did not fit
+    size_t header_len = body - buffer;
+    size_t body_len = len - header_len;
+    char *length = strstr(buffer, "Content-Length:");
+    int has_length = length && length < body;
+    size_t expected = has_length ? strtoul(length + 15, NULL, 10) : body_len;
+    int too_large = has_length ? header_len + expected > MAX_REQUEST_SIZE - 1 : (size_t)len >= MAX_REQUEST_SIZE - 1;
+    if (too_large || expected > body_len) {
+        fprintf(stderr, "Invalid HTTP request: %s\n", too_large ? "larger than MAX_REQUEST_SIZE" : "body cut short");
+        send_http_response(client_fd, too_large ? "413 Payload Too Large" : "400 Bad Request", 0);
+        return 0;
+    }
+
+    if (dispatch_alarms(body, client_fd) == 0) {
+        fprintf(stderr, "Invalid HTTP request: no alarm in body\n");
+        send_http_response(client_fd, "400 Bad Request", keep_alive);
+        return keep_alive;
+    }
+
+    send_http_response(client_fd, "200 OK", keep_alive);
+    return keep_alive;
+}
+
+// Receive a whole HTTP request: headers plus Content-Length bytes of body
+// Returns the number of bytes read (request may be cut at size - 1), or recv's result on error
+ssize_t recv_http_request(int client_fd, char *buffer, size_t size) {
+    size_t used = 0;
+    while (used < size - 1) {
+        ssize_t len = recv(client_fd, buffer + used, size - 1 - used, 0);
+        if (len <= 0) return used > 0 ? (ssize_t)used : len;
+        used += len;
+        buffer[used] = '\0';
+
+        char *body = strstr(buffer, "\r\n\r\n");
+        if (!body) continue;
+        char *length = strstr(buffer, "Content-Length:");
+        if (!length || length > body) break;    // no length: the body is what came with the headers
+        if ((size_t)(buffer + used - (body + 4)) >= strtoul(length + 15, NULL, 10)) break;
+    }
+    return used;
+}
+
+// Read and answer one alarm request on client_fd
+// Devices keep their connection open between posts (HTTP keep-alive), so a connection is only
+// closed when keep_alive is 0 (no room to keep it), the device closes it or a request goes wrong
+// Returns 1 if the connection stays open for the next request, 0 if the caller must close it
+int serve_alarm_connection(int client_fd, int keep_alive) {
+    // Batches of alarms with their metrics can exceed a single recv, so read the whole request
+    static char buffer[MAX_REQUEST_SIZE];
+
+    // Receive headers and body from the client socket, leaving space for null terminator
+    ssize_t len = recv_http_request(client_fd, buffer, sizeof(buffer));
+
+    // Handle errors or client disconnection during recv
+    if (len <= 0) {
+        // len == 0 indicates the client closed the connection (e.g., an idle keep-alive connection)
+        if (len == 0) {
+            fprintf(stderr, "Client closed connection on alarm server\n");
+        } else {
+            // Log recv errors (e.g., network issues, invalid socket) with system error message
+            fprintf(stderr, "Failed to receive on alarm server: %s\n", strerror(errno));
+        }
+        return 0;
+    }
+
+    // Null-terminate the received data to create a valid C string for processing
+    buffer[len] = '\0';
+
+    // Process the HTTP request (validate POST /alarm, extract JSON, log, and broadcast)
+    return handle_http_request(client_fd, buffer, len, keep_alive);
+}
+
+// Close a kept alarm connection and free its slot
+void close_alarm_connection(int slot) {
+    close(alarm_conn_fds[slot]);
+    fprintf(stderr, "Closed connection on alarm server\n");
+    alarm_conn_fds[slot] = -1;
+}
+
+// 1 if the alarm carries an id that was already delivered; otherwise remember its id
+// Devices re-send and replay alarms after failures, so the same alarm can arrive more than once
+int is_duplicate_alarm(const char *alarm) {
+    static char recent[RECENT_ALARM_IDS][32];
+    static int next = 0;
+    const char *id = strstr(alarm, "\"id\":\"");
+    if (!id) return 0;
+    id += 6;
+    size_t len = strcspn(id, "\"");
+    if (len == 0 || len >= sizeof(recent[0])) return 0;
+    for (int i = 0; i < RECENT_ALARM_IDS; i++) {
+        if (strncmp(recent[i], id, len) == 0 && recent[i][len] == '\0') return 1;
+    }
+    memcpy(recent[next], id, len);
+    recent[next][len] = '\0';
+    next = (next + 1) % RECENT_ALARM_IDS;
+    return 0;
+}
+
+// Log and broadcast one alarm object, unless it was delivered before
+void deliver_alarm(const char *alarm, int exclude_fd) {
+    if (is_duplicate_alarm(alarm)) {
+        fprintf(stderr, "Dropping duplicate alarm\n");
+        return;
+    }
+    log_message(alarm, ALARM_LOG_FILE);
+    broadcast_to_clients(alarm, exclude_fd);
+}
+
+// Log and broadcast the alarms of a request body
+// A batch is a JSON array of alarm objects; each is logged and broadcast on its own line,
+// so the log and CLI clients see the same one-alarm-per-line stream as for single alarms
+// Returns the number of alarms found
+int dispatch_alarms(char *body, int exclude_fd) {
+    if (body[0] != '[') {
+        deliver_alarm(body, exclude_fd);
+        return 1;
+    }
 
-    const char *response = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
-    send(client_fd, response, strlen(response), 0);
+    int count = 0;
+    int depth = 0;
+    int in_string = 0;
+    char *start = NULL;
+    for (char *p = body + 1; *p; p++) {
+        if (in_string) {
+            if (*p == '\\' && p[1]) p++;          // skip the escaped character
+            else if (*p == '"') in_string = 0;
+            continue;
+        }
+        if (*p == '"') {
+            in_string = 1;
+        } else if (*p == '{') {
+            if (depth++ == 0) start = p;
+        } else if (*p == '}' && depth > 0 && --depth == 0) {
+            // terminate the element in place for logging, then restore the batch
+            char saved = p[1];
+            p[1] = '\0';
+            deliver_alarm(start, exclude_fd);
+            p[1] = saved;
+            count++;
+        }
+    }
+    return count;
 }
 
-// Broadcast message to all connected CLI clients
+// Broadcast message to all connected CLI clients, one line each
+// The message and its newline go out in one writev, so an alarm of any size arrives whole
 void broadcast_to_clients(const char *message, int exclude_fd) {
-    char formatted_msg[MAX_MESSAGE_SIZE];
-    snprintf(formatted_msg, sizeof(formatted_msg), "%s\n", message);
+    struct iovec line[2] = {
+        { .iov_base = (void *)message, .iov_len = strlen(message) },
+        { .iov_base = "\n", .iov_len = 1 },
+    };
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (client_fds[i] >= 0 && client_fds[i] != exclude_fd) {
-            ssize_t sent = send(client_fds[i], formatted_msg, strlen(formatted_msg), 0);
+            ssize_t sent = writev(client_fds[i], line, 2);
             if (sent < 0) {
                 fprintf(stderr, "Failed to send to client %d: %s\n", client_fds[i], strerror(errno));
                 close(client_fds[i]);
@@ -191,6 +362,9 @@ int main() {
     for (int i = 0; i < MAX_CLIENTS; i++) {
         client_fds[i] = -1;
     }
+    for (int i = 0; i < MAX_ALARM_CONNS; i++) {
+        alarm_conn_fds[i] = -1;
+    }
 
     // Create metric server
     metric_server_fd = create_server_socket(METRIC_PORT);
@@ -220,7 +394,7 @@ int main() {
     printf("Client server running on %s:%d\n", CLOUD_HOST, CLIENT_PORT);
 
     // Poll for all sockets
-    struct pollfd fds[3 + MAX_CLIENTS];
+    struct pollfd fds[3 + MAX_ALARM_CONNS + MAX_CLIENTS];
     fds[0].fd = metric_server_fd;
     fds[0].events = POLLIN;
     fds[1].fd = alarm_server_fd;
@@ -231,8 +405,16 @@ int main() {
     printf("Cloud Manager server running, listening for metrics, alarms, and clients\n");
 
     while (1) {
-        // Update poll fds for clients
+        // Update poll fds for kept alarm connections, then for clients
         int nfds = 3;
+        for (int i = 0; i < MAX_ALARM_CONNS; i++) {
+            if (alarm_conn_fds[i] >= 0) {
+                fds[nfds].fd = alarm_conn_fds[i];
+                fds[nfds].events = POLLIN;
+                nfds++;
+            }
+        }
+        int first_client = nfds;
         for (int i = 0; i < MAX_CLIENTS; i++) {
             if (client_fds[i] >= 0) {
                 fds[nfds].fd = client_fds[i];
@@ -307,39 +489,28 @@ int main() {
             // Log successful acceptance of a new client connection
             fprintf(stderr, "Accepted connection on alarm server\n");
 
-            // Allocate buffer to store incoming HTTP POST request (e.g., JSON alarm from Device Agent)
-            char buffer[MAX_MESSAGE_SIZE];
-            
-            // Receive data from the client socket, leaving space for null terminator
-            // MAX_MESSAGE_SIZE - 1 ensures buffer safety; 0 flags use default recv behavior
-            ssize_t len = recv(client_fd, buffer, MAX_MESSAGE_SIZE - 1, 0);
-            
-            // Handle errors or client disconnection during recv
-            if (len <= 0) {
-                // len == 0 indicates the client closed the connection (e.g., after sending alarm)
-                if (len == 0) {
-                    fprintf(stderr, "Client closed connection on alarm server\n");
-                } else {
-                    // Log recv errors (e.g., network issues, invalid socket) with system error message
-                    fprintf(stderr, "Failed to receive on alarm server: %s\n", strerror(errno));
-                }
-                // Close the client socket to free resources
+            // Keep the connection for the device's next post if there is a free slot
+            int slot = -1;
+            for (int i = 0; i < MAX_ALARM_CONNS && slot < 0; i++) {
+                if (alarm_conn_fds[i] < 0) slot = i;
+            }
+            if (serve_alarm_connection(client_fd, slot >= 0)) {
+                alarm_conn_fds[slot] = client_fd;
+            } else {
                 close(client_fd);
-                continue; // Skip to the next poll iteration
+                fprintf(stderr, "Closed connection on alarm server\n");
+            }
+        }
+
+        // Next requests on kept alarm connections
+        for (int i = 3; i < first_client; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            for (int j = 0; j < MAX_ALARM_CONNS; j++) {
+                if (alarm_conn_fds[j] == fds[i].fd) {
+                    if (!serve_alarm_connection(fds[i].fd, 1)) close_alarm_connection(j);
+                    break;
+                }
             }
-            
-            // Null-terminate the received data to create a valid C string for processing
-            buffer[len] = '\0';
-            
-            // Process the HTTP request (validate POST /alarm, extract JSON, log, and broadcast)
-            // Passes client_fd for response, buffer for request data, and len for data length
-            handle_http_request(client_fd, buffer, len);
-            
-            // Close the client socket after processing the request, as each alarm is a short-lived connection
-            close(client_fd);
-            
-            // Log connection closure for debugging and monitoring
-            fprintf(stderr, "Closed connection on alarm server\n");
         }
 
         // Client server
@@ -372,7 +543,7 @@ int main() {
         }
 
         // Check existing clients
-        for (int i = 3; i < nfds; i++) {
+        for (int i = first_client; i < nfds; i++) {
             if (fds[i].revents & POLLIN) {
                 char buffer[MAX_MESSAGE_SIZE];
                 ssize_t len = recv(fds[i].fd, buffer, MAX_MESSAGE_SIZE - 1, 0);
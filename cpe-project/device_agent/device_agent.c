@@ -14,7 +14,7 @@
 #define UNIX_SOCK_PATH "/tmp/device_agent.sock"
 #define CLOUD_HOST "127.0.0.1"
 #define CLOUD_PORT 8080
-#define MAX_METRIC_SIZE 256
+#define MAX_METRIC_SIZE 1024
 #define BUFFER_SIZE 360
 #define LOG_FILE "metrics.log"
 #define ACK_RETRIES 3
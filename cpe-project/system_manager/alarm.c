@@ -1,118 +1,283 @@
 #include "alarm.h"
-#include "http_client.h"
+#include "alarm_queue.h"
+#include "metric_registry.h"
+#include "psi_monitor.h"
+#include "top_processes.h"
+#include "alarm_rules.h"
+#include "json_writer.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
-// check system metrics against thresholds and trigger alarms if exceeded
-int check_alarms(Metrics m, Thresholds t) {
-    int alarm_triggered = 0; // indicate if any alarm was triggered
-    char alarm_message[256]; 
-    char json_payload[512]; 
-
-    // check if memory usage exceeds threshold
-    if (m.memory >= 0 && m.memory > t.memory) {
-        // format alarm message  for memory usage
-        snprintf(alarm_message, sizeof(alarm_message), "Memory usage (%.1f%%) exceeds threshold (%.1f%%)", m.memory, t.memory);
-        log_message("ALARM: %s", alarm_message); // Log 
-        // JSON payload with alarm details and metrics
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        // attempt to send alarm to cvloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); // log success
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); // log failure
-        }
-        alarm_triggered = 1; // Set flag to indicate alarm was triggered
+// dedupe id of a new alarm: the start time of this run and a sequence number. A re-sent or
+// replayed alarm keeps its id, so the Cloud Manager can drop the copies
+static void next_alarm_id(char *id, size_t size) {
+    static unsigned long long started_ms;
+    static unsigned int seq;
+    if (started_ms == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        started_ms = (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
     }
+    snprintf(id, size, "%llx-%x", started_ms, ++seq);
+}
 
-    // check if CPU usage exceeds threshold
-    if (m.cpu >= 0 && m.cpu > t.cpu) {
-        
-        snprintf(alarm_message, sizeof(alarm_message), "CPU usage (%.1f%%) exceeds threshold (%.1f%%)", m.cpu, t.cpu);
-        log_message("ALARM: %s", alarm_message); 
-        // Format JSON payload with alarm details and metrics
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        // Attempt to send alarm to Cloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); // success
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); // failure
-        }
-        alarm_triggered = 1; 
+// write every valid metric in the table as the member "metrics":{"memory":8.25,"cpu":3.10,...}
+static void write_metrics(JsonWriter *w) {
+    int n = metric_count();
+    json_key(w, "metrics");
+    json_object_begin(w);
+    for (int id = 0; id < n; id++) {
+        if (!metric_valid(id)) continue;
+        double v = metric_value(id);
+        // counters are printed without decimals, percentages with two
+        json_key(w, metric_name(id));
+        if (v == (long long)v) json_int(w, (long long)v);
+        else json_double(w, v, 2);
     }
+    json_object_end(w);
+}
 
-    // check if disk usage exceeds threshold
-    if (m.disk >= 0 && m.disk > t.disk) {
-        // alarm message for disk usage
-        snprintf(alarm_message, sizeof(alarm_message), "Disk usage (%.1f%%) exceeds threshold (%.1f%%)", m.disk, t.disk);
-        log_message("ALARM: %s", alarm_message); 
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        // attempt to send alarm to Cloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); //success log
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); // failure log
+// write the top processes as the member "top":{"truncated":false,"cpu":[{"pid":1,"name":"x","cpu":9.5,"rss_kb":100}],"rss":[...]}
+// writes nothing when no scan was made
+static void write_top(JsonWriter *w, const TopProcesses *top) {
+    if (!top || top->scanned == 0) return;
+    const ProcessUsage *lists[2] = { top->cpu, top->rss };
+    int counts[2] = { top->n_cpu, top->n_rss };
+    json_key(w, "top");
+    json_object_begin(w);
+    json_key(w, "truncated");
+    json_bool(w, top->truncated);
+    for (int l = 0; l < 2; l++) {
+        json_key(w, l == 0 ? "cpu" : "rss");
+        json_array_begin(w);
+        for (int i = 0; i < counts[l]; i++) {
+            json_object_begin(w);
+            json_member_int(w, "pid", lists[l][i].pid);
+            // process names come from the processes themselves: the writer escapes them
+            json_member_string(w, "name", lists[l][i].name);
+            json_member_double(w, "cpu", lists[l][i].cpu, 1);
+            json_member_int(w, "rss_kb", lists[l][i].rss_kb);
+            json_object_end(w);
         }
-        alarm_triggered = 1; 
+        json_array_end(w);
     }
+    json_object_end(w);
+}
 
-    // check if uptime exceeds threshold
-    if (m.uptime >= 0 && m.uptime > t.uptime) {
-        // alarm message for uptime
-        snprintf(alarm_message, sizeof(alarm_message), "Uptime (%.1f seconds) exceeds threshold (%.1f seconds)", m.uptime, t.uptime);
-        log_message("ALARM: %s", alarm_message); 
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        // attempt to send alarm to Cloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); // Success
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); // Failure
-        }
-        alarm_triggered = 1; 
+// alarms of one check being collected into one payload: a JSON array of alarm objects
+typedef struct {
+    JsonWriter json;
+    char storage[ALARM_PAYLOAD_SIZE];
+    int count;
+    int priority;                       // highest severity in the batch
+    char message[256];                  // logged when the request ends
+    unsigned long long repeats;         // rules re-notified, when the batch holds nothing else
+    int only_repeats;
+} AlarmBatch;
+
+// add one encoded alarm object to the batch. rule is the index of a re-notified rule, -1 for
+// other events. returns 0 if the alarm does not fit
+static int batch_add(AlarmBatch *b, const JsonWriter *alarm, const char *message, int severity, int rule) {
+    if (b->count == 0) {
+        json_init(&b->json, b->storage, sizeof(b->storage));
+        json_array_begin(&b->json);
+        b->priority = severity;
+        b->repeats = 0;
+        b->only_repeats = 1;
+        snprintf(b->message, sizeof(b->message), "%s", message);
     }
+    // room for the separator, the closing bracket and the terminator: the batch never grows
+    if (json_len(&b->json) + json_len(alarm) + 3 > sizeof(b->storage)) return 0;
+    json_raw(&b->json, json_text(alarm), json_len(alarm));
+    b->count++;
+    if (severity > b->priority) b->priority = severity;
+    if (rule < 0) b->only_repeats = 0;
+    else b->repeats |= 1ULL << rule;
+    return 1;
+}
 
-    // check if number of network interfaces exceeds threshold
-    if (m.net_interfaces >= 0 && m.net_interfaces > t.net_interfaces) {
-        // alarm message for network interfaces
-        snprintf(alarm_message, sizeof(alarm_message), "Network interfaces (%d) exceeds threshold (%d)", m.net_interfaces, t.net_interfaces);
-        log_message("ALARM: %s", alarm_message);
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        //attempt to send alarm to Cloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); 
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); 
-        }
-        alarm_triggered = 1; // Set flag to indicate alarm was triggered
+// hand the batch to the alarm queue and empty it. A batch of repeats only is keyed by the rules
+// it repeats, so a newer repeat of the same rules still waiting in the queue replaces it
+static void queue_batch(AlarmBatch *b) {
+    char key[ALARM_KEY_LEN];
+    char message[256];
+    if (b->count == 0) return;
+    json_array_end(&b->json);
+    snprintf(key, sizeof(key), "rules.%llx", b->repeats);
+    snprintf(message, sizeof(message), b->count > 1 ? "%.200s (+%d more)" : "%.200s", b->message, b->count - 1);
+    char *payload = b->json.buf;
+    if (b->count == 1) {
+        // a lone alarm goes as a plain object: drop the brackets
+        payload[json_len(&b->json) - 1] = '\0';
+        payload++;
     }
+    alarm_queue_push(b->only_repeats ? key : NULL, b->priority, message, payload);
+    b->count = 0;
+}
+
+// 1 if a rule on cpu or memory usage or pressure is within TOP_NEAR_RATIO of firing. io stalls
+// are not attributed by a cpu/rss ranking
+static int near_cpu_or_memory(const AlarmRuleSet *rules) {
+    int cpu_pressure = metric_find("pressure.cpu");
+    int memory_pressure = metric_find("pressure.memory");
+    for (int i = 0; i < rules->count; i++) {
+        int id = rules->metric[i];
+        if (id < 0 || (id != METRIC_CPU && id != METRIC_MEMORY && id != cpu_pressure && id != memory_pressure)) continue;
+        if (rules->cmp[i] == RULE_ABOVE && metric_valid(id) && metric_value(id) > rules->threshold[i] * TOP_NEAR_RATIO)
+            return 1;
+    }
+    return 0;
+}
+
+// advance the alarm rules on the metric table and send their raise, renotify and clear events
+int check_alarms(AlarmRuleSet *rules, long long now_ms) {
+    AlarmEvent events[MAX_ALARM_RULES];
+    int n_events = alarm_rules_evaluate(rules, now_ms, events);
+
+    // rank processes only while cpu or memory is close to its threshold: the scan near the
+    // threshold gives the next one a baseline for per-process cpu, and costs nothing otherwise
+    static TopProcesses top;
+    top.scanned = 0;
+    if (near_cpu_or_memory(rules)) top_processes_scan(&top);
+    if (n_events == 0) return 0;
+
+    // the alarms of one check go out as one request: a JSON array whose first alarm carries the
+    // metrics and top processes. A single alarm stays a plain object
+    char alarm_message[256];
+    char alarm_id[32];
+    char alarm_storage[2048];
+    JsonWriter alarm;
+    static AlarmBatch batch;
+    json_init(&alarm, alarm_storage, sizeof(alarm_storage));
+    batch.count = 0;
 
-    // check if process count exceeds threshold
-    if (m.processes >= 0 && m.processes > t.processes) {
-        // alarm message for process count
-        snprintf(alarm_message, sizeof(alarm_message), "Process count (%d) exceeds threshold (%d)", m.processes, t.processes);
-        log_message("ALARM: %s", alarm_message); // Log the alarm message
-        snprintf(json_payload, sizeof(json_payload), 
-                 "{\"type\":\"alarm\",\"message\":\"%s\",\"metrics\":{\"memory\":%.1f,\"cpu\":%.1f,\"disk\":%.1f,\"uptime\":%.1f,\"net_interfaces\":%d,\"processes\":%d}}",
-                 alarm_message, m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-        // attempt to send alarm to Cloud Manager
-        if (send_http("http://127.0.0.1:8082/alarm", json_payload)) {
-            log_message("INFO: Alarm sent to Cloud Manager: %s", alarm_message); // log success
-        } else {
-            log_message("ERROR: Failed to send alarm to Cloud Manager: %s", alarm_message); // log failure
+    int alarmed = 0;
+    for (int e = 0; e < n_events; e++) {
+        int i = events[e].rule;
+        int clear = events[e].type == ALARM_CLEAR;
+        alarm_rule_message(rules, &events[e], alarm_message, sizeof(alarm_message));
+        if (clear) log_message("INFO: Alarm cleared: %s", alarm_message);
+        else log_message("ALARM: %s%s", alarm_message, events[e].type == ALARM_RENOTIFY ? " (still active)" : "");
+        alarmed |= !clear;
+        next_alarm_id(alarm_id, sizeof(alarm_id));
+
+        // an alarm that does not fit the current batch starts a new one, which carries the
+        // metrics; if the metrics alone exceed a payload the alarm goes without them
+        int drop_metrics = 0;
+        while (1) {
+            json_reset(&alarm);
+            json_object_begin(&alarm);
+            json_member_string(&alarm, "type", "alarm");
+            json_member_string(&alarm, "id", alarm_id);
+            json_member_string(&alarm, "event", alarm_event_name(events[e].type));
+            json_member_string(&alarm, "message", alarm_message);
+            json_member_string(&alarm, "severity", alarm_severity_name(rules->info[i].severity));
+            json_member_string(&alarm, "metric", metric_name(rules->metric[i]));
+            if (batch.count == 0 && !drop_metrics) {
+                write_metrics(&alarm);
+                if (!clear) write_top(&alarm, &top);
+            }
+            json_object_end(&alarm);
+            if (json_failed(&alarm)) break;
+            if (batch_add(&batch, &alarm, alarm_message, rules->info[i].severity,
+                          events[e].type == ALARM_RENOTIFY ? i : -1)) break;
+            if (batch.count > 0) {
+                queue_batch(&batch);
+            } else if (!drop_metrics) {
+                log_message("WARNING: Metrics do not fit an alarm (%zu bytes), sending it without them", json_len(&alarm));
+                drop_metrics = 1;
+            } else {
+                break;
+            }
         }
-        alarm_triggered = 1; // Set flag to indicate alarm was triggered
     }
+    queue_batch(&batch);
+    json_free(&alarm);
+    return alarmed; // 1 if an alarm was raised or repeated
+}
+
+// state last reported for each interface, and the changes held back since
+typedef struct {
+    char ifname[32];
+    int reported;               // state in the last alarm sent
+    int up;                     // latest state seen
+    int flaps;                  // changes held back since the last alarm was sent
+    long long sent_ms;
+} LinkState;
+
+static LinkState links[MAX_LINK_STATES];
+static int n_links = 0;
+
+// entry of ifname; when the table is full the entry idle the longest is taken over
+static LinkState *link_state(const char *ifname) {
+    LinkState *idle = NULL;
+    for (int i = 0; i < n_links; i++) {
+        if (strcmp(links[i].ifname, ifname) == 0) return &links[i];
+        if (links[i].flaps == 0 && (!idle || links[i].sent_ms < idle->sent_ms)) idle = &links[i];
+    }
+    LinkState *l = n_links < MAX_LINK_STATES ? &links[n_links++] : idle;
+    if (!l) return NULL;
+    memset(l, 0, sizeof(*l));
+    snprintf(l->ifname, sizeof(l->ifname), "%s", ifname);
+    l->reported = -1;
+    return l;
+}
 
-    return alarm_triggered; // whether any alarm was triggered
-}
\ No newline at end of file
+// queue the latest state of a link. Down is critical, up informational; up after flapping is a
+// warning, so the cloud sees the link was unstable
+static int queue_link_alarm(LinkState *l, long long now_ms) {
+    char alarm_message[256];
+    char alarm_id[32];
+    char storage[512];
+    char key[ALARM_KEY_LEN];
+    JsonWriter w;
+    int up = l->up;
+
+    if (l->flaps > 0)
+        snprintf(alarm_message, sizeof(alarm_message), "Link %s is %s after %d changes", l->ifname, up ? "up" : "down", l->flaps);
+    else
+        snprintf(alarm_message, sizeof(alarm_message), "Link %s is %s", l->ifname, up ? "up" : "down");
+    json_init(&w, storage, sizeof(storage));
+    json_object_begin(&w);
+    next_alarm_id(alarm_id, sizeof(alarm_id));
+    json_member_string(&w, "type", "alarm");
+    json_member_string(&w, "id", alarm_id);
+    json_member_string(&w, "message", alarm_message);
+    json_member_string(&w, "interface", l->ifname);
+    json_member_string(&w, "state", up ? "up" : "down");
+    if (l->flaps > 0) json_member_int(&w, "changes", l->flaps);
+    json_object_end(&w);
+    // a newer state of the link replaces one still waiting to be sent
+    snprintf(key, sizeof(key), "link.%s", l->ifname);
+    int severity = !up ? SEVERITY_CRITICAL : l->flaps > 0 ? SEVERITY_WARNING : SEVERITY_INFO;
+    int queued = !json_failed(&w) && alarm_queue_push(key, severity, alarm_message, json_text(&w));
+    json_free(&w);
+    l->reported = up;
+    l->flaps = 0;
+    l->sent_ms = now_ms;
+    return queued;
+}
+
+int send_link_alarm(const char *ifname, int up, long long now_ms) {
+    LinkState *l = link_state(ifname);
+    if (!l) return 0;
+    if (l->reported >= 0 && up == l->up) return 0;
+    l->up = up;
+    if (l->reported >= 0 && now_ms - l->sent_ms < LINK_HOLD_MS) {
+        l->flaps++;
+        return 0;
+    }
+    return queue_link_alarm(l, now_ms);
+}
+
+int send_held_link_alarms(long long now_ms) {
+    int queued = 0;
+    for (int i = 0; i < n_links; i++) {
+        // a link that flapped back to the state already reported is still worth one alarm
+        if (links[i].flaps > 0 && now_ms - links[i].sent_ms >= LINK_HOLD_MS)
+            queued += queue_link_alarm(&links[i], now_ms);
+    }
+    return queued;
+}
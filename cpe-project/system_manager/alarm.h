@@ -3,12 +3,27 @@
 #ifndef ALARM_H
 #define ALARM_H
 
-#include "metrics.h"
 #include "config.h"
+#include "alarm_rules.h"
 #include "logger.h"
 
-// check if metrics exceed specified thresholds
-// returns an integer indicating alert status
-int check_alarms(Metrics m, Thresholds t);
+// evaluate the alarm rules against the current metric table and queue the resulting raise,
+// renotify and clear events on the alarm queue (see alarm_rules_evaluate). returns 1 if an alarm was raised or repeated
+int check_alarms(AlarmRuleSet *rules, long long now_ms);
+
+// interfaces whose link state is tracked for debouncing
+#define MAX_LINK_STATES 32
+// a link that changes again within this long of its last alarm is held back
+#define LINK_HOLD_MS 5000
+
+// report a link up/down transition to the Cloud Manager: down as critical, up as info. Changes
+// within LINK_HOLD_MS of the link's last alarm are held and sent by send_held_link_alarms, so a
+// flapping port raises one alarm per hold with its latest state.
+// returns 1 if the alarm was queued for sending
+int send_link_alarm(const char *ifname, int up, long long now_ms);
+
+// queue the latest state of links whose hold has run out with changes held back.
+// returns the number of alarms queued
+int send_held_link_alarms(long long now_ms);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,260 @@
+// compound threshold conditions: parsed once per thresholds.conf load into postfix bytecode,
+// evaluated on every check against the metric arrays
+
+#include "alarm_expr.h"
+#include "metric_registry.h"
+#include "metric_trend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+// opcodes
+enum {
+    EXPR_METRIC,    // push the value of metric arg, NaN if invalid
+    EXPR_CONST,     // push consts[arg]
+    EXPR_GT, EXPR_GE, EXPR_LT, EXPR_LE,     // pop b, a; push a <op> b
+    EXPR_AND, EXPR_OR,                      // pop b, a; push a && b / a || b
+    EXPR_NOT,                               // pop a; push !a
+    // "metric <op> constant", the common case, fused into one op: arg is the metric id and
+    // consts[] at the op's own index the constant
+    EXPR_GT_MC, EXPR_GE_MC, EXPR_LT_MC, EXPR_LE_MC
+};
+
+// parser state
+typedef struct {
+    const char *p;
+    AlarmExpr *expr;
+    char *err;
+    size_t err_size;
+    int failed;
+} Parser;
+
+static int parse_or(Parser *ps);
+
+static void skip_space(Parser *ps) {
+    while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int fail(Parser *ps, const char *what) {
+    if (!ps->failed) snprintf(ps->err, ps->err_size, "%s at \"%.20s\"", what, ps->p);
+    ps->failed = 1;
+    return -1;
+}
+
+static int emit(Parser *ps, int op, int arg) {
+    AlarmExpr *e = ps->expr;
+    if (e->n_ops >= EXPR_MAX_OPS) return fail(ps, "expression too long");
+    e->op[e->n_ops] = (unsigned char)op;
+    e->arg[e->n_ops] = (short)arg;
+    e->n_ops++;
+    return 0;
+}
+
+// 1 and consume tok if the input continues with it
+static int accept(Parser *ps, const char *tok) {
+    skip_space(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0) return 0;
+    ps->p += n;
+    return 1;
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '/' || c == '-';
+}
+
+// decimal literal: [+-]digits[.digits][e[+-]digits]. strtod alone would also take nan, inf and
+// hex floats. returns 1 with the value in *v, 0 if the input does not start with a number,
+// -1 if it does not fit a double
+static int parse_number(Parser *ps, double *v) {
+    const char *p = ps->p;
+    if (*p == '+' || *p == '-') p++;
+    const char *digits = p;
+    while (isdigit((unsigned char)*p)) p++;
+    int n_digits = p - digits;
+    if (*p == '.') p++;
+    while (isdigit((unsigned char)*p)) p++, n_digits++;
+    if (n_digits == 0) return 0;
+    if (*p == 'e' || *p == 'E') {
+        const char *e = p + 1;
+        if (*e == '+' || *e == '-') e++;
+        if (isdigit((unsigned char)*e)) {
+            while (isdigit((unsigned char)*e)) e++;
+            p = e;
+        }
+    }
+    char literal[64];
+    if ((size_t)(p - ps->p) >= sizeof(literal)) return fail(ps, "number too long");
+    memcpy(literal, ps->p, p - ps->p);
+    literal[p - ps->p] = '\0';
+    *v = strtod(literal, NULL);
+    if (!isfinite(*v)) return fail(ps, "number out of range");
+    ps->p = p;
+    return 1;
+}
+
+// operand := number | metric name
+static int parse_operand(Parser *ps) {
+    skip_space(ps);
+    double v;
+    int number = parse_number(ps, &v);
+    if (number < 0) return -1;
+    if (number) {
+        // constants live next to the code; the op slot index is free to reuse as their index.
+        // emit checks for room first, so the constant is stored after it
+        if (emit(ps, EXPR_CONST, ps->expr->n_ops) < 0) return -1;
+        ps->expr->consts[ps->expr->n_ops - 1] = v;
+        return 0;
+    }
+    const char *start = ps->p;
+    while (is_name_char(*ps->p)) ps->p++;
+    size_t len = ps->p - start;
+    if (len == 0) return fail(ps, "expected a metric or a number");
+    if (len >= METRIC_NAME_LEN) return fail(ps, "metric name too long");
+    char name[METRIC_NAME_LEN];
+    memcpy(name, start, len);
+    name[len] = '\0';
+    // nan and inf are not constants here, and no collector publishes metrics by those names
+    const char *word = name + (name[0] == '+' || name[0] == '-');
+    if (strcasecmp(word, "nan") == 0 || strcasecmp(word, "inf") == 0 || strcasecmp(word, "infinity") == 0) {
+        ps->p = start;
+        return fail(ps, "non-finite constant");
+    }
+    // a trend is computed from its source; other metrics may be reserved before they are published
+    int id = trend_register(name);
+    if (id < 0) id = metric_register(name);
+    if (id < 0) return fail(ps, "metric table full");
+    if (emit(ps, EXPR_METRIC, id) < 0) {
+        if (trend_release(id) < 0) metric_unref(id);
+        return -1;
+    }
+    return 0;
+}
+
+// comparison := operand op operand
+static int parse_comparison(Parser *ps) {
+    if (parse_operand(ps) < 0) return -1;
+    int op;
+    if (accept(ps, ">=")) op = EXPR_GE;
+    else if (accept(ps, "<=")) op = EXPR_LE;
+    else if (accept(ps, ">")) op = EXPR_GT;
+    else if (accept(ps, "<")) op = EXPR_LT;
+    else return fail(ps, "expected a comparison");
+    if (parse_operand(ps) < 0) return -1;
+    AlarmExpr *e = ps->expr;
+    int n = e->n_ops;
+    if (n >= 2 && e->op[n - 2] == EXPR_METRIC && e->op[n - 1] == EXPR_CONST) {
+        e->op[n - 2] = (unsigned char)(op - EXPR_GT + EXPR_GT_MC);
+        e->consts[n - 2] = e->consts[e->arg[n - 1]];
+        e->n_ops--;
+        return 0;
+    }
+    return emit(ps, op, 0);
+}
+
+static int parse_unary(Parser *ps) {
+    if (accept(ps, "!")) {
+        if (parse_unary(ps) < 0) return -1;
+        return emit(ps, EXPR_NOT, 0);
+    }
+    if (accept(ps, "(")) {
+        if (parse_or(ps) < 0) return -1;
+        if (!accept(ps, ")")) return fail(ps, "expected )");
+        return 0;
+    }
+    return parse_comparison(ps);
+}
+
+static int parse_and(Parser *ps) {
+    if (parse_unary(ps) < 0) return -1;
+    while (accept(ps, "&&")) {
+        if (parse_unary(ps) < 0) return -1;
+        if (emit(ps, EXPR_AND, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+static int parse_or(Parser *ps) {
+    if (parse_and(ps) < 0) return -1;
+    while (accept(ps, "||")) {
+        if (parse_and(ps) < 0) return -1;
+        if (emit(ps, EXPR_OR, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+// "for <n>[s|m|h]" at the end of the condition
+static int parse_hold(Parser *ps, long long *hold_ms) {
+    *hold_ms = 0;
+    skip_space(ps);
+    if (strncmp(ps->p, "for", 3) != 0 || !isspace((unsigned char)ps->p[3])) return 0;
+    ps->p += 3;
+    skip_space(ps);
+    double n;
+    int number = parse_number(ps, &n);
+    if (number < 0) return -1;
+    if (!number || n < 0) return fail(ps, "expected a duration");
+    double unit = 1000;
+    if (*ps->p == 's') ps->p++;
+    else if (*ps->p == 'm') unit = 60000, ps->p++;
+    else if (*ps->p == 'h') unit = 3600000, ps->p++;
+    *hold_ms = (long long)(n * unit);
+    return 0;
+}
+
+int alarm_expr_compile(const char *text, AlarmExpr *expr, long long *hold_ms, char *err, size_t err_size) {
+    Parser ps = { text, expr, err, err_size, 0 };
+    expr->n_ops = 0;
+    int rc = parse_or(&ps) < 0 || parse_hold(&ps, hold_ms) < 0 ? -1 : 0;
+    skip_space(&ps);
+    if (rc == 0 && *ps.p) rc = fail(&ps, "unexpected input");
+    if (rc < 0) {
+        // the metrics named before the error were registered
+        alarm_expr_release(expr);
+        expr->n_ops = 0;
+    }
+    return rc;
+}
+
+void alarm_expr_release(const AlarmExpr *expr) {
+    for (int i = 0; i < expr->n_ops; i++) {
+        int op = expr->op[i];
+        if ((op == EXPR_METRIC || op >= EXPR_GT_MC) && trend_release(expr->arg[i]) < 0) metric_unref(expr->arg[i]);
+    }
+}
+
+int alarm_expr_unpublished(const AlarmExpr *expr) {
+    for (int i = 0; i < expr->n_ops; i++) {
+        int op = expr->op[i];
+        if ((op == EXPR_METRIC || op >= EXPR_GT_MC) && !metric_published(expr->arg[i])) return expr->arg[i];
+    }
+    return -1;
+}
+
+int alarm_expr_eval(const AlarmExpr *expr, const double *values, const unsigned char *valid) {
+    double stack[EXPR_MAX_OPS];
+    int sp = 0;
+    for (int i = 0; i < expr->n_ops; i++) {
+        int arg = expr->arg[i];
+        // comparisons with NaN are false, which is what an invalid metric should give
+        switch (expr->op[i]) {
+        case EXPR_METRIC: stack[sp++] = valid[arg] ? values[arg] : NAN; break;
+        case EXPR_CONST: stack[sp++] = expr->consts[arg]; break;
+        case EXPR_GT: sp--; stack[sp - 1] = stack[sp - 1] > stack[sp]; break;
+        case EXPR_GE: sp--; stack[sp - 1] = stack[sp - 1] >= stack[sp]; break;
+        case EXPR_LT: sp--; stack[sp - 1] = stack[sp - 1] < stack[sp]; break;
+        case EXPR_LE: sp--; stack[sp - 1] = stack[sp - 1] <= stack[sp]; break;
+        case EXPR_AND: sp--; stack[sp - 1] = stack[sp - 1] != 0 && stack[sp] != 0; break;
+        case EXPR_OR: sp--; stack[sp - 1] = stack[sp - 1] != 0 || stack[sp] != 0; break;
+        case EXPR_NOT: stack[sp - 1] = stack[sp - 1] == 0; break;
+        case EXPR_GT_MC: stack[sp++] = valid[arg] && values[arg] > expr->consts[i]; break;
+        case EXPR_GE_MC: stack[sp++] = valid[arg] && values[arg] >= expr->consts[i]; break;
+        case EXPR_LT_MC: stack[sp++] = valid[arg] && values[arg] < expr->consts[i]; break;
+        case EXPR_LE_MC: stack[sp++] = valid[arg] && values[arg] <= expr->consts[i]; break;
+        }
+    }
+    return sp > 0 && stack[0] != 0;
+}
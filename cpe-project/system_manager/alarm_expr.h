@@ -0,0 +1,40 @@
+// header file for alarm_expr.c : compound threshold conditions compiled to bytecode
+
+#ifndef ALARM_EXPR_H
+#define ALARM_EXPR_H
+
+#include <stddef.h>
+
+// longest program and deepest evaluation stack of one expression
+#define EXPR_MAX_OPS 32
+
+// compiled expression: postfix bytecode over metric ids and constants
+typedef struct {
+    int n_ops;
+    unsigned char op[EXPR_MAX_OPS];
+    short arg[EXPR_MAX_OPS];            // metric id (EXPR_METRIC) or index in consts (EXPR_CONST)
+    double consts[EXPR_MAX_OPS];
+} AlarmExpr;
+
+// compile a condition such as "cpu > 80 && memory > 70 for 30s".
+// Grammar: or := and ("||" and)* ; and := unary ("&&" unary)* ;
+// unary := "!" unary | "(" or ")" | operand (">" | ">=" | "<" | "<=") operand ;
+// operand := number | metric name (trend names such as memory.slope included).
+// Numbers are decimal, with an optional exponent; nan, inf and hex are rejected, as is a
+// constant too large for a double.
+// An optional trailing "for <n>[s|m|h]" is returned in *hold_ms (0 without it).
+// Metric names are resolved to ids here, so evaluation does no string work.
+// returns 0 on success, -1 with a reason in err
+int alarm_expr_compile(const char *text, AlarmExpr *expr, long long *hold_ms, char *err, size_t err_size);
+
+// release the metric ids compile registered for expr
+void alarm_expr_release(const AlarmExpr *expr);
+
+// a metric the expression reads that no collector has published so far, -1 if there is none
+int alarm_expr_unpublished(const AlarmExpr *expr);
+
+// evaluate against the metric value and valid arrays (metric_values(), metric_valid_flags()).
+// a comparison on an invalid metric is false. returns 1 if the condition holds
+int alarm_expr_eval(const AlarmExpr *expr, const double *values, const unsigned char *valid);
+
+#endif
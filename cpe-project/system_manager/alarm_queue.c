@@ -0,0 +1,310 @@
+// bounded alarm queue posted without blocking: the main loop polls the HTTP sockets along with its
+// other event sources, so a slow or unreachable cloud (a post retries for up to 30 s) never holds up sampling
+
+#include "alarm_queue.h"
+#include "http_client.h"
+#include "alarm_spool.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ALARM_MESSAGE_LEN 256
+
+typedef struct {
+    char key[ALARM_KEY_LEN];        // empty = never coalesced
+    int priority;
+    char message[ALARM_MESSAGE_LEN];
+    char payload[ALARM_PAYLOAD_SIZE];
+} QueuedAlarm;
+
+// a request in flight: its body and the messages of the alarms merged into it, or the spool
+// records it replays
+typedef struct {
+    char body[ALARM_BATCH_SIZE];
+    const char *payload;            // what is posted: body, or body + 1 for a lone object
+    char messages[ALARM_QUEUE_SIZE][ALARM_MESSAGE_LEN];
+    int n;                          // alarms, or spool records for a replay; 0 = free
+    long replay_end;                // spool offset after the replayed records, -1 = live alarms
+} AlarmRequest;
+
+// queue state, only touched from the main loop. slots[] holds the alarms, order[] their slot numbers
+// oldest first, so coalescing and eviction only move ints
+static QueuedAlarm slots[ALARM_QUEUE_SIZE];
+static int order[ALARM_QUEUE_SIZE];
+static int n_pending = 0;
+static int n_dropped = 0;
+static int dropped_reported = 0;
+static int running = 0;
+static HttpAsync client;            // keep-alive connections shared by the requests in flight
+static AlarmRequest requests[HTTP_MAX_IN_FLIGHT];
+static int batch_window_ms = 0;
+static long long first_pending_ms;  // when the oldest pending alarm was queued
+static int replaying = 0;           // a replay of the spool is in flight
+
+// monotonic clock in milliseconds
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// remove position p of order[], returning its slot
+static int take(int p) {
+    int slot = order[p];
+    memmove(&order[p], &order[p + 1], (n_pending - p - 1) * sizeof(int));
+    n_pending--;
+    return slot;
+}
+
+int alarm_queue_push(const char *key, int priority, const char *message, const char *payload) {
+    int slot = -1;
+    int queued = 1;
+
+    if (strlen(payload) >= ALARM_PAYLOAD_SIZE) {
+        log_message("ERROR: Alarm payload too large (%zu bytes), dropping: %s", strlen(payload), message);
+        return 0;
+    }
+    // a newer alarm with the same key supersedes the pending one
+    for (int p = 0; key && p < n_pending; p++) {
+        if (strcmp(slots[order[p]].key, key) == 0) {
+            slot = take(p);
+            n_dropped++;
+            break;
+        }
+    }
+    if (slot < 0 && n_pending == ALARM_QUEUE_SIZE) {
+        // full: evict the oldest alarm of the lowest priority, unless this one ranks below all of them
+        int victim = 0;
+        for (int p = 1; p < n_pending; p++)
+            if (slots[order[p]].priority < slots[order[victim]].priority) victim = p;
+        n_dropped++;
+        if (slots[order[victim]].priority > priority) queued = 0;
+        else slot = take(victim);
+        // the cloud is not keeping up: keep what does not fit on disk for a later replay
+        if (slot >= 0) alarm_spool_append(slots[slot].payload);
+        else alarm_spool_append(payload);
+    }
+    if (queued && slot < 0) {
+        // first slot not referenced by order[]
+        unsigned char used[ALARM_QUEUE_SIZE] = {0};
+        for (int p = 0; p < n_pending; p++) used[order[p]] = 1;
+        for (slot = 0; used[slot]; slot++) {}
+    }
+    if (queued) {
+        QueuedAlarm *a = &slots[slot];
+        snprintf(a->key, sizeof(a->key), "%s", key ? key : "");
+        a->priority = priority;
+        snprintf(a->message, sizeof(a->message), "%s", message);
+        snprintf(a->payload, sizeof(a->payload), "%s", payload);
+        if (n_pending == 0) first_pending_ms = now_ms();
+        order[n_pending++] = slot;
+    }
+
+    if (!queued) log_message("WARNING: Alarm queue full, dropping: %s", message);
+    return queued;
+}
+
+// append the alarms of payload (an object, or an array of them) to the request at *used.
+// returns 0 if they do not fit
+static int append_alarms(char *request, size_t *used, size_t size, const char *payload) {
+    const char *start = payload;
+    size_t len = strlen(payload);
+    if (payload[0] == '[' && len >= 2) {
+        start++;
+        len -= 2;
+    }
+    // separator, closing bracket and terminator
+    if (*used + len + 3 > size) return 0;
+    if (*used > 1) request[(*used)++] = ',';
+    memcpy(request + *used, start, len);
+    *used += len;
+    request[*used] = '\0';
+    return 1;
+}
+
+// a request has been answered, or given up after its retries. Alarms that could not be sent
+// are spooled and a failed replay leaves its records in the spool for the next one. A request the
+// Cloud Manager rejected would be rejected again: it is logged and dropped, so it cannot hold up
+// the spool behind it
+static void on_request_done(void *ctx, int result) {
+    AlarmRequest *r = ctx;
+    if (r->replay_end >= 0) {
+        if (result == HTTP_SENT) {
+            log_message("INFO: Replayed %d spooled alarm records to Cloud Manager", r->n);
+            alarm_spool_consume(r->replay_end, r->n);
+        } else if (result == HTTP_REJECTED) {
+            log_message("ERROR: Cloud Manager rejected %d spooled alarm records, dropping them: %.200s", r->n, r->payload);
+            alarm_spool_consume(r->replay_end, r->n);
+        } else {
+            log_message("WARNING: Replay of %d spooled alarm records failed, keeping them", r->n);
+        }
+        replaying = 0;
+        r->n = 0;
+        return;
+    }
+    int spooled = result == HTTP_FAILED && alarm_spool_append(r->payload);
+    for (int i = 0; i < r->n; i++) {
+        if (result == HTTP_SENT) log_message("INFO: Alarm sent to Cloud Manager: %s", r->messages[i]);
+        else if (result == HTTP_REJECTED) log_message("ERROR: Cloud Manager rejected alarm, dropping it: %s", r->messages[i]);
+        else if (spooled) log_message("WARNING: Failed to send alarm to Cloud Manager, spooled for replay: %s", r->messages[i]);
+        else log_message("ERROR: Failed to send alarm to Cloud Manager: %s", r->messages[i]);
+    }
+    r->n = 0;
+}
+
+// first request not in flight, or NULL
+static AlarmRequest *free_request() {
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT; i++)
+        if (requests[i].n == 0) return &requests[i];
+    return NULL;
+}
+
+// post alarms oldest first, everything pending merged into one request.
+// returns 0 if every request is in flight
+static int send_pending() {
+    AlarmRequest *r = free_request();
+    if (!r) return 0;
+    r->replay_end = -1;
+
+    // the first alarm always fits: ALARM_BATCH_SIZE holds any payload
+    char *request = r->body;
+    size_t used = 1;
+    int single_object = slots[order[0]].payload[0] == '{';
+    request[0] = '[';
+    while (n_pending > 0 && append_alarms(request, &used, sizeof(r->body), slots[order[0]].payload)) {
+        strcpy(r->messages[r->n++], slots[take(0)].message);
+    }
+    if (n_pending > 0) first_pending_ms = now_ms();
+
+    // a lone alarm object is sent as it was queued
+    const char *body = request + 1;
+    if (r->n > 1 || !single_object) {
+        request[used++] = ']';
+        request[used] = '\0';
+        body = request;
+    }
+    int dropped = n_dropped - dropped_reported;
+    dropped_reported = n_dropped;
+    if (dropped > 0) log_message("WARNING: %d alarms dropped or coalesced while the Cloud Manager was slow", dropped);
+    // attempt to send alarm to Cloud Manager
+    r->payload = body;
+    if (http_async_post(&client, body, on_request_done, r) != 0) on_request_done(r, HTTP_FAILED);
+    return 1;
+}
+
+// post the oldest spooled records, merged into one request like live alarms.
+// returns 0 if nothing was started
+static int replay_spool() {
+    static char record[ALARM_SPOOL_RECORD_MAX];
+    AlarmRequest *r = free_request();
+    if (!r) return 0;
+    char *request = r->body;
+    size_t used = 1;
+    long pos = alarm_spool_start();
+    long next = pos;
+    request[0] = '[';
+    r->n = 0;
+    while (alarm_spool_next(&next, record, sizeof(record))) {
+        if (!append_alarms(request, &used, sizeof(r->body), record)) {
+            // a record is a request that once fitted: alone, it goes as it was
+            if (r->n == 0) {
+                strcpy(request, record);
+                used = 0;
+                pos = next;
+                r->n = 1;
+            }
+            break;
+        }
+        pos = next;
+        r->n++;
+    }
+    if (r->n == 0) return 0;
+    if (used > 0) {
+        request[used++] = ']';
+        request[used] = '\0';
+    }
+    r->payload = request;
+    r->replay_end = pos;
+    replaying = 1;
+    log_message("INFO: Replaying %d spooled alarm records", r->n);
+    if (http_async_post(&client, r->payload, on_request_done, r) != 0) on_request_done(r, HTTP_FAILED);
+    return 1;
+}
+
+int alarm_queue_start(const char *url, int batch_ms) {
+    batch_window_ms = batch_ms;
+    if (http_async_init(&client, url) != 0) return -1;
+    running = 1;
+    return 0;
+}
+
+int alarm_queue_pollfds(struct pollfd *pfds, int max) {
+    return running ? http_async_pollfds(&client, pfds, max) : 0;
+}
+
+int alarm_queue_timeout() {
+    if (!running) return -1;
+    int wait = http_async_timeout(&client);
+    int circuit = http_async_wait_ms(&client);
+    int can_send = http_async_in_flight(&client) < HTTP_MAX_IN_FLIGHT && circuit >= 0;
+    long long left = -1;
+    if (n_pending > 0 && can_send) {
+        // let the alarms right behind the first one join its request; while the cloud is down
+        // they wait in the queue for the circuit instead
+        left = first_pending_ms + batch_window_ms - now_ms();
+        if (left < circuit) left = circuit;
+        if (left < 0) left = 0;
+    } else if (n_pending == 0 && !replaying && alarm_spool_records() > 0 && can_send) {
+        left = circuit;
+    }
+    if (left >= 0 && (wait < 0 || left < wait)) wait = (int)left;
+    // group commit of the spool
+    int sync = alarm_spool_sync_due_ms();
+    if (sync >= 0 && (wait < 0 || sync < wait)) wait = sync;
+    return wait;
+}
+
+void alarm_queue_run(const struct pollfd *pfds, int n) {
+    if (!running) return;
+    http_async_run(&client, pfds, n);
+    while (n_pending > 0 && now_ms() >= first_pending_ms + batch_window_ms &&
+           http_async_in_flight(&client) < HTTP_MAX_IN_FLIGHT && http_async_wait_ms(&client) == 0 &&
+           send_pending()) {}
+    // the spool is replayed when live alarms are out of the way, one request at a time
+    if (n_pending == 0 && !replaying && alarm_spool_records() > 0 &&
+        http_async_in_flight(&client) < HTTP_MAX_IN_FLIGHT && http_async_wait_ms(&client) == 0) {
+        replay_spool();
+    }
+    alarm_spool_sync(0);
+}
+
+int alarm_queue_pending() {
+    return n_pending;
+}
+
+int alarm_queue_dropped() {
+    return n_dropped;
+}
+
+void alarm_queue_stop() {
+    // unsent alarms go to the spool when there is one
+    int spooled = 0;
+    for (int p = 0; p < n_pending; p++) spooled += alarm_spool_append(slots[order[p]].payload);
+    if (n_pending > spooled) log_message("WARNING: Discarding %d unsent alarms", n_pending - spooled);
+    n_pending = 0;
+    if (running) {
+        int in_flight = http_async_in_flight(&client);
+        if (in_flight > 0) log_message("WARNING: Abandoning %d alarm requests in flight", in_flight);
+        http_async_cleanup(&client);
+        for (int i = 0; i < HTTP_MAX_IN_FLIGHT; i++) {
+            // live requests may not have arrived: spool them, the receiver drops duplicates by id
+            if (requests[i].n > 0 && requests[i].replay_end < 0) spooled += alarm_spool_append(requests[i].payload);
+            requests[i].n = 0;
+        }
+    }
+    if (spooled > 0) log_message("INFO: Spooled %d unsent alarm requests", spooled);
+    alarm_spool_sync(1);
+    replaying = 0;
+    running = 0;
+}
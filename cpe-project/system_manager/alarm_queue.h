@@ -0,0 +1,58 @@
+// header file for alarm_queue.c : alarms sent to the Cloud Manager without blocking the sampling loop
+
+#ifndef ALARM_QUEUE_H
+#define ALARM_QUEUE_H
+
+#include <poll.h>
+
+// alarms waiting to be sent
+#define ALARM_QUEUE_SIZE 32
+// largest alarm payload: one alarm object, or an array of the alarms of one check
+#define ALARM_PAYLOAD_SIZE 8192
+// largest request the sender makes when it merges pending alarms
+#define ALARM_BATCH_SIZE 16384
+// longest coalescing key
+#define ALARM_KEY_LEN 64
+
+// start posting queued alarms to url. Alarms pending together are merged into one JSON array per
+// request, and several requests may be in flight at once; with batch_ms > 0 a request waits that
+// long after its first alarm so the ones right behind it share it. While the circuit breaker of
+// the HTTP client is open, alarms stay queued and go out once a probe request gets through.
+// Requests that fail for good are appended to the alarm spool, if open, which is replayed one
+// request at a time whenever no live alarm is waiting.
+// Nothing is sent by itself: the caller's poll loop drives the requests (see alarm_queue_run).
+// All alarm_queue functions are called from that loop's thread.
+// returns 0 on success, -1 if the HTTP client could not be set up
+int alarm_queue_start(const char *url, int batch_ms);
+
+// copy the sockets of the requests in flight into pfds (at most max), for the caller's poll().
+// returns how many were copied
+int alarm_queue_pollfds(struct pollfd *pfds, int max);
+
+// milliseconds the caller's poll() may wait before alarm_queue_run is due, -1 = until a socket is ready
+int alarm_queue_timeout();
+
+// advance the requests in flight and start new ones for pending alarms. pfds are the entries
+// filled by alarm_queue_pollfds, with revents set by poll()
+void alarm_queue_run(const struct pollfd *pfds, int n);
+
+// queue an alarm and return at once. message is what gets logged, payload the JSON body:
+// an alarm object or an array of them.
+// a pending alarm with the same key (NULL = never coalesce) is replaced by this one, which goes
+// to the back of the queue. When the queue is full the oldest pending alarm of the lowest
+// priority is dropped, or this one if everything pending has a higher priority; the dropped alarm
+// goes to the alarm spool when one is open.
+// payloads of ALARM_PAYLOAD_SIZE bytes or more are refused.
+// returns 1 if queued, 0 if dropped
+int alarm_queue_push(const char *key, int priority, const char *message, const char *payload);
+
+// alarms waiting to be sent
+int alarm_queue_pending();
+
+// alarms dropped or coalesced away since start
+int alarm_queue_dropped();
+
+// stop sending: pending alarms and requests in flight are spooled when a spool is open, discarded otherwise
+void alarm_queue_stop();
+
+#endif
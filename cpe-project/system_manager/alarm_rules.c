@@ -0,0 +1,285 @@
+// threshold rules: compiled once per thresholds.conf load, evaluated on every check
+
+#include "alarm_rules.h"
+#include "metric_registry.h"
+#include "metric_trend.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+// built-in thresholds: where the value lives in Thresholds and how the alarm reads.
+// Adding a built-in threshold means adding a row here
+static const struct {
+    const char *key;        // key in thresholds.conf, also used for "<key>.clear"
+    int metric;
+    size_t offset;          // offset of the threshold in Thresholds
+    int is_int;             // the threshold is an int field, not a float
+    AlarmRuleInfo info;
+} builtin_rules[] = {
+    { "memory", METRIC_MEMORY, offsetof(Thresholds, memory), 0, { "Memory usage", "%", 1, SEVERITY_CRITICAL } },
+    { "cpu", METRIC_CPU, offsetof(Thresholds, cpu), 0, { "CPU usage", "%", 1, SEVERITY_CRITICAL } },
+    { "disk", METRIC_DISK, offsetof(Thresholds, disk), 0, { "Disk usage", "%", 1, SEVERITY_CRITICAL } },
+    { "uptime", METRIC_UPTIME, offsetof(Thresholds, uptime), 0, { "Uptime", " seconds", 1, SEVERITY_INFO } },
+    { "net_interfaces", METRIC_NET_INTERFACES, offsetof(Thresholds, net_interfaces), 1, { "Network interfaces", "", 0, SEVERITY_WARNING } },
+    { "processes", METRIC_PROCESSES, offsetof(Thresholds, processes), 1, { "Process count", "", 0, SEVERITY_WARNING } },
+};
+
+// pressure thresholds: the share of time tasks stall, published by psi_monitor as
+// pressure.<resource>. 0 disables the rule
+static const struct {
+    const char *key;
+    const char *metric;
+    size_t offset;          // offset of the float threshold in Thresholds
+    AlarmRuleInfo info;
+} pressure_rules[] = {
+    { "cpu_pressure", "pressure.cpu", offsetof(Thresholds, cpu_pressure), { "CPU pressure", "%", 1, SEVERITY_CRITICAL } },
+    { "memory_pressure", "pressure.memory", offsetof(Thresholds, memory_pressure), { "Memory pressure", "%", 1, SEVERITY_CRITICAL } },
+    { "io_pressure", "pressure.io", offsetof(Thresholds, io_pressure), { "IO pressure", "%", 1, SEVERITY_CRITICAL } },
+};
+
+// clear point of the rule named key: the explicit "<key>.clear" value, or the threshold moved
+// back by alarm_hysteresis percent
+static double clear_point(const Thresholds *t, const char *key, int cmp, double threshold) {
+    double margin = threshold * t->alarm_hysteresis / 100;
+    double clear = cmp == RULE_ABOVE ? threshold - margin : threshold + margin;
+    for (int c = 0; c < t->n_clears; c++) {
+        if (strcmp(t->clears[c].name, key) != 0) continue;
+        // a clear point past the threshold would flap between raise and clear
+        if (cmp == RULE_ABOVE ? t->clears[c].value > threshold : t->clears[c].value < threshold) {
+            log_message("WARNING: Clear point %.2f of %s is past its threshold, using %.2f",
+                        t->clears[c].value, key, clear);
+        } else {
+            clear = t->clears[c].value;
+        }
+        break;
+    }
+    return clear;
+}
+
+// sustained duration of the rule named key ("<key>.for"), 0 if none
+static long long hold_time_ms(const Thresholds *t, const char *key) {
+    for (int h = 0; h < t->n_holds; h++)
+        if (strcmp(t->holds[h].name, key) == 0) return (long long)(t->holds[h].value * 1000);
+    return 0;
+}
+
+static void add_rule(AlarmRuleSet *set, int metric, int cmp, double threshold, double clear, long long hold_ms,
+                     AlarmRuleInfo info) {
+    if (metric < 0 || set->count >= MAX_ALARM_RULES) return;
+    int i = set->count++;
+    set->metric[i] = metric;
+    set->cmp[i] = (unsigned char)cmp;
+    set->threshold[i] = threshold;
+    set->clear[i] = clear;
+    set->hold_ms[i] = hold_ms;
+    set->expr[i] = -1;
+    set->info[i] = info;
+    set->breaches[i] = 0;
+    set->breach_ms[i] = 0;
+    set->active[i] = 0;
+    set->notified_ms[i] = 0;
+}
+
+// drop a reference taken with trend_register or metric_register
+static void release_metric(int id) {
+    if (trend_release(id) < 0) metric_unref(id);
+}
+
+// keep the id compile registered for the rule just added, or give it back if the rule was not added
+static void hold_metric(AlarmRuleSet *set, int id, int before) {
+    if (set->count > before) set->held[set->n_held++] = id;
+    else if (id >= 0) release_metric(id);
+}
+
+int alarm_rules_compile(const Thresholds *t, AlarmRuleSet *set) {
+    // the previous table, to carry alarm state over to the new one
+    static AlarmRuleSet old;
+    old = *set;
+
+    set->count = 0;
+    set->n_held = 0;
+    for (size_t r = 0; r < sizeof(builtin_rules) / sizeof(builtin_rules[0]); r++) {
+        const char *field = (const char *)t + builtin_rules[r].offset;
+        double threshold = builtin_rules[r].is_int ? *(const int *)field : *(const float *)field;
+        add_rule(set, builtin_rules[r].metric, RULE_ABOVE, threshold,
+                 clear_point(t, builtin_rules[r].key, RULE_ABOVE, threshold),
+                 hold_time_ms(t, builtin_rules[r].key), builtin_rules[r].info);
+    }
+    for (size_t r = 0; r < sizeof(pressure_rules) / sizeof(pressure_rules[0]); r++) {
+        float threshold = *(const float *)((const char *)t + pressure_rules[r].offset);
+        if (threshold <= 0) continue;
+        int id = metric_register(pressure_rules[r].metric);
+        int before = set->count;
+        add_rule(set, id, RULE_ABOVE, threshold, clear_point(t, pressure_rules[r].key, RULE_ABOVE, threshold),
+                 hold_time_ms(t, pressure_rules[r].key), pressure_rules[r].info);
+        hold_metric(set, id, before);
+    }
+    for (int m = 0; m < t->n_metrics; m++) {
+        // a trend is computed from its source metric; any other name is looked up directly:
+        // metric_register returns the existing id, or reserves one the collector will fill later
+        const char *name = t->metrics[m].name;
+        int id = trend_register(name);
+        if (id < 0) id = metric_register(name);
+        int cmp = t->metrics[m].below ? RULE_BELOW : RULE_ABOVE;
+        AlarmRuleInfo info = { metric_name(id), "", 2, SEVERITY_WARNING };
+        int before = set->count;
+        add_rule(set, id, cmp, t->metrics[m].value, clear_point(t, name, cmp, t->metrics[m].value),
+                 hold_time_ms(t, name), info);
+        hold_metric(set, id, before);
+    }
+    set->n_exprs = 0;
+    for (int x = 0; x < t->n_exprs; x++) {
+        char name[METRIC_NAME_LEN];
+        char err[96];
+        long long hold_ms;
+        AlarmExpr *expr = &set->exprs[set->n_exprs];
+        if (alarm_expr_compile(t->exprs[x].text, expr, &hold_ms, err, sizeof(err)) < 0) {
+            log_message("WARNING: Invalid condition expr.%s: %s, ignoring", t->exprs[x].name, err);
+            continue;
+        }
+        snprintf(name, sizeof(name), "expr.%s", t->exprs[x].name);
+        int id = metric_register(name);
+        // labelled with the registry's copy of the name, which outlives t
+        AlarmRuleInfo info = { id < 0 ? "" : metric_name(id) + 5, "", 0, SEVERITY_WARNING };
+        int before = set->count;
+        // the condition result is 0 or 1: it breaches above 0.5 and clears as soon as it no longer holds
+        add_rule(set, id, RULE_ABOVE, 0.5, 0.5, hold_ms, info);
+        hold_metric(set, id, before);
+        if (set->count == before) {
+            alarm_expr_release(expr);
+            continue;
+        }
+        set->expr[before] = (signed char)set->n_exprs;
+        strcpy(set->expr_text[set->n_exprs], t->exprs[x].text);
+        set->n_exprs++;
+    }
+    set->debounce = t->alarm_debounce > 0 ? t->alarm_debounce : 1;
+    set->renotify_ms = t->alarm_renotify * 1000LL;
+    set->name_check_ms = -1;
+
+    for (int i = 0; i < set->count; i++) {
+        for (int o = 0; o < old.count; o++) {
+            if (old.metric[o] != set->metric[i] || old.cmp[o] != set->cmp[i]) continue;
+            set->breaches[i] = old.breaches[o];
+            set->breach_ms[i] = old.breach_ms[o];
+            set->active[i] = old.active[o];
+            set->notified_ms[i] = old.notified_ms[o];
+            break;
+        }
+    }
+    // the new table holds its own references, so ids only the old one used are freed
+    for (int i = 0; i < old.n_held; i++) release_metric(old.held[i]);
+    for (int x = 0; x < old.n_exprs; x++) alarm_expr_release(&old.exprs[x]);
+    return set->count;
+}
+
+// warn about rules on metrics that no collector has published: a misspelled name is registered
+// like any other and its rule would silently never fire
+static void check_names(const AlarmRuleSet *set) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->expr[i] >= 0) {
+            int id = alarm_expr_unpublished(&set->exprs[set->expr[i]]);
+            if (id >= 0)
+                log_message("WARNING: Condition %s reads %s, which no collector has published in %d s: check the name",
+                            set->info[i].label, metric_name(id), ALARM_NAME_CHECK_MS / 1000);
+        } else if (!metric_published(set->metric[i])) {
+            log_message("WARNING: Threshold on %s: no collector has published it in %d s: check the name",
+                        metric_name(set->metric[i]), ALARM_NAME_CHECK_MS / 1000);
+        }
+    }
+}
+
+int alarm_rules_evaluate(AlarmRuleSet *set, long long now_ms, AlarmEvent *events) {
+    if (set->name_check_ms < 0) {
+        set->name_check_ms = now_ms + ALARM_NAME_CHECK_MS;
+    } else if (set->name_check_ms > 0 && now_ms >= set->name_check_ms) {
+        check_names(set);
+        set->name_check_ms = 0;
+    }
+    const double *values = metric_values();
+    const unsigned char *valid = metric_valid_flags();
+    int n = 0;
+    for (int i = 0; i < set->count; i++) {
+        int id = set->metric[i];
+        double v;
+        if (set->expr[i] >= 0) {
+            // publish the condition so it shows in the metrics sent with alarms
+            v = alarm_expr_eval(&set->exprs[set->expr[i]], values, valid);
+            metric_set(id, v);
+        } else {
+            // no data is not a recovery: keep the state until the metric is back
+            if (!valid[id]) continue;
+            v = values[id];
+        }
+        int above = set->cmp[i] == RULE_ABOVE;
+        int breached = above ? v > set->threshold[i] : v < set->threshold[i];
+
+        if (breached) {
+            if (set->breaches[i] == 0) set->breach_ms[i] = now_ms;
+            if (set->breaches[i] < set->debounce) set->breaches[i]++;
+            if (!set->active[i]) {
+                if (set->breaches[i] < set->debounce || now_ms - set->breach_ms[i] < set->hold_ms[i]) continue;
+                set->active[i] = 1;
+                set->notified_ms[i] = now_ms;
+                events[n].rule = i;
+                events[n++].type = ALARM_RAISE;
+                continue;
+            }
+        } else {
+            set->breaches[i] = 0;
+            // between the clear point and the threshold an active alarm stays active
+            if (set->active[i] && (above ? v <= set->clear[i] : v >= set->clear[i])) {
+                set->active[i] = 0;
+                events[n].rule = i;
+                events[n++].type = ALARM_CLEAR;
+                continue;
+            }
+        }
+        if (set->active[i] && set->renotify_ms > 0 && now_ms - set->notified_ms[i] >= set->renotify_ms) {
+            set->notified_ms[i] = now_ms;
+            events[n].rule = i;
+            events[n++].type = ALARM_RENOTIFY;
+        }
+    }
+    return n;
+}
+
+void alarm_rule_message(const AlarmRuleSet *set, const AlarmEvent *event, char *buf, size_t size) {
+    int i = event->rule;
+    const AlarmRuleInfo *info = &set->info[i];
+    if (set->expr[i] >= 0) {
+        snprintf(buf, size, "%s (%s) %s", info->label, set->expr_text[set->expr[i]],
+                 event->type == ALARM_CLEAR ? "no longer holds" : "holds");
+        return;
+    }
+    if (event->type == ALARM_CLEAR) {
+        snprintf(buf, size, "%s (%.*f%s) back %s %.*f%s", info->label,
+                 info->decimals, metric_value(set->metric[i]), info->unit,
+                 set->cmp[i] == RULE_ABOVE ? "below" : "above",
+                 info->decimals, set->clear[i], info->unit);
+        return;
+    }
+    int len = snprintf(buf, size, "%s (%.*f%s) %s threshold (%.*f%s)", info->label,
+                       info->decimals, metric_value(set->metric[i]), info->unit,
+                       set->cmp[i] == RULE_ABOVE ? "exceeds" : "is below",
+                       info->decimals, set->threshold[i], info->unit);
+    if (set->hold_ms[i] > 0 && len > 0 && len < (int)size)
+        snprintf(buf + len, size - len, " for %lld s", set->hold_ms[i] / 1000);
+}
+
+const char *alarm_event_name(int type) {
+    switch (type) {
+    case ALARM_RAISE: return "raise";
+    case ALARM_RENOTIFY: return "renotify";
+    default: return "clear";
+    }
+}
+
+const char *alarm_severity_name(int severity) {
+    switch (severity) {
+    case SEVERITY_INFO: return "info";
+    case SEVERITY_WARNING: return "warning";
+    default: return "critical";
+    }
+}
@@ -0,0 +1,101 @@
+// header file for alarm_rules.c : threshold rules compiled into a table
+
+#ifndef ALARM_RULES_H
+#define ALARM_RULES_H
+
+#include "config.h"
+#include "alarm_expr.h"
+#include <stddef.h>
+
+// capacity of a rule table: the built-in and pressure thresholds, MAX_METRIC_THRESHOLDS and MAX_THRESHOLD_EXPRS
+#define MAX_ALARM_RULES 64
+// time after a compile by which every collector has published at least once, trends included:
+// a rule on a metric still unpublished then most likely names it wrong
+#define ALARM_NAME_CHECK_MS 120000
+
+// comparators
+#define RULE_ABOVE 0    // fires when value > threshold
+#define RULE_BELOW 1    // fires when value < threshold
+
+// severities, in increasing order
+#define SEVERITY_INFO 0
+#define SEVERITY_WARNING 1
+#define SEVERITY_CRITICAL 2
+
+// alarm events produced by the rule state machine
+#define ALARM_RAISE 0       // breached for alarm_debounce consecutive checks
+#define ALARM_RENOTIFY 1    // still active after alarm_renotify seconds
+#define ALARM_CLEAR 2       // back past the clear point
+
+typedef struct {
+    int rule;               // index in the rule set
+    int type;               // ALARM_RAISE / ALARM_RENOTIFY / ALARM_CLEAR
+} AlarmEvent;
+
+// how a rule is shown in alarm messages
+typedef struct {
+    const char *label;      // "Memory usage", the metric name for rules from thresholds.conf, or the condition name
+    const char *unit;       // appended to values: "%", " seconds", ""
+    int decimals;           // digits after the point in the message
+    int severity;
+} AlarmRuleInfo;
+
+// compiled rules. The fields read on every evaluation are kept in dense arrays, so a pass
+// over all rules touches a few cache lines
+typedef struct {
+    int count;
+    int metric[MAX_ALARM_RULES];            // metric id
+    unsigned char cmp[MAX_ALARM_RULES];     // RULE_ABOVE / RULE_BELOW
+    double threshold[MAX_ALARM_RULES];
+    double clear[MAX_ALARM_RULES];          // an active alarm clears once the value is back past this
+    long long hold_ms[MAX_ALARM_RULES];     // how long a breach must last before it counts
+    signed char expr[MAX_ALARM_RULES];      // compound condition in exprs[], -1 for a plain threshold
+    AlarmRuleInfo info[MAX_ALARM_RULES];
+    // per-rule state, carried over when the table is recompiled
+    int breaches[MAX_ALARM_RULES];          // consecutive breached checks
+    long long breach_ms[MAX_ALARM_RULES];   // start of the current breach
+    unsigned char active[MAX_ALARM_RULES];
+    long long notified_ms[MAX_ALARM_RULES]; // last raise or renotify
+    int debounce;
+    long long renotify_ms;                  // 0 = never
+    long long name_check_ms;                // when to warn about unpublished metrics: -1 = from the next evaluation, 0 = done
+    // compound conditions. Their rule watches metric "expr.<name>", set to 1 while the condition holds
+    int n_exprs;
+    AlarmExpr exprs[MAX_THRESHOLD_EXPRS];
+    char expr_text[MAX_THRESHOLD_EXPRS][160];
+    // metric ids the rules registered (conditions hold theirs in exprs), released when the table is recompiled
+    int n_held;
+    int held[MAX_ALARM_RULES];
+} AlarmRuleSet;
+
+// build the rule table from the loaded thresholds: one row per built-in threshold, one per
+// enabled pressure threshold (on pressure.<resource>) and one per metric threshold. Metrics that are not registered yet (interface not up yet) are registered
+// so their rule starts to apply as soon as a collector publishes them; trend names
+// ("memory.slope") start tracking the trend. Compound conditions are compiled to bytecode here;
+// one that does not parse is logged and left out.
+// set must be zeroed before the first call; on later calls rules on the same metric keep their
+// alarm state, so a reload neither re-raises nor forgets active alarms. A rule or condition whose
+// metric no collector has published ALARM_NAME_CHECK_MS later is logged once, as a likely typo.
+// The metric ids the previous table registered are released once the new one holds its own, so
+// names dropped from thresholds.conf give their ids back.
+// returns the number of rules
+int alarm_rules_compile(const Thresholds *t, AlarmRuleSet *set);
+
+// evaluate every rule against the metric table and advance its alarm state. An alarm is raised
+// after set->debounce consecutive breaches lasting at least the rule's hold_ms, repeated every renotify_ms while active and cleared
+// once the value is back past the clear point. Invalid metrics leave the state unchanged.
+// writes the events to events[] (room for MAX_ALARM_RULES) and returns their count
+int alarm_rules_evaluate(AlarmRuleSet *set, long long now_ms, AlarmEvent *events);
+
+// format the message of an event for the current value, e.g.
+// "CPU usage (91.2%) exceeds threshold (80.0%)", "memory.slope (1.20) exceeds threshold (1.00) for 600 s",
+// "CPU usage (61.0%) back below 72.0%" or "overload (cpu > 80 && memory > 70 for 30s) holds"
+void alarm_rule_message(const AlarmRuleSet *set, const AlarmEvent *event, char *buf, size_t size);
+
+// "raise", "renotify" or "clear"
+const char *alarm_event_name(int type);
+
+// "info", "warning" or "critical"
+const char *alarm_severity_name(int severity);
+
+#endif
@@ -0,0 +1,291 @@
+// append-only spool of alarms the Cloud Manager could not take. Each record is a header
+// (magic, length, crc32 of the payload) followed by the payload as it was posted; alarms carry
+// their own ids, so a record replayed twice after a crash is dropped by the receiver.
+// Delivered records are dropped by rewriting the undelivered ones to a new file, renamed over
+// the spool, so the size limit only counts alarms still waiting. How far delivery has got is
+// kept in "<spool>.pos", so a restart does not post the delivered records again
+
+#include "alarm_spool.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#define SPOOL_MAGIC 0x4c4f4f50u     // "POOL"
+#define POS_MAGIC 0x534f5053u       // "SPOS"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;
+} SpoolHeader;
+
+// contents of the .pos file: the first undelivered record of the spool file with inode ino.
+// A compaction makes a new file, so a position of the old one is never applied to it
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;           // of ino and offset
+    uint64_t ino;
+    int64_t offset;
+} SpoolPos;
+
+// positions handed out (alarm_spool_start, _next, _consume) count every byte ever appended, so a
+// replay in flight stays valid when compaction moves its records to the front of the file
+static int spool_fd = -1;
+static char spool_path[256];
+static long spool_base = 0;         // position of the file's first byte
+static long spool_size = 0;         // end of the last good record, in the file
+static long replay_start = 0;       // first undelivered record, in the file
+static int n_records = 0;           // undelivered records
+static long long sync_due_ms = -1;  // when the pending appends must be fsynced, -1 = none
+static int pos_fd = -1;
+static int pos_dirty = 0;           // .pos written since the last sync
+static uint64_t spool_ino;
+static int n_syncs = 0;
+static uint32_t crc_table[256];
+
+// monotonic clock in milliseconds
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// crc32 (IEEE) of len bytes
+static uint32_t crc32(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint32_t crc = 0xffffffffu;
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    while (len--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+// read and check the record at pos into buf.
+// returns the payload length, or -1 if there is no valid record there
+static long read_record(long pos, char *buf, size_t size) {
+    SpoolHeader h;
+    if (pread(spool_fd, &h, sizeof(h), pos) != (ssize_t)sizeof(h) || h.magic != SPOOL_MAGIC ||
+        h.len >= size || pread(spool_fd, buf, h.len, pos + sizeof(h)) != (ssize_t)h.len ||
+        crc32(buf, h.len) != h.crc)
+        return -1;
+    buf[h.len] = '\0';
+    return h.len;
+}
+
+// record replay_start in the .pos file; durable right away with sync, else with the next
+// alarm_spool_sync. Losing an update only replays delivered records, which the receiver drops
+static void write_pos(int sync) {
+    if (pos_fd < 0) return;
+    SpoolPos pos = { POS_MAGIC, 0, spool_ino, replay_start };
+    pos.crc = crc32(&pos.ino, sizeof(pos.ino) + sizeof(pos.offset));
+    if (pwrite(pos_fd, &pos, sizeof(pos), 0) != (ssize_t)sizeof(pos) || (sync && fdatasync(pos_fd) != 0)) {
+        log_message("ERROR: Failed to record alarm spool position");
+        return;
+    }
+    pos_dirty = !sync;
+}
+
+// file offset of the first undelivered record saved for the open spool file, 0 if none
+static long read_pos() {
+    SpoolPos pos;
+    if (pos_fd < 0 || pread(pos_fd, &pos, sizeof(pos), 0) != (ssize_t)sizeof(pos) || pos.magic != POS_MAGIC ||
+        pos.crc != crc32(&pos.ino, sizeof(pos.ino) + sizeof(pos.offset)) || pos.ino != spool_ino || pos.offset < 0)
+        return 0;
+    return (long)pos.offset;
+}
+
+// rewrite the undelivered records to a new file and rename it over the spool; a crash before
+// the rename leaves the old file, which still holds them.
+// returns 0 on success, -1 if the spool is left as it was
+static int compact() {
+    static char buf[ALARM_SPOOL_RECORD_MAX];
+    char tmp_path[sizeof(spool_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", spool_path);
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        log_message("ERROR: Failed to compact alarm spool %s", spool_path);
+        return -1;
+    }
+    long pos = replay_start;
+    while (pos < spool_size) {
+        size_t chunk = spool_size - pos < (long)sizeof(buf) ? (size_t)(spool_size - pos) : sizeof(buf);
+        if (pread(spool_fd, buf, chunk, pos) != (ssize_t)chunk || write(fd, buf, chunk) != (ssize_t)chunk) break;
+        pos += chunk;
+    }
+    if (pos < spool_size || fdatasync(fd) != 0 || rename(tmp_path, spool_path) != 0) {
+        log_message("ERROR: Failed to compact alarm spool %s", spool_path);
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    // make the rename itself durable
+    char dir[sizeof(spool_path)];
+    snprintf(dir, sizeof(dir), "%s", spool_path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    int dir_fd = open(slash ? (dir[0] ? dir : "/") : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    close(spool_fd);
+    spool_fd = fd;
+    struct stat st;
+    spool_ino = fstat(fd, &st) == 0 ? st.st_ino : 0;
+    spool_base += replay_start;
+    spool_size -= replay_start;
+    replay_start = 0;
+    write_pos(1);
+    // the appends waiting for a sync were copied and synced with the new file
+    sync_due_ms = -1;
+    return 0;
+}
+
+int alarm_spool_open(const char *path) {
+    static char record[ALARM_SPOOL_RECORD_MAX];
+    snprintf(spool_path, sizeof(spool_path), "%s", path);
+    spool_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (spool_fd < 0) {
+        log_message("ERROR: Failed to open alarm spool %s", path);
+        return -1;
+    }
+    char pos_path[sizeof(spool_path) + 8];
+    snprintf(pos_path, sizeof(pos_path), "%s.pos", path);
+    pos_fd = open(pos_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (pos_fd < 0) log_message("ERROR: Failed to open %s, delivered alarms will be replayed after a restart", pos_path);
+    struct stat st;
+    spool_ino = fstat(spool_fd, &st) == 0 ? st.st_ino : 0;
+    long delivered = read_pos();
+    int n_delivered = -1;
+    long end = lseek(spool_fd, 0, SEEK_END);
+    long len;
+    spool_size = 0;
+    n_records = 0;
+    while (spool_size < end && (len = read_record(spool_size, record, sizeof(record))) >= 0) {
+        if (spool_size == delivered) n_delivered = n_records;
+        spool_size += sizeof(SpoolHeader) + len;
+        n_records++;
+    }
+    if (spool_size == delivered) n_delivered = n_records;
+    if (spool_size < end) {
+        // torn or corrupted tail: everything before it is intact
+        log_message("WARNING: Alarm spool damaged at offset %ld, dropping %ld bytes", spool_size, end - spool_size);
+        if (ftruncate(spool_fd, spool_size) != 0 || fsync(spool_fd) != 0)
+            log_message("ERROR: Failed to repair alarm spool %s", path);
+    }
+    spool_base = 0;
+    replay_start = 0;
+    sync_due_ms = -1;
+    n_syncs = 0;
+    pos_dirty = 0;
+    // records before the saved position were delivered before the restart; a position that is
+    // not on a record boundary (the tail was cut) is ignored and everything is replayed
+    if (n_delivered > 0) {
+        log_message("INFO: Skipping %d alarm records delivered before the restart", n_delivered);
+        alarm_spool_consume(delivered, n_delivered);
+    }
+    if (n_records > 0) log_message("INFO: %d spooled alarm records waiting for replay", n_records);
+    return n_records;
+}
+
+int alarm_spool_append(const char *payload) {
+    if (spool_fd < 0) return 0;
+    size_t len = strlen(payload);
+    // delivered records at the front take no room: drop them once the file reaches the limit
+    if (replay_start > 0 && spool_size + sizeof(SpoolHeader) + len > ALARM_SPOOL_MAX_BYTES) compact();
+    if (len >= ALARM_SPOOL_RECORD_MAX || spool_size + sizeof(SpoolHeader) + len > ALARM_SPOOL_MAX_BYTES) {
+        log_message("ERROR: Alarm spool full, dropping %zu bytes of alarms", len);
+        return 0;
+    }
+    SpoolHeader h = { SPOOL_MAGIC, (uint32_t)len, crc32(payload, len) };
+    struct iovec iov[2] = { { &h, sizeof(h) }, { (void *)payload, len } };
+    ssize_t written = writev(spool_fd, iov, 2);
+    if (written != (ssize_t)(sizeof(h) + len)) {
+        // a short write leaves a tail the next open cuts off; keep the end we know is good
+        log_message("ERROR: Failed to write alarm spool");
+        if (written > 0 && ftruncate(spool_fd, spool_size) != 0) log_message("ERROR: Failed to repair alarm spool");
+        return 0;
+    }
+    spool_size += written;
+    n_records++;
+    if (sync_due_ms < 0) sync_due_ms = now_ms() + ALARM_SPOOL_SYNC_MS;
+    return 1;
+}
+
+int alarm_spool_records() {
+    return n_records;
+}
+
+long alarm_spool_start() {
+    return spool_base + replay_start;
+}
+
+int alarm_spool_next(long *pos, char *payload, size_t size) {
+    long at = *pos - spool_base;
+    if (spool_fd < 0 || at < replay_start || at >= spool_size) return 0;
+    long len = read_record(at, payload, size);
+    if (len < 0) return 0;
+    *pos += sizeof(SpoolHeader) + len;
+    return 1;
+}
+
+void alarm_spool_consume(long end, int n) {
+    end -= spool_base;
+    if (spool_fd < 0 || end <= replay_start) return;
+    n_records -= n;
+    replay_start = end;
+    if (end < spool_size) {
+        // keep the delivered prefix from growing to most of the file
+        if (replay_start >= ALARM_SPOOL_MAX_BYTES / 2 && compact() == 0) return;
+        write_pos(0);
+        if (sync_due_ms < 0) sync_due_ms = now_ms() + ALARM_SPOOL_SYNC_MS;
+        return;
+    }
+    // everything delivered: start over with an empty file. The position goes back to 0 first,
+    // so a crash in between replays delivered records rather than skipping new ones
+    replay_start = 0;
+    write_pos(1);
+    if (ftruncate(spool_fd, 0) != 0) log_message("ERROR: Failed to empty alarm spool");
+    spool_base += spool_size;
+    spool_size = 0;
+    n_records = 0;
+    sync_due_ms = now_ms();
+}
+
+int alarm_spool_sync_due_ms() {
+    if (sync_due_ms < 0) return -1;
+    long long left = sync_due_ms - now_ms();
+    return left > 0 ? (int)left : 0;
+}
+
+void alarm_spool_sync(int force) {
+    if (spool_fd < 0 || sync_due_ms < 0 || (!force && now_ms() < sync_due_ms)) return;
+    if (fdatasync(spool_fd) != 0 || (pos_dirty && fdatasync(pos_fd) != 0)) log_message("ERROR: Failed to sync alarm spool");
+    pos_dirty = 0;
+    sync_due_ms = -1;
+    n_syncs++;
+}
+
+int alarm_spool_syncs() {
+    return n_syncs;
+}
+
+void alarm_spool_close() {
+    if (spool_fd < 0) return;
+    alarm_spool_sync(1);
+    close(spool_fd);
+    spool_fd = -1;
+    if (pos_fd >= 0) close(pos_fd);
+    pos_fd = -1;
+}
@@ -0,0 +1,55 @@
+// header file for alarm_spool.c : undeliverable alarms kept on disk until the Cloud Manager takes them
+
+#ifndef ALARM_SPOOL_H
+#define ALARM_SPOOL_H
+
+#include <stddef.h>
+
+// most bytes of undelivered alarms; alarms beyond it are dropped. Delivered ones do not count
+#define ALARM_SPOOL_MAX_BYTES (1024 * 1024)
+// largest record, terminator included: a request the Cloud Manager did not take
+#define ALARM_SPOOL_RECORD_MAX 16384
+// group commit: appends within this long share one fsync
+#define ALARM_SPOOL_SYNC_MS 1000
+
+// open (or create) the spool at path and check every record. A damaged tail, left by a crash
+// in the middle of an append, is cut off. Records already delivered before a restart, as
+// saved in "<path>.pos", are skipped.
+// returns the number of undelivered records, or -1 if the file could not be opened
+int alarm_spool_open(const char *path);
+
+// append one payload (an alarm object or an array of them) as a checksummed record.
+// the write is made durable by the next alarm_spool_sync.
+// returns 1 if spooled, 0 if the spool is not open, full or the write failed
+int alarm_spool_append(const char *payload);
+
+// undelivered records
+int alarm_spool_records();
+
+// position of the oldest undelivered record, where a replay starts. Positions stay valid while
+// the file is compacted
+long alarm_spool_start();
+
+// read the record at *pos into payload (NUL-terminated) and advance *pos past it.
+// returns 1 if a record was read, 0 at the end of the spool or if it does not fit in size
+int alarm_spool_next(long *pos, char *payload, size_t size);
+
+// the n records from the replay start up to end have been delivered (or rejected for good).
+// Once every record is, the file is emptied; a delivered prefix of half the limit is compacted away.
+// The new start is saved with the next alarm_spool_sync
+void alarm_spool_consume(long end, int n);
+
+// milliseconds until alarm_spool_sync is due, -1 if nothing waits for an fsync
+int alarm_spool_sync_due_ms();
+
+// fsync the appends made since the last sync if ALARM_SPOOL_SYNC_MS has passed since the first
+// of them, or right away with force
+void alarm_spool_sync(int force);
+
+// fsyncs made since open
+int alarm_spool_syncs();
+
+// sync and close the spool
+void alarm_spool_close();
+
+#endif
@@ -0,0 +1,233 @@
+// per-service resource usage from cgroup v2 interface files
+
+#include "cgroup_monitor.h"
+#include "metric_registry.h"
+#include "logger.h"
+#include "host_paths.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define CGROUP_PATH_LEN 192
+#define CGROUP_BUF_SIZE 8192
+
+// cgroup interface files read for every service, kept open between samples
+enum { CG_CPU_STAT, CG_MEMORY_CURRENT, CG_MEMORY_EVENTS, CG_IO_STAT, CG_FILES };
+static const char *cg_files[CG_FILES] = { "cpu.stat", "memory.current", "memory.events", "io.stat" };
+static const char *cg_metric_names[CGROUP_METRICS] = {
+    "cpu_pct", "memory_bytes", "oom_kills", "io_read_bps", "io_write_bps"
+};
+
+// one tracked cgroup
+typedef struct {
+    char path[CGROUP_PATH_LEN];
+    int fds[CG_FILES];
+    int have_prev;
+    unsigned long long prev_usage_usec, prev_oom_kills, prev_rbytes, prev_wbytes;
+    long long prev_ms;
+    int ids[CGROUP_METRICS];
+} CgroupService;
+
+static CgroupService cgroups[MAX_CGROUPS];
+static int n_cgroups = 0;
+static char cg_buf[CGROUP_BUF_SIZE];
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// read one interface file through a descriptor that stays open. cgroup files are regenerated
+// on every read at offset 0. A removed cgroup returns ENODEV, then the fd is dropped and the
+// next call reopens it (the service may have been restarted into a new cgroup)
+static ssize_t read_cgroup_file(CgroupService *cg, int file) {
+    int *fd = &cg->fds[file];
+    if (*fd < 0) {
+        char path[CGROUP_PATH_LEN + 32];
+        snprintf(path, sizeof(path), "%s/%s", cg->path, cg_files[file]);
+        *fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (*fd < 0) return -1;
+    }
+    ssize_t len = pread(*fd, cg_buf, sizeof(cg_buf) - 1, 0);
+    if (len <= 0) {
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    cg_buf[len] = '\0';
+    return len;
+}
+
+// parse the unsigned number at p
+static unsigned long long parse_number(const char *p) {
+    unsigned long long v = 0;
+    while (*p >= '0' && *p <= '9') v = v * 10 + (unsigned long long)(*p++ - '0');
+    return v;
+}
+
+// value of a "key value" line in a flat-keyed file (cpu.stat, memory.events), -1 if missing
+static int find_key(const char *buf, const char *key, unsigned long long *out) {
+    size_t len = strlen(key);
+    for (const char *line = buf; *line; ) {
+        if (strncmp(line, key, len) == 0 && line[len] == ' ') {
+            *out = parse_number(line + len + 1);
+            return 0;
+        }
+        const char *nl = strchr(line, '\n');
+        if (!nl) break;
+        line = nl + 1;
+    }
+    return -1;
+}
+
+// sum a "key=value" field over all lines of io.stat ("8:0 rbytes=... wbytes=... rios=...")
+static unsigned long long sum_io_field(const char *buf, const char *field) {
+    unsigned long long total = 0;
+    size_t len = strlen(field);
+    for (const char *p = strstr(buf, field); p; p = strstr(p + len, field)) {
+        if (p == buf || p[-1] == ' ') total += parse_number(p + len);
+    }
+    return total;
+}
+
+// 1 if the characters in [p, end) are exactly word
+static int same_word(const char *p, const char *end, const char *word) {
+    size_t len = strlen(word);
+    return (size_t)(end - p) == len && strncmp(p, word, len) == 0;
+}
+
+// metric name for a cgroup path: ".../dataplane.service" -> "dataplane", the hierarchy root -> "root"
+static void service_name(const char *path, char *out, size_t size) {
+    const char *end = path + strlen(path);
+    while (end > path && end[-1] == '/') end--;
+    const char *base = end;
+    while (base > path && base[-1] != '/') base--;
+    size_t n = 0;
+    for (const char *p = base; p < end && n + 1 < size; p++) {
+        if (same_word(p, end, ".service") || same_word(p, end, ".scope") || same_word(p, end, ".slice")) break;
+        out[n++] = *p == '.' ? '_' : *p;
+    }
+    out[n] = '\0';
+    if (n == 0 || same_word(base, end, "cgroup") || same_word(base, end, "unified"))
+        snprintf(out, size, "root");
+}
+
+static void invalidate_cgroup(CgroupService *cg) {
+    for (int m = 0; m < CGROUP_METRICS; m++) metric_invalidate(cg->ids[m]);
+}
+
+int update_cgroups() {
+    int failed = 0;
+    for (int i = 0; i < n_cgroups; i++) {
+        CgroupService *cg = &cgroups[i];
+        long long now = now_ms();
+        unsigned long long usage_usec = 0, oom_kills = 0, memory = 0, rbytes = 0, wbytes = 0;
+
+        // cpu.stat always exists in a cgroup v2 directory, without it the service is not running
+        if (read_cgroup_file(cg, CG_CPU_STAT) < 0 || find_key(cg_buf, "usage_usec", &usage_usec) < 0) {
+            invalidate_cgroup(cg);
+            cg->have_prev = 0;
+            failed = 1;
+            continue;
+        }
+
+        // the memory.* and io.* files are missing when the controller is not enabled for the cgroup
+        if (read_cgroup_file(cg, CG_MEMORY_CURRENT) >= 0) {
+            memory = parse_number(cg_buf);
+            metric_set(cg->ids[CGROUP_MEMORY_BYTES], (double)memory);
+        } else {
+            metric_invalidate(cg->ids[CGROUP_MEMORY_BYTES]);
+        }
+        int have_events = read_cgroup_file(cg, CG_MEMORY_EVENTS) >= 0 &&
+                          find_key(cg_buf, "oom_kill", &oom_kills) == 0;
+        int have_io = read_cgroup_file(cg, CG_IO_STAT) >= 0;
+        if (have_io) {
+            rbytes = sum_io_field(cg_buf, "rbytes=");
+            wbytes = sum_io_field(cg_buf, "wbytes=");
+        }
+
+        double elapsed_ms = (double)(now - cg->prev_ms);
+        if (cg->have_prev && elapsed_ms >= 1) {
+            // counters only go backwards when the cgroup was re-created: the share of that sample is unknown
+            if (usage_usec >= cg->prev_usage_usec)
+                metric_set(cg->ids[CGROUP_CPU_PCT], (usage_usec - cg->prev_usage_usec) / (elapsed_ms * 10.0));
+            else metric_invalidate(cg->ids[CGROUP_CPU_PCT]);
+            if (have_events && oom_kills >= cg->prev_oom_kills)
+                metric_set(cg->ids[CGROUP_OOM_KILLS], (double)(oom_kills - cg->prev_oom_kills));
+            else metric_invalidate(cg->ids[CGROUP_OOM_KILLS]);
+            if (have_io && rbytes >= cg->prev_rbytes && wbytes >= cg->prev_wbytes) {
+                metric_set(cg->ids[CGROUP_IO_READ_BPS], (rbytes - cg->prev_rbytes) * 1000.0 / elapsed_ms);
+                metric_set(cg->ids[CGROUP_IO_WRITE_BPS], (wbytes - cg->prev_wbytes) * 1000.0 / elapsed_ms);
+            } else {
+                metric_invalidate(cg->ids[CGROUP_IO_READ_BPS]);
+                metric_invalidate(cg->ids[CGROUP_IO_WRITE_BPS]);
+            }
+        } else if (cg->have_prev) {
+            continue; // called twice within a millisecond, keep the previous reading
+        }
+        cg->prev_usage_usec = usage_usec;
+        cg->prev_oom_kills = oom_kills;
+        cg->prev_rbytes = rbytes;
+        cg->prev_wbytes = wbytes;
+        cg->prev_ms = now;
+        cg->have_prev = 1;
+    }
+    return failed ? -1 : 0;
+}
+
+static int collect_cgroups() {
+    return update_cgroups();
+}
+
+int cgroup_monitor_start(const char *list) {
+    cgroup_monitor_stop();
+
+    const char *p = list;
+    while (*p && n_cgroups < MAX_CGROUPS) {
+        while (*p == ',' || *p == ' ') p++;
+        size_t len = strcspn(p, ", ");
+        if (len == 0) break;
+
+        CgroupService *cg = &cgroups[n_cgroups];
+        memset(cg, 0, sizeof(*cg));
+        for (int f = 0; f < CG_FILES; f++) cg->fds[f] = -1;
+        char root[HOST_ROOT_LEN + 16];
+        sys_path(root, sizeof(root), CGROUP_DIR);
+        int n = p[0] == '/' ? snprintf(cg->path, sizeof(cg->path), "%.*s", (int)len, p)
+                            : snprintf(cg->path, sizeof(cg->path), "%s/%.*s", root, (int)len, p);
+        p += len;
+        if (n >= (int)sizeof(cg->path)) {
+            log_message("WARNING: cgroup path too long, ignoring %s", cg->path);
+            continue;
+        }
+
+        char service[24], name[METRIC_NAME_LEN];
+        service_name(cg->path, service, sizeof(service));
+        for (int m = 0; m < CGROUP_METRICS; m++) {
+            snprintf(name, sizeof(name), "cgroup.%s.%s", service, cg_metric_names[m]);
+            cg->ids[m] = metric_register(name);
+        }
+        n_cgroups++;
+    }
+
+    if (n_cgroups > 0 && collector_register("cgroups", collect_cgroups, 1000) < 0) {
+        cgroup_monitor_stop();
+        return 0;
+    }
+    return n_cgroups;
+}
+
+void cgroup_monitor_stop() {
+    for (int i = 0; i < n_cgroups; i++) {
+        for (int f = 0; f < CG_FILES; f++) {
+            if (cgroups[i].fds[f] >= 0) close(cgroups[i].fds[f]);
+            cgroups[i].fds[f] = -1;
+        }
+        for (int m = 0; m < CGROUP_METRICS; m++) metric_release(cgroups[i].ids[m]);
+    }
+    n_cgroups = 0;
+    collector_unregister("cgroups");
+}
@@ -0,0 +1,33 @@
+// header file for cgroup_monitor.c : per-service resource usage from cgroup v2
+
+#ifndef CGROUP_MONITOR_H
+#define CGROUP_MONITOR_H
+
+// maximum number of cgroups tracked
+#define MAX_CGROUPS 8
+// relative cgroup paths are resolved against this directory under the sys root
+#define CGROUP_DIR "fs/cgroup"
+
+// per-service metrics: cgroup.<service>.<metric>
+enum {
+    CGROUP_CPU_PCT,         // cpu time used, % of one core
+    CGROUP_MEMORY_BYTES,    // memory.current
+    CGROUP_OOM_KILLS,       // OOM kills since the previous sample
+    CGROUP_IO_READ_BPS,     // bytes read per second, all devices
+    CGROUP_IO_WRITE_BPS,    // bytes written per second, all devices
+    CGROUP_METRICS
+};
+
+// track the cgroups in list (comma separated paths, relative to <sys root>/fs/cgroup or absolute) and
+// register the "cgroups" collector. The service name in the metric is the last path component
+// without its .service/.scope/.slice suffix. returns the number of cgroups tracked
+int cgroup_monitor_start(const char *list);
+
+// read cpu.stat, memory.current, memory.events and io.stat of every tracked cgroup and
+// publish the metrics. returns 0, or -1 if any cgroup could not be read
+int update_cgroups();
+
+// close the descriptors held open on the cgroup files and release the cgroup metrics
+void cgroup_monitor_stop();
+
+#endif
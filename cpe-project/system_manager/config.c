@@ -3,12 +3,44 @@
 #include "config.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+// strip leading and trailing whitespace in place
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+// 1 if key ends with suffix (and has a name before it)
+static int has_suffix(const char *key, const char *suffix) {
+    size_t n = strlen(key), s = strlen(suffix);
+    return n > s && strcmp(key + n - s, suffix) == 0;
+}
+
+// append "<name><suffix>=value" to a list of named values, as name and value
+static void add_named_value(MetricThreshold *list, int *n, const char *key, size_t suffix_len, float value) {
+    size_t len = strlen(key) - suffix_len;
+    if (*n >= MAX_METRIC_THRESHOLDS || len >= sizeof(list[0].name)) {
+        log_message("WARNING: Too many %s settings or metric name too long, ignoring %s", key + len, key);
+        return;
+    }
+    memcpy(list[*n].name, key, len);
+    list[*n].name[len] = '\0';
+    list[*n].value = value;
+    list[*n].below = 0;
+    (*n)++;
+}
 
 //load threshold values from a configuration file
 // returns a Thresholds structure with either loaded values or defaults
 Thresholds load_thresholds(const char *filename) {
     // thresholds structure with default values
-    Thresholds t = {80.0, 75.0, 90.0, 86400.0, 5, 200}; 
+    Thresholds t = {80.0, 75.0, 90.0, 86400.0, 5, 200, .cpu_pressure = 0, .memory_pressure = 0, .io_pressure = 0, .n_metrics = 0,
+                    .alarm_debounce = 3, .alarm_hysteresis = 5, .alarm_renotify = 3600, .n_clears = 0, .n_holds = 0, .n_exprs = 0};
     
     // attempt to open the configuration file in read mode
     FILE *fp = fopen(filename, "r");
@@ -21,11 +53,40 @@ Thresholds load_thresholds(const char *filename) {
     }
 
     // variables to store key-value pairs from the file
-    char key[32];
+    char line[256];
+    char key[64];
     float value;
     
-    // read file line by line until end of file
-    while (fscanf(fp, "%[^=]=%f\n", key, &value) != EOF) {
+    // read file line by line until end of file, skipping blank lines and # comments
+    while (fgets(line, sizeof(line), fp)) {
+        char *eq = strchr(line, '=');
+        if (line[0] == '#' || !eq) continue;
+        *eq = '\0';
+        char *name = trim(line);
+        char *text = trim(eq + 1);
+        
+        // compound conditions keep their text, the alarm rules compile it
+        if (strncmp(name, "expr.", 5) == 0) {
+            if (t.n_exprs >= MAX_THRESHOLD_EXPRS || strlen(name + 5) >= sizeof(t.exprs[0].name) ||
+                strlen(text) >= sizeof(t.exprs[0].text)) {
+                log_message("WARNING: Too many conditions or condition too long, ignoring %s", name);
+                continue;
+            }
+            strcpy(t.exprs[t.n_exprs].name, name + 5);
+            strcpy(t.exprs[t.n_exprs].text, text);
+            t.n_exprs++;
+            continue;
+        }
+        
+        // every other key takes a number
+        char *end;
+        value = strtof(text, &end);
+        if (end == text || *end != '\0' || strlen(name) >= sizeof(key)) {
+            log_message("WARNING: Invalid threshold '%s=%s', ignoring", name, text);
+            continue;
+        }
+        strcpy(key, name);
+
         // validate float-based thresholds (memory, cpu, disk, uptime)
         // ensure they are positive
         if ((strcmp(key, "memory") == 0 || strcmp(key, "cpu") == 0 || 
@@ -45,6 +106,21 @@ Thresholds load_thresholds(const char *filename) {
             }
         }
         
+        // pressure triggers are a share of the PSI window
+        if ((strcmp(key, "cpu_pressure") == 0 || strcmp(key, "memory_pressure") == 0 ||
+             strcmp(key, "io_pressure") == 0) && (value <= 0 || value > 100)) {
+            log_message("WARNING: Invalid threshold value %.1f for %s, ignoring", value, key);
+            continue;
+        }
+        
+        // alarm policy: debounce in checks, renotify in seconds, hysteresis in % of the threshold
+        if ((strcmp(key, "alarm_debounce") == 0 && (value < 1 || value != (int)value)) ||
+            (strcmp(key, "alarm_renotify") == 0 && (value < 0 || value != (int)value)) ||
+            (strcmp(key, "alarm_hysteresis") == 0 && (value < 0 || value >= 100))) {
+            log_message("WARNING: Invalid threshold value %.1f for %s, ignoring", value, key);
+            continue;
+        }
+        
         // assign values to corresponding fields in Thresholds structure
         if (strcmp(key, "memory") == 0) t.memory = value;
         else if (strcmp(key, "cpu") == 0) t.cpu = value;
@@ -52,13 +128,128 @@ Thresholds load_thresholds(const char *filename) {
         else if (strcmp(key, "uptime") == 0) t.uptime = value;
         else if (strcmp(key, "net_interfaces") == 0) t.net_interfaces = (int)value;
         else if (strcmp(key, "processes") == 0) t.processes = (int)value;
+        else if (strcmp(key, "cpu_pressure") == 0) t.cpu_pressure = value;
+        else if (strcmp(key, "memory_pressure") == 0) t.memory_pressure = value;
+        else if (strcmp(key, "io_pressure") == 0) t.io_pressure = value;
+        else if (strcmp(key, "alarm_debounce") == 0) t.alarm_debounce = (int)value;
+        else if (strcmp(key, "alarm_hysteresis") == 0) t.alarm_hysteresis = value;
+        else if (strcmp(key, "alarm_renotify") == 0) t.alarm_renotify = (int)value;
+        else if (has_suffix(key, ".clear")) {
+            // clear point of the threshold named before ".clear"
+            add_named_value(t.clears, &t.n_clears, key, strlen(".clear"), value);
+        }
+        else if (has_suffix(key, ".for")) {
+            // sustained duration, in seconds, of the threshold named before ".for"
+            if (value < 0) log_message("WARNING: Invalid threshold value %.1f for %s, ignoring", value, key);
+            else add_named_value(t.holds, &t.n_holds, key, strlen(".for"), value);
+        }
+        else {
+            // any other key names a registry metric, e.g. net.eth0.rx_bytes_ps
+            if (t.n_metrics >= MAX_METRIC_THRESHOLDS || strlen(key) >= sizeof(t.metrics[0].name)) {
+                log_message("WARNING: Too many thresholds or metric name too long, ignoring %s", key);
+                continue;
+            }
+            size_t len = strlen(key);
+            int below = len > 0 && key[len - 1] == '<';
+            if (below) key[len - 1] = '\0';
+            strcpy(t.metrics[t.n_metrics].name, key);
+            t.metrics[t.n_metrics].value = value;
+            t.metrics[t.n_metrics].below = below;
+            t.n_metrics++;
+        }
     }
     
     fclose(fp);
     
     // log the loaded threshold values
-    log_message("INFO: Loaded thresholds - memory: %.1f, cpu: %.1f, disk: %.1f, uptime: %.1f, net_interfaces: %d, processes: %d", 
-                t.memory, t.cpu, t.disk, t.uptime, t.net_interfaces, t.processes);
+    log_message("INFO: Loaded thresholds - memory: %.1f, cpu: %.1f, disk: %.1f, uptime: %.1f, net_interfaces: %d, processes: %d, pressure cpu/memory/io: %.1f/%.1f/%.1f, other metrics: %d, conditions: %d, debounce: %d, hysteresis: %.1f%%, renotify: %d s", 
+                t.memory, t.cpu, t.disk, t.uptime, t.net_interfaces, t.processes,
+                t.cpu_pressure, t.memory_pressure, t.io_pressure, t.n_metrics, t.n_exprs,
+                t.alarm_debounce, t.alarm_hysteresis, t.alarm_renotify);
     
     return t;
-}
\ No newline at end of file
+}
+
+// parse an integer setting within [min, max], keeping the current value on error
+static void parse_int_setting(const char *key, const char *value, int min, int max, int *out) {
+    char *end;
+    long v = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || v < min || v > max) {
+        log_message("WARNING: Invalid value '%s' for %s (allowed %d-%d), ignoring", value, key, min, max);
+        return;
+    }
+    *out = (int)v;
+}
+
+// load runtime settings from a configuration file
+// returns a Settings structure with either loaded values or defaults
+Settings load_settings(const char *filename) {
+    // settings structure with default values
+    Settings s;
+    memset(&s, 0, sizeof(s));
+    s.process_count_mode = PROCESS_COUNT_FAST;
+    s.sample_interval_ms = 1000;
+    s.report_interval = 10;
+    strcpy(s.disk_devices, DISK_DEVICES_DEFAULT);
+    strcpy(s.proc_root, "/proc");
+    strcpy(s.sys_root, "/sys");
+    strcpy(s.alarm_spool, "logs/alarm_spool.dat");
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        log_message("WARNING: Failed to open %s, using default settings", filename);
+        return s;
+    }
+
+    char line[256];
+    // read "key=value" lines, skipping blank lines and # comments
+    while (fgets(line, sizeof(line), fp)) {
+        char *eq = strchr(line, '=');
+        if (line[0] == '#' || !eq) continue;
+        *eq = '\0';
+        char *key = trim(line);
+        char *value = trim(eq + 1);
+
+        if (strcmp(key, "process_count") == 0) {
+            if (strcmp(value, "exact") == 0) s.process_count_mode = PROCESS_COUNT_EXACT;
+            else if (strcmp(value, "fast") == 0) s.process_count_mode = PROCESS_COUNT_FAST;
+            else log_message("WARNING: Invalid process_count mode '%s', ignoring", value);
+        } else if (strcmp(key, "sample_interval_ms") == 0) {
+            parse_int_setting(key, value, 10, 60000, &s.sample_interval_ms);
+        } else if (strcmp(key, "report_interval") == 0) {
+            parse_int_setting(key, value, 1, 3600, &s.report_interval);
+        } else if (strcmp(key, "disk_devices") == 0) {
+            snprintf(s.disk_devices, sizeof(s.disk_devices), "%s", value);
+        } else if (strcmp(key, "proc_root") == 0) {
+            snprintf(s.proc_root, sizeof(s.proc_root), "%s", value);
+        } else if (strcmp(key, "sys_root") == 0) {
+            snprintf(s.sys_root, sizeof(s.sys_root), "%s", value);
+        } else if (strcmp(key, "cgroups") == 0) {
+            snprintf(s.cgroups, sizeof(s.cgroups), "%s", value);
+        } else if (strcmp(key, "alarm_batch_ms") == 0) {
+            parse_int_setting(key, value, 0, 5000, &s.alarm_batch_ms);
+        } else if (strcmp(key, "alarm_spool") == 0) {
+            snprintf(s.alarm_spool, sizeof(s.alarm_spool), "%s", value);
+        } else if (strncmp(key, "interval.", 9) == 0) {
+            // per-collector interval, e.g. interval.disk=60000
+            if (s.n_intervals >= MAX_COLLECTOR_SETTINGS || strlen(key + 9) >= sizeof(s.intervals[0].name)) {
+                log_message("WARNING: Too many collector intervals or name too long, ignoring %s", key);
+                continue;
+            }
+            CollectorSetting *cs = &s.intervals[s.n_intervals];
+            cs->interval_ms = -1;
+            parse_int_setting(key, value, 0, 86400000, &cs->interval_ms);
+            if (cs->interval_ms < 0) continue;
+            strcpy(cs->name, key + 9);
+            s.n_intervals++;
+        } else {
+            log_message("WARNING: Unknown setting '%s', ignoring", key);
+        }
+    }
+    fclose(fp);
+
+    log_message("INFO: Loaded settings - process_count: %s, sample_interval_ms: %d, report_interval: %d, disk_devices: %s",
+                s.process_count_mode == PROCESS_COUNT_EXACT ? "exact" : "fast",
+                s.sample_interval_ms, s.report_interval, s.disk_devices);
+    return s;
+}
@@ -5,6 +5,30 @@
 #include "metrics.h"
 #include "logger.h"
 
+// maximum number of thresholds on registry metrics (per-interface rates, per-mount usage, ...)
+#define MAX_METRIC_THRESHOLDS 32
+
+// threshold on any metric of the registry by name, e.g. "net.eth0.rx_bytes_ps=12500000".
+// a '<' after the name ("disk.root.free_bytes<=500000000") alarms when the value drops below.
+// "<name>.clear=<value>" sets the value an active alarm clears at, for built-in keys as well,
+// and "<name>.for=<seconds>" how long the breach must last before the alarm is raised.
+// "<metric>.ewma" and "<metric>.slope" (change per minute) name trends of any metric
+typedef struct {
+    char name[48];
+    float value;
+    int below;            // 1 = alarm when below the value, 0 = when above
+} MetricThreshold;
+
+// maximum number of compound conditions
+#define MAX_THRESHOLD_EXPRS 16
+
+// compound condition over several metrics, "expr.<name>=cpu > 80 && memory > 70 for 30s".
+// compiled by the alarm rules (see alarm_expr.h)
+typedef struct {
+    char name[32];
+    char text[160];
+} ThresholdExpr;
+
 // Thresholds structure to hold configuration threshold values
 typedef struct {
     float memory;         // memory usage percentage
@@ -13,10 +37,51 @@ typedef struct {
     float uptime;         // system uptime in seconds
     int net_interfaces;   // number of active network interfaces
     int processes;        // for number of running processes
+    float cpu_pressure;   // PSI trigger: % of time tasks stall on cpu (0 = disabled)
+    float memory_pressure;// PSI trigger: % of time tasks stall on memory (0 = disabled)
+    float io_pressure;    // PSI trigger: % of time tasks stall on io (0 = disabled)
+    int n_metrics;        // thresholds on other registry metrics
+    MetricThreshold metrics[MAX_METRIC_THRESHOLDS];
+    int alarm_debounce;   // consecutive breached checks before an alarm is raised
+    float alarm_hysteresis;// default clear point, % of the threshold back from it
+    int alarm_renotify;   // seconds between repeats of a still active alarm (0 = never)
+    int n_clears;         // explicit clear points ("cpu.clear=70")
+    MetricThreshold clears[MAX_METRIC_THRESHOLDS];
+    int n_holds;          // how long a breach must last before it counts ("memory.slope.for=600")
+    MetricThreshold holds[MAX_METRIC_THRESHOLDS];
+    int n_exprs;          // compound conditions
+    ThresholdExpr exprs[MAX_THRESHOLD_EXPRS];
 } Thresholds;
 
+// maximum number of per-collector interval overrides
+#define MAX_COLLECTOR_SETTINGS 32
+
+// interval override for one collector ("interval.<collector>=<ms>")
+typedef struct {
+    char name[48];
+    int interval_ms;
+} CollectorSetting;
+
+// runtime settings for the collectors, loaded from system_manager.conf
+typedef struct {
+    int process_count_mode;   // PROCESS_COUNT_FAST or PROCESS_COUNT_EXACT
+    int sample_interval_ms;   // time between samples in milliseconds
+    int report_interval;      // seconds per reporting window (summary sent to the Device Agent)
+    char disk_devices[256];   // block devices tracked from /proc/diskstats (fnmatch patterns, comma separated)
+    char proc_root[128];      // procfs mount the collectors read ("/proc")
+    char sys_root[128];       // sysfs mount the collectors read ("/sys")
+    char cgroups[256];        // cgroup v2 directories of the monitored services, comma separated
+    int alarm_batch_ms;       // extra wait for alarms to share one request to the Cloud Manager
+    char alarm_spool[128];    // file keeping alarms the Cloud Manager could not take, empty = none
+    int n_intervals;          // collector interval overrides
+    CollectorSetting intervals[MAX_COLLECTOR_SETTINGS];
+} Settings;
+
 // load threshold values from a configuration file
 // returns a Thresholds structure populated with values from the file
 Thresholds load_thresholds(const char *filename);
 
+// load runtime settings from a key=value file, missing keys keep their defaults
+Settings load_settings(const char *filename);
+
 #endif 
\ No newline at end of file
@@ -9,9 +9,12 @@
 
 // the path for the Unix domain socket
 #define SOCKET_PATH "/tmp/device_agent.sock"
+// largest metrics line accepted by the device agent (MAX_METRIC_SIZE there)
+#define AGENT_MESSAGE_SIZE 1024
 
-// send system metrics to a device agent via Unix domain socket
-int send_metrics_to_agent(Metrics m) {
+// connect to the device agent, send one metrics line and wait for its ACK
+// returns 1 if a valid ACK was received, 0 otherwise
+static int send_line_to_agent(const char *buffer) {
     // Create a Unix domain socket
     int sock = socket(AF_UNIX, SOCK_STREAM, 0);
     if (sock < 0) {
@@ -32,13 +35,6 @@ int send_metrics_to_agent(Metrics m) {
         return 0; // return 0 if connection fails
     }
 
-    // Buffer to store formatted metrics string
-    char buffer[256];
-    // Format metrics into a comma-separated string
-    snprintf(buffer, sizeof(buffer),
-             "memory=%.2f,cpu=%.2f,uptime=%.2f,disk=%.2f,net=%d,proc=%d",
-             m.memory, m.cpu, m.uptime, m.disk, m.net_interfaces, m.processes);
-
     // send the formatted metrics string to the device agent
     if(send(sock, buffer, strlen(buffer), 0)) {
         printf("Metric send to device agent.\n");
@@ -61,3 +57,33 @@ int send_metrics_to_agent(Metrics m) {
     // return 1 if valid ACK received, 0 otherwise
     return (len > 0 && strncmp(ack, "ACK", 3) == 0);
 }
+
+// send a window summary to the device agent via Unix domain socket.
+// metrics are keyed by their registered name, so the set of keys follows whatever collectors
+// are registered; lines longer than the agent accepts are split into several messages
+int send_metric_summary_to_agent(const MetricSummary summary[MAX_METRICS]) {
+    // Buffer to store formatted summary string
+    char buffer[AGENT_MESSAGE_SIZE];
+    char entry[256];
+    int ok = 1;
+    int n = metric_count();
+    int used = 0;
+    for (int id = 0; id < n; id++) {
+        if (summary[id].count == 0) continue;
+        const char *name = metric_name(id);
+        // mean under the plain name keeps the old "memory=..,cpu=.." keys meaningful
+        int len = summary[id].count == 1
+            ? snprintf(entry, sizeof(entry), "%s=%.2f", name, summary[id].mean)
+            : snprintf(entry, sizeof(entry), "%s=%.2f,%s_min=%.2f,%s_max=%.2f,%s_p95=%.2f",
+                       name, summary[id].mean, name, summary[id].min, name, summary[id].max, name, summary[id].p95);
+        if (len >= (int)sizeof(entry)) continue;
+        // flush the current line when the entry does not fit
+        if (used > 0 && used + 1 + len >= (int)sizeof(buffer)) {
+            ok &= send_line_to_agent(buffer);
+            used = 0;
+        }
+        used += snprintf(buffer + used, sizeof(buffer) - used, "%s%s", used > 0 ? "," : "", entry);
+    }
+    if (used > 0) ok &= send_line_to_agent(buffer);
+    return ok;
+}
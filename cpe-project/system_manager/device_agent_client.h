@@ -3,9 +3,12 @@
 #ifndef DEVICE_AGENT_CLIENT_H
 #define DEVICE_AGENT_CLIENT_H
 
-#include "metrics.h"
+#include "metric_window.h"
 
 
-int send_metrics_to_agent(Metrics m);
+// send a reporting window summary: "<name>=<mean>,<name>_min=..,<name>_max=..,<name>_p95=.."
+// for every metric sampled in the window (only "<name>=<value>" if it was sampled once).
+// returns 1 if every message was ACKed
+int send_metric_summary_to_agent(const MetricSummary summary[MAX_METRICS]);
 
 #endif
@@ -0,0 +1,30 @@
+// procfs/sysfs roots used by the collectors ("/proc" and "/sys" unless configured)
+
+#include "host_paths.h"
+#include <stdio.h>
+
+static char proc_root_buf[HOST_ROOT_LEN] = "/proc";
+static char sys_root_buf[HOST_ROOT_LEN] = "/sys";
+
+void host_paths_set(const char *proc, const char *sys) {
+    if (proc && *proc) snprintf(proc_root_buf, sizeof(proc_root_buf), "%s", proc);
+    if (sys && *sys) snprintf(sys_root_buf, sizeof(sys_root_buf), "%s", sys);
+}
+
+const char *proc_root() {
+    return proc_root_buf;
+}
+
+const char *sys_root() {
+    return sys_root_buf;
+}
+
+const char *proc_path(char *buf, size_t size, const char *rel) {
+    snprintf(buf, size, "%s/%s", proc_root_buf, rel);
+    return buf;
+}
+
+const char *sys_path(char *buf, size_t size, const char *rel) {
+    snprintf(buf, size, "%s/%s", sys_root_buf, rel);
+    return buf;
+}
@@ -0,0 +1,21 @@
+// header file for host_paths.c : where the collectors find procfs and sysfs
+
+#ifndef HOST_PATHS_H
+#define HOST_PATHS_H
+
+#include <stddef.h>
+
+#define HOST_ROOT_LEN 128
+
+// point the collectors at another procfs/sysfs tree (e.g. a captured fixture).
+// Takes effect for files opened afterwards, call metrics_cleanup() and friends to reopen
+void host_paths_set(const char *proc_root, const char *sys_root);
+
+const char *proc_root();
+const char *sys_root();
+
+// build "<proc root>/<rel>" or "<sys root>/<rel>" into buf, returns buf
+const char *proc_path(char *buf, size_t size, const char *rel);
+const char *sys_path(char *buf, size_t size, const char *rel);
+
+#endif
@@ -2,15 +2,89 @@
 
 #include "http_client.h"
 #include "logger.h"
-#include <curl/curl.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
 
-// maximum number of retries for HTTP requests
+// maximum number of attempts for HTTP requests
 #define MAX_RETRIES 3
-// delay between retry attempts in seconds
-#define RETRY_DELAY_SECONDS 1
+
+// curl_global_init is not thread-safe and must run once per process, not once per request
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+static CURLcode curl_global_result;
+
+static void curl_global_setup(void) {
+    curl_global_result = curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+// monotonic clock in milliseconds
+static long long clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// closed circuit with the default backoff. The jitter is seeded from the kernel: devices that
+// booted together share pid and clock, and would otherwise draw the same delays
+static void breaker_init(HttpBreaker *b) {
+    memset(b, 0, sizeof(*b));
+    b->state = HTTP_BREAKER_CLOSED;
+    b->base_ms = HTTP_BACKOFF_BASE_MS;
+    b->max_ms = HTTP_BACKOFF_MAX_MS;
+    FILE *fp = fopen("/dev/urandom", "r");
+    if (!fp || fread(&b->seed, sizeof(b->seed), 1, fp) != 1) b->seed = (unsigned int)(getpid() ^ time(NULL));
+    if (fp) fclose(fp);
+}
+
+// delay after the n-th consecutive failure (from 0): base doubled n times, capped at max,
+// of which a random half is jitter
+static long long backoff_ms(HttpBreaker *b, int n) {
+    long long d = b->base_ms;
+    while (n-- > 0 && d < b->max_ms) d *= 2;
+    if (d > b->max_ms) d = b->max_ms;
+    return d / 2 + rand_r(&b->seed) % (d / 2 + 1);
+}
+
+// when the circuit lets the next attempt start: 0 now, -1 once the probe in flight has ended
+static long long breaker_ready_ms(const HttpBreaker *b) {
+    if (b->state == HTTP_BREAKER_OPEN) return b->open_until_ms;
+    if (b->state == HTTP_BREAKER_HALF_OPEN) return -1;
+    return 0;
+}
+
+// an attempt wants to start at now; the first one after the open time is the probe.
+// returns 0 if the circuit refuses it
+static int breaker_allow(HttpBreaker *b, long long now, const char *url) {
+    if (b->state == HTTP_BREAKER_CLOSED) return 1;
+    if (b->state == HTTP_BREAKER_HALF_OPEN || now < b->open_until_ms) return 0;
+    b->state = HTTP_BREAKER_HALF_OPEN;
+    log_message("INFO: Probing %s after %d failed attempts", url, b->failures);
+    return 1;
+}
+
+// record the outcome of an attempt: a success closes the circuit, enough failures or a failed
+// probe open it for the next backoff period
+static void breaker_result(HttpBreaker *b, int ok, long long now, const char *url) {
+    if (ok) {
+        if (b->state != HTTP_BREAKER_CLOSED) log_message("INFO: %s reachable again, circuit closed", url);
+        b->state = HTTP_BREAKER_CLOSED;
+        b->failures = 0;
+        b->trips = 0;
+        return;
+    }
+    b->failures++;
+    if (b->state == HTTP_BREAKER_HALF_OPEN ||
+        (b->state == HTTP_BREAKER_CLOSED && b->failures >= HTTP_BREAKER_THRESHOLD)) {
+        long long wait = backoff_ms(b, b->trips++);
+        b->state = HTTP_BREAKER_OPEN;
+        b->open_until_ms = now + wait;
+        log_message("WARNING: Circuit open for %s after %d failed attempts, holding requests for %lld ms",
+                    url, b->failures, wait);
+    }
+}
 
 // handle response data from curl
 // discards response data by returning the size of data received
@@ -18,91 +92,284 @@ static size_t write_callback(void *contents, size_t size, size_t nmemb, void *us
     return size * nmemb;
 }
 
-// send an HTTP POST request with JSON payload
-// Returns 1 on success, 0 on failure
-int send_http(const char *url, const char *json_payload) {
-    CURL *curl;           // CURL handle for HTTP request
-    CURLcode res;         // CURL result code
-    int success = 0;      // Flag to track request success
-    int retries = 0;      // Counter for retry attempts
-    long response_code = 0; // HTTP response status code
+// create a curl handle with every option that does not change between requests
+// Returns the handle, or NULL on failure
+static CURL *new_handle(const char *url, struct curl_slist *headers) {
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        // Log error if CURL initialization fails
+        log_message("ERROR: Failed to initialize curl for URL: %s", url);
+        return NULL;
+    }
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
+    curl_easy_setopt(curl, CURLOPT_URL, url);                       // Set target URL
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);                       // Enable POST method
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);            // Set HTTP headers
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);  // Set response callback
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);                // No user data for callback
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);                   // Set request timeout (10 seconds)
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);            // Set connection timeout (10 seconds)
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 0L);                // Don't fail on HTTP errors
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);                    // Disable verbose output
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);                     // Include response body
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);              // Enable TCP keep-alive
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);                   // No SIGALRM timeouts: the multi interface never blocks on them
+    return curl;
+}
 
-    // retry loop for handling transient failures
-    while (retries < MAX_RETRIES && !success) {
-        curl = curl_easy_init();
-        if (!curl) {
-            // Log error if CURL initialization fails
-            log_message("ERROR: Failed to initialize curl for URL: %s", url);
-            curl_global_cleanup();
-            return 0;
-        }
+// global setup and the header list sent with every request
+// Returns 0 on success, -1 on failure
+static int setup_headers(struct curl_slist **headers, const char *url) {
+    pthread_once(&curl_once, curl_global_setup);
+    if (curl_global_result != CURLE_OK) {
+        log_message("ERROR: Failed to initialize curl: %s", curl_easy_strerror(curl_global_result));
+        return -1;
+    }
 
-        // Set up HTTP headers
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        headers = curl_slist_append(headers, "Accept: application/json");
-        if (!headers) {
-            // Log error if header setup fails
-            log_message("ERROR: Failed to set headers for URL: %s", url);
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            return 0;
+    // Set up HTTP headers
+    *headers = curl_slist_append(*headers, "Content-Type: application/json");
+    *headers = curl_slist_append(*headers, "Accept: application/json");
+    if (!*headers) {
+        // Log error if header setup fails
+        log_message("ERROR: Failed to set headers for URL: %s", url);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 if an attempt says the server is up: it answered, and not with a server error
+static int server_reachable(CURLcode res, long response_code) {
+    return res == CURLE_OK && response_code < 500;
+}
+
+// 1 if the server refused the request itself: sending the same body again cannot succeed.
+// 408 (request timeout) and 429 (too many requests) are about timing and are retried
+static int rejected(CURLcode res, long response_code) {
+    return res == CURLE_OK && response_code >= 400 && response_code < 500 &&
+           response_code != 408 && response_code != 429;
+}
+
+// curl tells which socket to watch for what; the caller's poll loop picks the list up
+static int socket_callback(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp) {
+    HttpAsync *client = userp;
+    int i;
+    for (i = 0; i < client->n_sockets && client->sockets[i].fd != fd; i++) {}
+    if (what == CURL_POLL_REMOVE) {
+        if (i < client->n_sockets) client->sockets[i] = client->sockets[--client->n_sockets];
+        return 0;
+    }
+    if (i == client->n_sockets) {
+        if (i == HTTP_MAX_SOCKETS) {
+            log_message("ERROR: Too many HTTP sockets, fd %d not watched", fd);
+            return -1;
         }
+        client->n_sockets++;
+    }
+    client->sockets[i].fd = fd;
+    client->sockets[i].events = (what & CURL_POLL_IN ? POLLIN : 0) | (what & CURL_POLL_OUT ? POLLOUT : 0);
+    client->sockets[i].revents = 0;
+    return 0;
+}
+
+// curl wants to be called back after timeout_ms (-1 = cancel)
+static int timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+    HttpAsync *client = userp;
+    client->timer_ms = timeout_ms < 0 ? -1 : clock_ms() + timeout_ms;
+    return 0;
+}
 
-        // Configure CURL options for the HTTP POST request
-        curl_easy_setopt(curl, CURLOPT_URL, url);                    // Set target URL
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);                   // Enable POST method
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_payload);   // Set JSON payload
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)strlen(json_payload)); // Set payload size
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);        // Set HTTP headers
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback); // Set response callback
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);            // No user data for callback
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);               // Set request timeout (10 seconds)
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);        // Set connection timeout (10 seconds)
-        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 0L);            // Don't fail on HTTP errors
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);                // Disable verbose output
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);                 // Include response body
-        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);          // Enable TCP keep-alive
-
-        // HTTP request
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            // log error for all CURL failures, including CURLE_GOT_NOTHING
-            log_message("ERROR: curl_easy_perform() failed: %s (URL: %s, retry %d/%d)",
-                        curl_easy_strerror(res), url, retries + 1, MAX_RETRIES);
-            if (retries < MAX_RETRIES - 1) {
-                // log retry attempt and wait before next attempt
-                log_message("INFO: Retrying in %d seconds for URL: %s", RETRY_DELAY_SECONDS, url);
-                sleep(RETRY_DELAY_SECONDS);
-            }
+int http_async_init(HttpAsync *client, const char *url) {
+    memset(client, 0, sizeof(*client));
+    snprintf(client->url, sizeof(client->url), "%s", url);
+    client->timer_ms = -1;
+    breaker_init(&client->breaker);
+    if (setup_headers(&client->headers, url) != 0) {
+        http_async_cleanup(client);
+        return -1;
+    }
+    client->multi = curl_multi_init();
+    if (!client->multi) {
+        log_message("ERROR: Failed to initialize curl multi for URL: %s", url);
+        http_async_cleanup(client);
+        return -1;
+    }
+    curl_multi_setopt(client->multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(client->multi, CURLMOPT_SOCKETDATA, client);
+    curl_multi_setopt(client->multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(client->multi, CURLMOPT_TIMERDATA, client);
+    curl_multi_setopt(client->multi, CURLMOPT_MAXCONNECTS, (long)HTTP_MAX_IN_FLIGHT);   // keep-alive pool
+    return 0;
+}
+
+// hand a transfer's handle to the multi for its next attempt
+// Returns 1 on success, 0 on failure
+static int start_transfer(HttpAsync *client, HttpTransfer *t) {
+    if (!t->curl) {
+        t->curl = new_handle(client->url, client->headers);
+        if (!t->curl) return 0;
+        curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+    }
+    t->retry_ms = 0;
+    curl_easy_setopt(t->curl, CURLOPT_POSTFIELDS, t->payload);                 // Set JSON payload
+    curl_easy_setopt(t->curl, CURLOPT_POSTFIELDSIZE, (long)strlen(t->payload)); // Set payload size
+    if (curl_multi_add_handle(client->multi, t->curl) != CURLM_OK) {
+        log_message("ERROR: Failed to start HTTP request for URL: %s", client->url);
+        return 0;
+    }
+    return 1;
+}
+
+int http_async_post(HttpAsync *client, const char *payload, HttpDoneFn done, void *ctx) {
+    HttpTransfer *t = NULL;
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT && !t; i++)
+        if (!client->transfers[i].busy) t = &client->transfers[i];
+    // fail fast while the cloud is known to be down
+    if (!t || !breaker_allow(&client->breaker, clock_ms(), client->url)) return -1;
+    t->payload = payload;
+    t->done = done;
+    t->ctx = ctx;
+    t->attempt = 0;
+    if (!start_transfer(client, t)) {
+        breaker_result(&client->breaker, 0, clock_ms(), client->url);
+        return -1;
+    }
+    t->busy = 1;
+    return 0;
+}
+
+int http_async_in_flight(const HttpAsync *client) {
+    int n = 0;
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT; i++) n += client->transfers[i].busy;
+    return n;
+}
+
+int http_async_wait_ms(const HttpAsync *client) {
+    long long ready = breaker_ready_ms(&client->breaker);
+    if (ready <= 0) return (int)ready;
+    long long left = ready - clock_ms();
+    return left > 0 ? (int)left : 0;
+}
+
+int http_async_pollfds(const HttpAsync *client, struct pollfd *pfds, int max) {
+    int n = client->n_sockets < max ? client->n_sockets : max;
+    memcpy(pfds, client->sockets, n * sizeof(*pfds));
+    return n;
+}
+
+int http_async_timeout(const HttpAsync *client) {
+    long long due = client->timer_ms;
+    long long ready = breaker_ready_ms(&client->breaker);
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT && ready >= 0; i++) {
+        // a retry waits for its backoff and for the circuit
+        long long retry = client->transfers[i].retry_ms;
+        if (retry > 0 && retry < ready) retry = ready;
+        if (retry > 0 && (due < 0 || retry < due)) due = retry;
+    }
+    if (due < 0) return -1;
+    long long left = due - clock_ms();
+    return left > 0 ? (int)left : 0;
+}
+
+// a transfer's attempt has ended: report it, or schedule a retry
+static void finish_transfer(HttpAsync *client, HttpTransfer *t, CURLcode res) {
+    long response_code = 0; // HTTP response status code
+    long long now = clock_ms();
+    curl_multi_remove_handle(client->multi, t->curl);
+    t->attempt++;
+    if (res != CURLE_OK) {
+        // log error for all CURL failures, including CURLE_GOT_NOTHING
+        log_message("ERROR: HTTP request failed: %s (URL: %s, retry %d/%d)",
+                    curl_easy_strerror(res), client->url, t->attempt, MAX_RETRIES);
+    } else {
+        // get HTTP response code
+        curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &response_code);
+        if (response_code >= 200 && response_code < 300) {
+            // log success for 2xx status codes
+            log_message("INFO: HTTP request succeeded with status %ld for URL: %s", response_code, client->url);
         } else {
-            // get HTTP response code
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            if (response_code >= 200 && response_code < 300) {
-                // log success for 2xx status codes
-                success = 1;
-                log_message("INFO: HTTP request succeeded with status %ld for URL: %s", response_code, url);
-            } else {
-                // log failure for non-2xx status codes
-                log_message("ERROR: HTTP request failed with status %ld for URL: %s", response_code, url);
-            }
+            // log failure for non-2xx status codes
+            log_message("ERROR: HTTP request failed with status %ld for URL: %s", response_code, client->url);
         }
+    }
+    breaker_result(&client->breaker, server_reachable(res, response_code), now, client->url);
+    if (res == CURLE_OK && response_code >= 200 && response_code < 300) {
+        t->busy = 0;
+        t->done(t->ctx, HTTP_SENT);
+        return;
+    }
+    if (rejected(res, response_code)) {
+        log_message("ERROR: HTTP request rejected with status %ld for URL: %s, not retrying", response_code, client->url);
+        t->busy = 0;
+        t->done(t->ctx, HTTP_REJECTED);
+        return;
+    }
+    if (t->attempt < MAX_RETRIES) {
+        // log retry attempt; the poll loop brings us back once the backoff is over and the
+        // circuit lets it through
+        t->retry_ms = now + backoff_ms(&client->breaker, t->attempt - 1);
+        long long ready = breaker_ready_ms(&client->breaker);
+        if (ready > t->retry_ms) t->retry_ms = ready;
+        log_message("INFO: Retrying in %lld ms for URL: %s", t->retry_ms - now, client->url);
+        return;
+    }
+    // log final failure if all retries are exhausted
+    log_message("ERROR: Failed to send HTTP request after %d retries (URL: %s, last status: %ld)",
+                MAX_RETRIES, client->url, response_code);
+    t->busy = 0;
+    t->done(t->ctx, HTTP_FAILED);
+}
 
-        // clean up headers and CURL handle
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        retries++;
+void http_async_run(HttpAsync *client, const struct pollfd *pfds, int n) {
+    int running;
+    for (int i = 0; i < n; i++) {
+        if (!pfds[i].revents) continue;
+        int flags = (pfds[i].revents & POLLIN ? CURL_CSELECT_IN : 0) |
+                    (pfds[i].revents & POLLOUT ? CURL_CSELECT_OUT : 0) |
+                    (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL) ? CURL_CSELECT_ERR : 0);
+        curl_multi_socket_action(client->multi, pfds[i].fd, flags, &running);
+    }
+    long long now = clock_ms();
+    if (client->timer_ms >= 0 && now >= client->timer_ms) {
+        client->timer_ms = -1;
+        curl_multi_socket_action(client->multi, CURL_SOCKET_TIMEOUT, 0, &running);
     }
 
-    // log final failure if all retries are exhausted
-    if (!success) {
-        log_message("ERROR: Failed to send HTTP request after %d retries (URL: %s, last status: %ld)",
-                    MAX_RETRIES, url, response_code);
+    // report finished attempts; a callback may post again, which takes a free transfer
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(client->multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        HttpTransfer *t;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+        finish_transfer(client, t, msg->data.result);
+    }
+
+    // retries that are due
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT; i++) {
+        HttpTransfer *t = &client->transfers[i];
+        if (!t->busy || t->retry_ms == 0 || now < t->retry_ms) continue;
+        if (!breaker_allow(&client->breaker, now, client->url)) continue;
+        if (!start_transfer(client, t)) {
+            breaker_result(&client->breaker, 0, now, client->url);
+            t->busy = 0;
+            t->done(t->ctx, HTTP_FAILED);
+        }
     }
+}
 
-    // clean up CURL global resources
-    curl_global_cleanup();
-    return success;
+void http_async_cleanup(HttpAsync *client) {
+    for (int i = 0; i < HTTP_MAX_IN_FLIGHT; i++) {
+        HttpTransfer *t = &client->transfers[i];
+        if (!t->curl) continue;
+        if (client->multi) curl_multi_remove_handle(client->multi, t->curl);
+        curl_easy_cleanup(t->curl);
+        t->curl = NULL;
+        t->busy = 0;
+    }
+    if (client->multi) curl_multi_cleanup(client->multi);
+    client->multi = NULL;
+    curl_slist_free_all(client->headers);
+    client->headers = NULL;
+    client->n_sockets = 0;
+    client->timer_ms = -1;
 }
@@ -3,12 +3,99 @@
 #ifndef HTTP_CLIENT_H
 #define HTTP_CLIENT_H
 
-// sends an HTTP request to the specified URL with a JSON payload.
-// parameters:
-//   url - The destination URL for the HTTP request.
-//   json_payload - The JSON-formatted string to be sent in the request body.
-// returns:
-//   an integer status code (implementation-defined, e.g., 0 for success, non-zero for error).
-int send_http(const char *url, const char *json_payload);
+#include <curl/curl.h>
+#include <poll.h>
+
+// requests an HttpAsync keeps in flight at once
+#define HTTP_MAX_IN_FLIGHT 4
+// sockets curl may ask an HttpAsync to watch
+#define HTTP_MAX_SOCKETS 8
+
+// circuit breaker states
+#define HTTP_BREAKER_CLOSED 0       // requests flow, failures are counted
+#define HTTP_BREAKER_OPEN 1         // requests fail fast until open_until_ms
+#define HTTP_BREAKER_HALF_OPEN 2    // one probe request decides between closed and open
+
+// consecutive failed attempts that open the circuit
+#define HTTP_BREAKER_THRESHOLD 3
+// first retry delay and open time, doubled per failure up to the max; a random half of it is jitter
+#define HTTP_BACKOFF_BASE_MS 1000
+#define HTTP_BACKOFF_MAX_MS 300000
+
+// circuit breaker shared by every request of a client, so an unreachable cloud costs one probe per
+// backoff period instead of a round of timeouts per alarm
+typedef struct {
+    int state;
+    int failures;               // consecutive failed attempts
+    int trips;                  // consecutive times the circuit opened, sets the open time
+    long long open_until_ms;
+    int base_ms;                // backoff parameters, HTTP_BACKOFF_* after init
+    int max_ms;
+    unsigned int seed;          // jitter, seeded per device so a fleet does not retry in step
+} HttpBreaker;
+
+// outcome of a non-blocking post
+#define HTTP_FAILED 0       // transport error or server error after the retries: worth sending again later
+#define HTTP_SENT 1         // 2xx status
+#define HTTP_REJECTED 2     // 4xx status other than 408/429: the server will never take this body
+
+// called when a non-blocking post has finished with HTTP_SENT, HTTP_REJECTED or HTTP_FAILED
+typedef void (*HttpDoneFn)(void *ctx, int result);
+
+// one request of an HttpAsync
+typedef struct {
+    CURL *curl;                 // kept for the next request, NULL until first used
+    const char *payload;        // the caller's body, which must stay valid until done is called
+    HttpDoneFn done;
+    void *ctx;
+    int busy;
+    int attempt;
+    long long retry_ms;         // > 0: waiting to be retried at this time
+} HttpTransfer;
+
+// non-blocking client for one URL on curl multi. It never waits itself: the caller's poll loop
+// watches its sockets and calls http_async_run when they are ready or its timeout expires
+typedef struct {
+    CURLM *multi;               // owns the keep-alive connections shared by all transfers
+    struct curl_slist *headers;
+    char url[256];
+    HttpTransfer transfers[HTTP_MAX_IN_FLIGHT];
+    struct pollfd sockets[HTTP_MAX_SOCKETS];   // what curl wants watched
+    int n_sockets;
+    long long timer_ms;         // when curl wants to be called back, -1 = never
+    HttpBreaker breaker;
+} HttpAsync;
+
+// set up a non-blocking client posting to url.
+// returns 0 on success, -1 if curl could not be initialized
+int http_async_init(HttpAsync *client, const char *url);
+
+// start posting payload and return at once; done is called from http_async_run when it ends.
+// failed attempts are retried with exponential backoff, but never while the circuit is open;
+// a request the server rejects (see HTTP_REJECTED) is not.
+// returns 0 if started, -1 if HTTP_MAX_IN_FLIGHT requests are already in flight, the circuit
+// does not let a new request through (see http_async_wait_ms) or curl failed
+int http_async_post(HttpAsync *client, const char *payload, HttpDoneFn done, void *ctx);
+
+// requests in flight, including those waiting to be retried
+int http_async_in_flight(const HttpAsync *client);
+
+// milliseconds until the circuit lets a new request through: 0 now, -1 not before the probe
+// request in flight has ended
+int http_async_wait_ms(const HttpAsync *client);
+
+// copy the sockets to watch into pfds (at most max).
+// returns how many were copied
+int http_async_pollfds(const HttpAsync *client, struct pollfd *pfds, int max);
+
+// milliseconds until http_async_run is due even if no socket is ready, -1 if nothing is pending
+int http_async_timeout(const HttpAsync *client);
+
+// advance the transfers: pfds are the entries filled by http_async_pollfds after poll() set their
+// revents. Finished requests are retried or reported through their done callback
+void http_async_run(HttpAsync *client, const struct pollfd *pfds, int n);
+
+// abort the requests in flight without calling their callbacks and release the client
+void http_async_cleanup(HttpAsync *client);
 
 #endif 
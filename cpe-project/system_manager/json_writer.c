@@ -0,0 +1,226 @@
+// JSON writer: escapes strings, formats numbers without printf and grows its buffer on demand
+
+#include "json_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void json_init(JsonWriter *w, char *buf, size_t size) {
+    w->buf = buf;
+    w->cap = size;
+    w->on_heap = 0;
+    w->failed = size == 0;
+    json_reset(w);
+}
+
+void json_reset(JsonWriter *w) {
+    w->len = 0;
+    if (w->cap > 0) w->buf[0] = '\0';
+    w->depth = 0;
+    w->first[0] = 1;
+    w->after_key = 0;
+}
+
+void json_free(JsonWriter *w) {
+    if (w->on_heap) free(w->buf);
+    w->buf = NULL;
+    w->cap = 0;
+    w->on_heap = 0;
+}
+
+const char *json_text(const JsonWriter *w) {
+    return w->cap > 0 ? w->buf : "";
+}
+
+size_t json_len(const JsonWriter *w) {
+    return w->len;
+}
+
+int json_failed(const JsonWriter *w) {
+    return w->failed;
+}
+
+// make room for n more bytes plus the terminator. returns 0 if the writer failed
+static int reserve(JsonWriter *w, size_t n) {
+    if (w->failed) return 0;
+    if (w->len + n + 1 <= w->cap) return 1;
+    size_t cap = w->cap * 2;
+    while (cap < w->len + n + 1) cap *= 2;
+    if (cap > JSON_MAX_SIZE) {
+        w->failed = 1;
+        return 0;
+    }
+    char *buf = w->on_heap ? realloc(w->buf, cap) : malloc(cap);
+    if (!buf) {
+        w->failed = 1;
+        return 0;
+    }
+    // the caller's buffer is left as it was; from here on the document lives on the heap
+    if (!w->on_heap) memcpy(buf, w->buf, w->len + 1);
+    w->buf = buf;
+    w->cap = cap;
+    w->on_heap = 1;
+    return 1;
+}
+
+static void put(JsonWriter *w, const char *s, size_t n) {
+    if (!reserve(w, n)) return;
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+    w->buf[w->len] = '\0';
+}
+
+// separator before a value or key at the current level
+static void separate(JsonWriter *w) {
+    if (w->after_key) {
+        w->after_key = 0;
+        return;
+    }
+    if (!w->first[w->depth]) put(w, ",", 1);
+    w->first[w->depth] = 0;
+}
+
+static void open_level(JsonWriter *w, char c) {
+    separate(w);
+    put(w, &c, 1);
+    if (w->depth + 1 >= JSON_MAX_DEPTH) {
+        w->failed = 1;
+        return;
+    }
+    w->first[++w->depth] = 1;
+}
+
+static void close_level(JsonWriter *w, char c) {
+    if (w->depth > 0) w->depth--;
+    put(w, &c, 1);
+}
+
+void json_object_begin(JsonWriter *w) { open_level(w, '{'); }
+void json_object_end(JsonWriter *w) { close_level(w, '}'); }
+void json_array_begin(JsonWriter *w) { open_level(w, '['); }
+void json_array_end(JsonWriter *w) { close_level(w, ']'); }
+
+// write s as a quoted JSON string. Runs of plain characters are copied in one go
+static void put_escaped(JsonWriter *w, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    put(w, "\"", 1);
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        put(w, run, s - run);
+        char esc[6] = { '\\', (char)c, 0, 0, 0, 0 };
+        size_t n = 2;
+        if (c == '\n') esc[1] = 'n';
+        else if (c == '\r') esc[1] = 'r';
+        else if (c == '\t') esc[1] = 't';
+        else if (c < 0x20) {
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 15];
+            n = 6;
+        }
+        put(w, esc, n);
+        run = s + 1;
+    }
+    put(w, run, s - run);
+    put(w, "\"", 1);
+}
+
+void json_key(JsonWriter *w, const char *key) {
+    separate(w);
+    put_escaped(w, key);
+    put(w, ":", 1);
+    w->after_key = 1;
+}
+
+void json_string(JsonWriter *w, const char *s) {
+    separate(w);
+    put_escaped(w, s);
+}
+
+// digits of v, written backwards from end. returns the start
+static char *format_uint(unsigned long long v, char *end) {
+    do {
+        *--end = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    return end;
+}
+
+void json_int(JsonWriter *w, long long v) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    char *p = format_uint(u, end);
+    if (v < 0) *--p = '-';
+    separate(w);
+    put(w, p, end - p);
+}
+
+void json_double(JsonWriter *w, double v, int decimals) {
+    static const double scale[] = { 1, 10, 100, 1e3, 1e4, 1e5, 1e6 };
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+    // NaN fails both comparisons; values too large for the integer path go through printf
+    double limit = 9e18 / scale[decimals];
+    if (!(v > -limit && v < limit)) {
+        if (v != v || v == v * 2) {
+            // NaN or infinite: JSON has no literal for them
+            separate(w);
+            put(w, "null", 4);
+            return;
+        }
+        char text[400];
+        int n = snprintf(text, sizeof(text), "%.*f", decimals, v);
+        separate(w);
+        put(w, text, n < (int)sizeof(text) ? (size_t)n : sizeof(text) - 1);
+        return;
+    }
+    // fixed point: round to an integer number of 10^-decimals units and print its digits
+    int negative = v < 0;
+    unsigned long long units = (unsigned long long)((negative ? -v : v) * scale[decimals] + 0.5);
+    char digits[40];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    for (int d = 0; d < decimals; d++) {
+        *--p = (char)('0' + units % 10);
+        units /= 10;
+    }
+    if (decimals > 0) *--p = '.';
+    p = format_uint(units, p);
+    // "-0.00" reads oddly; only negative values that survive rounding keep their sign
+    int nonzero = 0;
+    for (char *q = p; q < end; q++) nonzero |= *q > '0';
+    if (negative && nonzero) *--p = '-';
+    separate(w);
+    put(w, p, end - p);
+}
+
+void json_bool(JsonWriter *w, int v) {
+    separate(w);
+    if (v) put(w, "true", 4);
+    else put(w, "false", 5);
+}
+
+void json_raw(JsonWriter *w, const char *json, size_t len) {
+    separate(w);
+    put(w, json, len);
+}
+
+void json_member_string(JsonWriter *w, const char *key, const char *s) {
+    json_key(w, key);
+    json_string(w, s);
+}
+
+void json_member_int(JsonWriter *w, const char *key, long long v) {
+    json_key(w, key);
+    json_int(w, v);
+}
+
+void json_member_double(JsonWriter *w, const char *key, double v, int decimals) {
+    json_key(w, key);
+    json_double(w, v, decimals);
+}
@@ -0,0 +1,56 @@
+// header file for json_writer.c : escaping JSON writer over a growable buffer
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stddef.h>
+
+// deepest nesting of objects and arrays
+#define JSON_MAX_DEPTH 8
+// the buffer never grows past this; larger documents fail
+#define JSON_MAX_SIZE (1024 * 1024)
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int on_heap;                        // buf was allocated by the writer and must be freed
+    int failed;                         // out of memory, too large or too deep: the output is unusable
+    int depth;
+    unsigned char first[JSON_MAX_DEPTH];    // no member written yet at this level
+    int after_key;                      // a key was written, its value comes next
+} JsonWriter;
+
+// start writing into the caller's buffer; it moves to the heap if the document outgrows it
+void json_init(JsonWriter *w, char *buf, size_t size);
+// release heap storage, if the writer grew
+void json_free(JsonWriter *w);
+// the document written so far (NUL terminated), and its length
+const char *json_text(const JsonWriter *w);
+size_t json_len(const JsonWriter *w);
+// 1 if the document could not be written completely
+int json_failed(const JsonWriter *w);
+// drop what was written, keeping the storage
+void json_reset(JsonWriter *w);
+
+void json_object_begin(JsonWriter *w);
+void json_object_end(JsonWriter *w);
+void json_array_begin(JsonWriter *w);
+void json_array_end(JsonWriter *w);
+// member name inside an object; the next value call writes its value
+void json_key(JsonWriter *w, const char *key);
+
+// values. Strings are escaped; numbers that are not finite are written as null
+void json_string(JsonWriter *w, const char *s);
+void json_int(JsonWriter *w, long long v);
+void json_double(JsonWriter *w, double v, int decimals);
+void json_bool(JsonWriter *w, int v);
+// an already encoded JSON value (e.g. a payload from another writer)
+void json_raw(JsonWriter *w, const char *json, size_t len);
+
+// key and value in one call
+void json_member_string(JsonWriter *w, const char *key, const char *s);
+void json_member_int(JsonWriter *w, const char *key, long long v);
+void json_member_double(JsonWriter *w, const char *key, double v, int decimals);
+
+#endif
@@ -0,0 +1,263 @@
+// network interface tracking over rtnetlink (replaces getifaddrs polling)
+
+#include "link_monitor.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// receive buffer for netlink messages (kernel recommends at least 8 KB)
+#define NL_BUF_SIZE 32768
+// socket receive queue size, large enough to absorb a burst of link flaps
+#define NL_RCVBUF (256 * 1024)
+
+// one address assigned to an interface
+typedef struct {
+    unsigned char family;
+    unsigned char prefixlen;
+    unsigned char addr[16];
+} LinkAddr;
+
+// one entry of the interface table
+typedef struct {
+    int ifindex;                        // 0 = free slot
+    char name[IFNAMSIZ];
+    int up;                             // administratively up and carrier present
+    int seen;                           // set while resyncing from a dump
+    int naddrs;
+    LinkAddr addrs[MAX_LINK_ADDRS];
+} Link;
+
+static Link links[MAX_LINKS];
+static int nl_fd = -1;                  // subscription socket
+static unsigned int nl_seq = 0;         // sequence number for dump requests
+static char nl_buf[NL_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+// find the table entry for ifindex, optionally allocating a free slot
+static Link *find_link(int ifindex, int create) {
+    Link *free_slot = NULL;
+    for (int i = 0; i < MAX_LINKS; i++) {
+        if (links[i].ifindex == ifindex) return &links[i];
+        if (!free_slot && links[i].ifindex == 0) free_slot = &links[i];
+    }
+    if (!create || !free_slot) return NULL;
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->ifindex = ifindex;
+    return free_slot;
+}
+
+// RTM_NEWLINK / RTM_DELLINK
+static void handle_link(struct nlmsghdr *nh, link_event_fn on_event) {
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi))) return;
+
+    if (nh->nlmsg_type == RTM_DELLINK) {
+        Link *l = find_link(ifi->ifi_index, 0);
+        if (!l) return;
+        if (l->up && on_event) on_event(l->name, 0);
+        l->ifindex = 0;
+        return;
+    }
+
+    Link *l = find_link(ifi->ifi_index, 1);
+    if (!l) return; // table full, interface is not tracked
+
+    // pick up the interface name from the attributes
+    int attr_len = IFLA_PAYLOAD(nh);
+    for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            strncpy(l->name, RTA_DATA(rta), IFNAMSIZ - 1);
+            l->name[IFNAMSIZ - 1] = '\0';
+        }
+    }
+
+    int up = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+    if (up != l->up && on_event) on_event(l->name, up);
+    l->up = up;
+    l->seen = 1;
+}
+
+// RTM_NEWADDR / RTM_DELADDR
+static void handle_addr(struct nlmsghdr *nh) {
+    struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa))) return;
+
+    Link *l = find_link(ifa->ifa_index, nh->nlmsg_type == RTM_NEWADDR);
+    if (!l) return;
+
+    // IFA_LOCAL is the interface's own address on point-to-point links, prefer it over IFA_ADDRESS
+    LinkAddr a;
+    memset(&a, 0, sizeof(a));
+    a.family = ifa->ifa_family;
+    a.prefixlen = ifa->ifa_prefixlen;
+    int have_local = 0;
+    int attr_len = IFA_PAYLOAD(nh);
+    for (struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, attr_len); rta = RTA_NEXT(rta, attr_len)) {
+        if ((rta->rta_type == IFA_LOCAL || (rta->rta_type == IFA_ADDRESS && !have_local)) &&
+            RTA_PAYLOAD(rta) <= sizeof(a.addr)) {
+            memcpy(a.addr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+            have_local = rta->rta_type == IFA_LOCAL;
+        }
+    }
+
+    int i;
+    for (i = 0; i < l->naddrs; i++)
+        if (memcmp(&l->addrs[i], &a, sizeof(a)) == 0) break;
+
+    if (nh->nlmsg_type == RTM_NEWADDR) {
+        // the kernel re-announces addresses on lifetime updates, so only add unknown ones
+        if (i == l->naddrs && l->naddrs < MAX_LINK_ADDRS) l->addrs[l->naddrs++] = a;
+    } else if (i < l->naddrs) {
+        l->addrs[i] = l->addrs[--l->naddrs];
+    }
+}
+
+// walk the netlink messages in buf. returns 1 when the end of a dump was reached
+static int dispatch(int len, link_event_fn on_event) {
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)nl_buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+        switch (nh->nlmsg_type) {
+        case NLMSG_DONE:
+        case NLMSG_ERROR:
+            return 1;
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            handle_link(nh, on_event);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            handle_addr(nh);
+            break;
+        }
+    }
+    return 0;
+}
+
+// request a full dump of links or addresses on a private socket and apply it to the table
+static int dump(int type, link_event_fn on_event) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) return -1;
+
+    struct {
+        struct nlmsghdr nh;
+        struct rtgenmsg gen;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.gen));
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++nl_seq;
+    req.gen.rtgen_family = AF_UNSPEC;
+
+    if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+        close(fd);
+        return -1;
+    }
+    int done = 0;
+    while (!done) {
+        int len = recv(fd, nl_buf, sizeof(nl_buf), 0);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) {
+            close(fd);
+            return -1;
+        }
+        done = dispatch(len, on_event);
+    }
+    close(fd);
+    return 0;
+}
+
+// rebuild the table from a fresh dump, reporting links that disappeared or changed state
+static int resync(link_event_fn on_event) {
+    for (int i = 0; i < MAX_LINKS; i++) {
+        links[i].seen = 0;
+        links[i].naddrs = 0;
+    }
+    if (dump(RTM_GETLINK, on_event) < 0 || dump(RTM_GETADDR, on_event) < 0) return -1;
+    for (int i = 0; i < MAX_LINKS; i++) {
+        if (links[i].ifindex && !links[i].seen) {
+            if (links[i].up && on_event) on_event(links[i].name, 0);
+            links[i].ifindex = 0;
+        }
+    }
+    return 0;
+}
+
+// subscribe to link and address notifications and load the current table
+int link_monitor_open() {
+    if (nl_fd >= 0) return nl_fd;
+
+    nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl_fd < 0) return -1;
+
+    int rcvbuf = NL_RCVBUF;
+    setsockopt(nl_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(nl_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        link_monitor_close();
+        return -1;
+    }
+
+    int groups[] = { RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR };
+    for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+        if (setsockopt(nl_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &groups[i], sizeof(groups[i])) < 0) {
+            link_monitor_close();
+            return -1;
+        }
+    }
+
+    // subscribe first and dump second, so no change can slip in between
+    memset(links, 0, sizeof(links));
+    if (resync(NULL) < 0) {
+        link_monitor_close();
+        return -1;
+    }
+    return nl_fd;
+}
+
+// apply queued notifications
+int link_monitor_process(link_event_fn on_event) {
+    if (nl_fd < 0) return -1;
+    int processed = 0;
+    while (1) {
+        int len = recv(nl_fd, nl_buf, sizeof(nl_buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == ENOBUFS) {
+                // the kernel dropped notifications, the table can no longer be trusted
+                if (resync(on_event) < 0) return -1;
+                processed++;
+                continue;
+            }
+            return -1;
+        }
+        if (len == 0) break;
+        dispatch(len, on_event);
+        processed++;
+    }
+    return processed;
+}
+
+int link_monitor_active() {
+    return nl_fd >= 0;
+}
+
+// number of interfaces with at least one address, each interface counted once
+int link_monitor_count() {
+    int count = 0;
+    for (int i = 0; i < MAX_LINKS; i++)
+        if (links[i].ifindex && links[i].naddrs > 0) count++;
+    return count;
+}
+
+void link_monitor_close() {
+    if (nl_fd >= 0) close(nl_fd);
+    nl_fd = -1;
+    memset(links, 0, sizeof(links));
+}
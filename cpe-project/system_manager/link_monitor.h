@@ -0,0 +1,30 @@
+// header file for link_monitor.c : rtnetlink based network interface tracking
+
+#ifndef LINK_MONITOR_H
+#define LINK_MONITOR_H
+
+// maximum number of interfaces and addresses per interface kept in the table
+#define MAX_LINKS 64
+#define MAX_LINK_ADDRS 16
+
+// called for every link up/down transition seen on the netlink socket
+typedef void (*link_event_fn)(const char *ifname, int up);
+
+// subscribe to RTNLGRP_LINK/RTNLGRP_IPV4_IFADDR/RTNLGRP_IPV6_IFADDR and load the current
+// interface table. returns the socket fd to poll for POLLIN, or -1 on failure
+int link_monitor_open();
+
+// drain pending netlink messages and update the table, calling on_event for link transitions.
+// never blocks. returns number of messages processed, or -1 on socket error
+int link_monitor_process(link_event_fn on_event);
+
+// 1 if the monitor is open and its table is valid
+int link_monitor_active();
+
+// number of interfaces that have at least one address
+int link_monitor_count();
+
+// close the netlink socket and clear the table
+void link_monitor_close();
+
+#endif
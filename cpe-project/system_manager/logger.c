@@ -1,45 +1,213 @@
-// log file manager
+// log file manager. log_message only formats into a ring of slots claimed without locks; a
+// flusher thread writes them out in batches, so logging costs no open/write/close per call
 
 #include "logger.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
-// log messages to a file with a timestamp
-void log_message(const char *format, ...) {
-    FILE *fp = fopen("logs/system_manager.log", "a");
-    if (!fp) {
+#define LOG_FILE "logs/system_manager.log"
+// bytes written to the file in one go
+#define LOG_BATCH_SIZE 65536
+
+// one message. seq tells who owns the slot: equal to the ring position when free for a producer,
+// position + 1 once the message is complete (bounded multi-producer queue with per-slot sequences)
+typedef struct {
+    atomic_size_t seq;
+    time_t time;
+    char text[LOG_RECORD_SIZE];
+} LogSlot;
+
+static LogSlot ring[LOG_RING_SLOTS];
+static atomic_size_t tail;                  // next position a producer claims
+static size_t head;                         // next position to write, under flush_lock
+static atomic_int dropped;                  // messages lost to a full ring
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;   // one consumer at a time
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static int threaded = 0;                    // flusher running; otherwise log_message flushes itself
+static char log_path[256] = LOG_FILE;      // under flush_lock
+static int log_fd = -1;
+static ino_t log_ino;
+
+// write the whole buffer, retrying short writes
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(log_fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "ERROR: Failed to write log file\n");
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// (re)open the log file if it is not open or was rotated away since
+static int open_log() {
+    struct stat st;
+    if (log_fd >= 0 && stat(log_path, &st) == 0 && st.st_ino == log_ino) return 1;
+    if (log_fd >= 0) close(log_fd);
+    log_fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
         // print error to stderr if file opening fails
         fprintf(stderr, "ERROR: Failed to open log file\n");
-        return;
+        return 0;
     }
+    if (fstat(log_fd, &st) == 0) log_ino = st.st_ino;
+    return 1;
+}
 
-    // get current time
-    time_t now = time(NULL);
-    if (now == (time_t)-1) {
-        // log error if time retrieval fails
-        fprintf(fp, "[ERROR: Failed to get time] ");
-    } else {
-        // Buffer to store formatted time
-        char time_buf[64]; // Larger buffer for safety
-        // Convert time to local time
-        struct tm *tm_info = localtime(&now);
-        if (tm_info) {
+// append "[Day Mon DD HH:MM:SS YYYY] " for t to buf; the formatted second is cached
+static size_t format_time(char *buf, time_t t) {
+    static time_t cached_time = (time_t)-1;
+    static char cached[64];
+    static size_t cached_len;
+    if (t != cached_time) {
+        struct tm tm_info;
+        if (t == (time_t)-1) {
+            // log error if time retrieval fails
+            cached_len = snprintf(cached, sizeof(cached), "[ERROR: Failed to get time] ");
+        } else if (localtime_r(&t, &tm_info)) {
             // Format time as "[Day Mon DD HH:MM:SS YYYY]"
-            strftime(time_buf, sizeof(time_buf), "[%a %b %d %H:%M:%S %Y]", tm_info);
-            fprintf(fp, "%s ", time_buf);
+            cached_len = strftime(cached, sizeof(cached), "[%a %b %d %H:%M:%S %Y] ", &tm_info);
         } else {
-            fprintf(fp, "[ERROR: Failed to format time] "); // log error
+            cached_len = snprintf(cached, sizeof(cached), "[ERROR: Failed to format time] "); // log error
         }
+        cached_time = t;
     }
+    memcpy(buf, cached, cached_len);
+    return cached_len;
+}
 
+// write every complete message in the ring to the file, in batches
+static void drain() {
+    static char batch[LOG_BATCH_SIZE];
+    size_t used = 0;
+    pthread_mutex_lock(&flush_lock);
+    // nothing to write: leave the file alone
+    if (atomic_load(&dropped) == 0 &&
+        atomic_load_explicit(&ring[head % LOG_RING_SLOTS].seq, memory_order_acquire) != head + 1) {
+        pthread_mutex_unlock(&flush_lock);
+        return;
+    }
+    if (!open_log()) {
+        pthread_mutex_unlock(&flush_lock);
+        return;
+    }
+    int lost = atomic_exchange(&dropped, 0);
+    if (lost > 0) {
+        used += format_time(batch, time(NULL));
+        used += snprintf(batch + used, sizeof(batch) - used, "WARNING: %d log messages dropped, logging faster than the disk\n", lost);
+    }
+    while (1) {
+        LogSlot *slot = &ring[head % LOG_RING_SLOTS];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != head + 1) break;   // not written yet
+        size_t len = strlen(slot->text);
+        if (used + 64 + len + 1 > sizeof(batch)) {
+            write_all(batch, used);
+            used = 0;
+        }
+        used += format_time(batch + used, slot->time);
+        memcpy(batch + used, slot->text, len);
+        used += len;
+        batch[used++] = '\n';
+        // hand the slot back to the producers one lap later
+        atomic_store_explicit(&slot->seq, head + LOG_RING_SLOTS, memory_order_release);
+        head++;
+    }
+    if (used > 0) write_all(batch, used);
+    pthread_mutex_unlock(&flush_lock);
+}
+
+// flusher thread: drain the ring every LOG_FLUSH_MS, or sooner when it fills up
+static void *flusher(void *arg) {
+    while (1) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += LOG_FLUSH_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_mutex_lock(&wake_lock);
+        pthread_cond_timedwait(&wake, &wake_lock, &until);
+        pthread_mutex_unlock(&wake_lock);
+        drain();
+    }
+    return NULL;
+}
+
+static void start_flusher() {
+    for (size_t i = 0; i < LOG_RING_SLOTS; i++) atomic_init(&ring[i].seq, i);
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    threaded = pthread_create(&thread, &attr, flusher, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!threaded) fprintf(stderr, "ERROR: Failed to start log flusher, logging synchronously\n");
+    // whatever is still in the ring when the process exits normally
+    atexit(log_flush);
+}
+
+// log messages to a file with a timestamp
+void log_message(const char *format, ...) {
+    pthread_once(&start_once, start_flusher);
+
+    // claim a slot: the one at tail is ours if its sequence says it is free for this lap
+    size_t pos = atomic_load_explicit(&tail, memory_order_relaxed);
+    LogSlot *slot;
+    while (1) {
+        slot = &ring[pos % LOG_RING_SLOTS];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // full: the flusher is a whole ring behind
+            atomic_fetch_add(&dropped, 1);
+            pthread_cond_signal(&wake);
+            return;
+        } else {
+            pos = atomic_load_explicit(&tail, memory_order_relaxed);
+        }
+    }
+
+    slot->time = time(NULL);
     // variable arguments for flexible message formatting
     va_list args;
     va_start(args, format); // Initialize variable argument list
-    vfprintf(fp, format, args); // Write formatted message to log file
+    int len = vsnprintf(slot->text, sizeof(slot->text), format, args);
     va_end(args); // Clean up variable argument list
+    if (len >= (int)sizeof(slot->text)) memcpy(slot->text + sizeof(slot->text) - 4, "...", 4);
+    else if (len < 0) strcpy(slot->text, "ERROR: Failed to format log message");
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    // wake the flusher early every half ring, so a burst does not wait out LOG_FLUSH_MS and overflow
+    if (!threaded) drain();
+    else if (pos % (LOG_RING_SLOTS / 2) == LOG_RING_SLOTS / 2 - 1) pthread_cond_signal(&wake);
+}
+
+void log_flush() {
+    drain();
+}
 
-    fprintf(fp, "\n");
-    fclose(fp);
-}
\ No newline at end of file
+void logger_set_path(const char *path) {
+    // what was logged before goes to the old file
+    drain();
+    pthread_mutex_lock(&flush_lock);
+    snprintf(log_path, sizeof(log_path), "%s", path);
+    if (log_fd >= 0) close(log_fd);
+    log_fd = -1;
+    pthread_mutex_unlock(&flush_lock);
+}
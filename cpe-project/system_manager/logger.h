@@ -5,6 +5,22 @@
 
 #include <stdarg.h>
 
+// messages waiting for the flusher thread; when the ring is full new messages are dropped and counted
+#define LOG_RING_SLOTS 128
+// longest message, timestamp excluded; longer ones are cut and end in "..."
+#define LOG_RECORD_SIZE 1536
+// a message reaches the file at most this long after log_message returns
+#define LOG_FLUSH_MS 500
+
+// format a message into the log ring and return without touching the file. A background thread,
+// started by the first call, writes the ring to the log file with a timestamp per line.
+// Safe to call from any thread
 void log_message(const char *format, ...);
 
-#endif
\ No newline at end of file
+// write every message logged so far before returning
+void log_flush();
+
+// write the log to path instead of logs/system_manager.log from now on (tests use a scratch file)
+void logger_set_path(const char *path);
+
+#endif
@@ -1,23 +1,263 @@
-#include "metrics.h"        // collect_metrics() and Metrics struct
+#include "metrics.h"        // built-in collectors (metrics_init())
+#include "metric_registry.h" // metric table and collector scheduling
 #include "config.h"         // load_thresholds() and Thresholds struct
 #include "alarm.h"          // check_alarms()
-#include "device_agent_client.h"  // send_metrics_to_agent()
-#include "http_client.h"    // send_http() (used in alarm.c)
+#include "device_agent_client.h"  // send_metric_summary_to_agent()
+#include "alarm_queue.h"    // non-blocking alarm posts to the Cloud Manager
+#include "alarm_spool.h"    // undeliverable alarms kept on disk for replay
 #include "logger.h"         // log_message()
-#include <unistd.h>         // sleep()
+#include "link_monitor.h"   // rtnetlink interface table and link events
+#include "metric_window.h"  // per-metric sample rings and window summaries
+#include "metric_trend.h"   // streaming ewma/slope metrics
+#include "mount_monitor.h"  // per-mount disk usage
+#include "psi_monitor.h"    // kernel pressure stall triggers
+#include "cgroup_monitor.h" // per-service cgroup v2 metrics
+#include "host_paths.h"     // procfs/sysfs roots
+#include <unistd.h>         // usleep()
 #include <sys/stat.h>       // stat() to check file changes
 #include <time.h>           // time_t in stat
 #include <stdio.h>
+#include <string.h>         // strerror()
+#include <errno.h>
+#include <poll.h>           // poll() on event sources between samples
 
 // global variable to hold threshold values (memory, cpu, etc.) loaded from config file.
 // gets updated when thresholds.conf changes.
 static Thresholds thresholds;
+// alarm rules compiled from thresholds, rebuilt on every reload
+static AlarmRuleSet alarm_rules;
+
+// samples of the current reporting window and its summary
+static MetricsWindow window;
+static MetricSummary summary[MAX_METRICS];
+
+// log per-core utilisation as "cpuN=usage/iowait/steal" so a single pinned core is visible
+static void log_cpu_cores() {
+    const CpuStats *cs = get_cpu_stats();
+    char line[1024];
+    size_t used = 0;
+    for (int i = 1; i <= cs->count; i++) {
+        int n = snprintf(line + used, sizeof(line) - used, "%scpu%d=%.1f/%.1f/%.1f",
+                         i > 1 ? " " : "", i - 1, cs->usage[i], cs->iowait[i], cs->steal[i]);
+        // flush when the line is full and continue on a new one
+        if (n < 0) break;
+        if ((size_t)n >= sizeof(line) - used && used > 0) {
+            line[used] = '\0';
+            log_message("INFO: Per-core cpu (usage/iowait/steal %%) - %s", line);
+            used = 0;
+            i--;
+            continue;
+        }
+        used += n;
+    }
+    if (used > 0) log_message("INFO: Per-core cpu (usage/iowait/steal %%) - %s", line);
+}
+
+// maximum number of file descriptors watched between samples
+#define MAX_EVENT_SOURCES 8
+// poll() entries: the event sources plus the sockets of alarm requests in flight
+#define MAX_POLL_FDS (MAX_EVENT_SOURCES + 8)
+
+// a file descriptor watched while waiting for the next sample
+typedef struct {
+    int fd;
+    short events;                   // poll events to wait for
+    void (*handler)(int fd, short revents); // called when any of them fire
+} EventSource;
+
+static EventSource sources[MAX_EVENT_SOURCES];
+static int n_sources = 0;
+
+// netlink socket of the link monitor, -1 when falling back to getifaddrs polling
+static int link_fd = -1;
+
+// monotonic clock in milliseconds
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// watch fd for events while waiting between samples
+static void add_event_source(int fd, short events, void (*handler)(int, short)) {
+    if (n_sources >= MAX_EVENT_SOURCES) {
+        log_message("ERROR: Too many event sources, fd %d not watched", fd);
+        return;
+    }
+    sources[n_sources].fd = fd;
+    sources[n_sources].events = events;
+    sources[n_sources].handler = handler;
+    n_sources++;
+}
+
+// stop watching fd
+static void remove_event_source(int fd) {
+    for (int i = 0; i < n_sources; i++) {
+        if (sources[i].fd == fd) {
+            sources[i] = sources[--n_sources];
+            return;
+        }
+    }
+}
+
+// called by the link monitor for every link up/down transition
+static void on_link_event(const char *ifname, int up) {
+    log_message("%s: Link %s is %s", up ? "INFO" : "ALARM", ifname, up ? "up" : "down");
+    send_link_alarm(ifname, up, now_ms());
+}
+
+// netlink socket readable: apply link/address notifications
+static void handle_link_events(int fd, short revents) {
+    if (link_monitor_process(on_link_event) < 0) {
+        // socket broke, fall back to polling getifaddrs
+        log_message("ERROR: Link monitor failed, falling back to interface polling");
+        remove_event_source(link_fd);
+        link_monitor_close();
+        link_fd = -1;
+    }
+}
+
+// mountinfo signalled POLLPRI: the mount table changed
+static void handle_mount_change(int fd, short revents) {
+    mount_monitor_reload();
+}
+
+// pressure trigger fired (POLLPRI) or its file went away (POLLERR). The handler samples the
+// resource, and its alarm rule raises, repeats and clears like any other
+static void handle_pressure(int fd, short revents) {
+    if (psi_monitor_handle(fd, revents, NULL) < 0) {
+        log_message("ERROR: Pressure trigger failed, falling back to sampled alarms");
+        remove_event_source(fd);
+    }
+}
+
+// (re-)register PSI triggers for the pressure thresholds and sample the resources their alarm
+// rules watch. Without PSI (old kernel or psi=0) the sampled cpu/memory alarms in check_alarms() still apply
+static void arm_pressure_triggers() {
+    float pct[PSI_RESOURCES] = { thresholds.cpu_pressure, thresholds.memory_pressure, thresholds.io_pressure };
+    int watched = 0;
+    for (int r = 0; r < PSI_RESOURCES; r++) {
+        int old_fd = psi_monitor_fd(r);
+        if (old_fd >= 0) {
+            remove_event_source(old_fd);
+            psi_monitor_close(r);
+        }
+        if (pct[r] <= 0) {
+            psi_monitor_unwatch(r);
+            continue;
+        }
+        if (psi_monitor_watch(r) == 0) watched++;
+        int fd = psi_monitor_open(r, pct[r]);
+        if (fd < 0) {
+            log_message("WARNING: No PSI trigger on %s (%s), relying on sampled alarms",
+                        psi_monitor_name(r), strerror(errno));
+            continue;
+        }
+        add_event_source(fd, POLLPRI, handle_pressure);
+    }
+    // sampled every second between triggers too, so an alarm clears once the stall is over
+    collector_unregister("pressure");
+    if (watched > 0) collector_register("pressure", psi_monitor_collect, 1000);
+}
+
+// wait timeout_ms before the next sample, handling events (link changes, mount changes, ...)
+// the moment they arrive instead of sleeping through them. Alarm requests progress in the same
+// poll(), so a slow Cloud Manager never delays the next sample
+static void wait_for_events(int timeout_ms) {
+    long long deadline = now_ms() + timeout_ms;
+    long long left;
+    struct pollfd pfds[MAX_POLL_FDS];
+    do {
+        left = deadline - now_ms();
+        if (left < 0) left = 0;
+        int n = n_sources;
+        for (int i = 0; i < n; i++) {
+            pfds[i].fd = sources[i].fd;
+            pfds[i].events = sources[i].events;
+            pfds[i].revents = 0;
+        }
+        int n_http = alarm_queue_pollfds(pfds + n, MAX_POLL_FDS - n);
+        int http_wait = alarm_queue_timeout();
+        if (http_wait >= 0 && http_wait < left) left = http_wait;
+        int ready = poll(pfds, n + n_http, (int)left);
+        // alarms just queued, sockets ready and HTTP timers
+        alarm_queue_run(pfds + n, n_http);
+        if (ready <= 0) continue;
+        // a handler may remove its source, so look each one up again by fd
+        for (int i = 0; i < n; i++) {
+            if (!pfds[i].revents) continue;
+            for (int j = 0; j < n_sources; j++) {
+                if (sources[j].fd == pfds[i].fd) {
+                    sources[j].handler(pfds[i].fd, pfds[i].revents);
+                    break;
+                }
+            }
+        }
+    } while (deadline > now_ms());
+}
 
 int main() {
     // load the initial thresholds from thresholds.conf at startup.
     // This sets up our limits for memory, cpu, disk, etc., which we’ll compare against metrics.
     thresholds = load_thresholds("config/thresholds.conf");
 
+    // load collector settings (sampling/reporting intervals, process counting mode, ...)
+    Settings settings = load_settings("config/system_manager.conf");
+    host_paths_set(settings.proc_root, settings.sys_root);
+    metrics_set_process_mode(settings.process_count_mode);
+    metrics_set_disk_devices(settings.disk_devices);
+
+    // alarms the Cloud Manager could not take survive on disk until it is back
+    if (settings.alarm_spool[0] && alarm_spool_open(settings.alarm_spool) < 0) {
+        log_message("WARNING: No alarm spool, undeliverable alarms will be dropped");
+    }
+
+    // alarms are posted without blocking from the wait between samples, so an unreachable
+    // Cloud Manager cannot stall sampling
+    if (alarm_queue_start("http://127.0.0.1:8082/alarm", settings.alarm_batch_ms) < 0) {
+        log_message("ERROR: Alarms will be queued but not sent");
+    }
+
+    // register the built-in metrics and collectors
+    metrics_init();
+
+    // subscribe to rtnetlink link/address notifications so interface counts and link
+    // up/down alarms are event driven. Without it get_network_interfaces() polls getifaddrs.
+    link_fd = link_monitor_open();
+    if (link_fd < 0) {
+        log_message("WARNING: Failed to open rtnetlink monitor, polling interfaces instead");
+    } else {
+        add_event_source(link_fd, POLLIN, handle_link_events);
+    }
+
+    // track usage of every real filesystem. The mount list is cached and re-read only when
+    // mountinfo signals a change; statvfs runs on a worker thread so a hung mount cannot stall us.
+    int mount_fd = mount_monitor_start();
+    if (mount_fd < 0) {
+        log_message("WARNING: Failed to start mount monitor, reporting root filesystem only");
+    } else {
+        add_event_source(mount_fd, POLLPRI, handle_mount_change);
+        log_message("INFO: Tracking disk usage of %d filesystems", mount_monitor_count());
+    }
+
+    // per-service cpu, memory, OOM kills and io from the configured cgroups
+    if (settings.cgroups[0]) {
+        log_message("INFO: Tracking %d cgroups", cgroup_monitor_start(settings.cgroups));
+    }
+
+    // turn the thresholds into the alarm rule table, once every built-in metric is registered
+    alarm_rules_compile(&thresholds, &alarm_rules);
+
+    // let the kernel report cpu/memory/io stalls the moment they cross the pressure thresholds
+    arm_pressure_triggers();
+
+    // apply collector interval overrides once every collector is registered
+    for (int i = 0; i < settings.n_intervals; i++) {
+        if (collector_set_interval(settings.intervals[i].name, settings.intervals[i].interval_ms) < 0) {
+            log_message("WARNING: Unknown collector %s in interval settings", settings.intervals[i].name);
+        }
+    }
+
     // log that the program has started. This goes to whatever logging system logger.h defines
     // It’s just a way to confirm the program is running.
     log_message("System Manager started.");
@@ -36,75 +276,103 @@ int main() {
         last_modified = config_stat.st_mtime;
     }
 
-    // how often we send metrics to the Device Agent and log them (every 10 seconds).
-    // interval controls the frequency, and elapsed tracks how many seconds have passed.
-    int interval = 10; // send and log metrics every 10 seconds
-    int elapsed = 0;   // counter for elapsed seconds
+    // sampling and reporting schedule. Every sample_interval_ms the due collectors run and their
+    // values are collected into per-metric rings; every report_interval seconds the window is summarized
+    // (min/max/mean/p95), logged and sent to the Device Agent. Config reload and alarm checks
+    // keep running once per second whatever the sampling rate is.
+    int sample_ms = settings.sample_interval_ms;
+    long long report_ms = settings.report_interval * 1000LL;
+    if (report_ms / sample_ms > WINDOW_CAPACITY) {
+        log_message("WARNING: %lld samples per report exceed the window capacity (%d), only the latest are summarized",
+                    report_ms / sample_ms, WINDOW_CAPACITY);
+    }
+    long long next_sample = now_ms();
+    long long next_check = next_sample;
+    long long next_report = next_sample + report_ms;
 
     // main loop runs forever, monitoring the system in real-time.
-    // each iteration takes about 1 second (due to sleep at the end).
+    // each iteration takes one sample interval (the wait at the end).
     while (1) {
-        // check if thresholds.conf has changed by getting its current metadata.
-        // If stat fails (e.g., file deleted), log an error but keep running.
-        if (stat("config/thresholds.conf", &config_stat) != 0) {
-            log_message("ERROR: Failed to stat thresholds.conf");
-            printf("ERROR: Failed to stat thresholds.conf");
-        }
-        // If the file’s modification time (st_mtime) is different from last_modified,
-        // it means the file was edited or replaced. Reload thresholds and update last_modified.
-        else if (config_stat.st_mtime != last_modified) {
-            log_message("Detected config file change. Reloading...");
-            thresholds = load_thresholds("config/thresholds.conf");
-            last_modified = config_stat.st_mtime;
-        }       
-
-        // collect system metrics (memory, cpu, disk, etc.) using collect_metrics().
-        // This reads from /proc, statvfs, etc., and returns a Metrics struct.
-        Metrics m = collect_metrics();
-
-        // validate the metrics to make sure they’re reasonable.
-        // If any metric is negative (indicating an error in collection), log the issue
-        // and skip this iteration. This prevents bad data from triggering alarms or being sent.
-        if (m.memory < 0 || m.cpu < 0 || m.disk < 0 || m.uptime < 0 || m.net_interfaces < 0 || m.processes < 0) {
-            log_message("ERROR: Invalid metrics collected - memory: %.1f, cpu: %.1f, disk: %.1f, uptime: %.1f, net_interfaces: %d, processes: %d",
-                        m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-            sleep(1); // Wait 1 second before trying again
-            continue; // Skip the rest of the loop
+        long long now = now_ms();
+        int check_due = now >= next_check;
+
+        if (check_due) {
+            // check if thresholds.conf has changed by getting its current metadata.
+            // If stat fails (e.g., file deleted), log an error but keep running.
+            if (stat("config/thresholds.conf", &config_stat) != 0) {
+                log_message("ERROR: Failed to stat thresholds.conf");
+                printf("ERROR: Failed to stat thresholds.conf");
+            }
+            // If the file’s modification time (st_mtime) is different from last_modified,
+            // it means the file was edited or replaced. Reload thresholds and update last_modified.
+            else if (config_stat.st_mtime != last_modified) {
+                log_message("Detected config file change. Reloading...");
+                thresholds = load_thresholds("config/thresholds.conf");
+                last_modified = config_stat.st_mtime;
+                alarm_rules_compile(&thresholds, &alarm_rules);
+                arm_pressure_triggers();
+            }
+            // link changes held back while a port flaps
+            send_held_link_alarms(now);
+            next_check += 1000;
+            if (next_check <= now) next_check = now + 1000; // don't try to catch up after a stall
         }
 
+        // run the collectors that are due this tick (memory, cpu, disk, etc.).
+        // Each collector writes its values into the metric table; a collector that fails marks its
+        // metrics invalid, which keeps bad data out of the window and the alarm checks.
+        run_collectors(next_sample);
+        // ewma and slope of the metrics the alarm rules watch for trends
+        trends_update(next_sample);
+        window_add_updated(&window);
+
         // Check if any metrics exceed thresholds (e.g., memory > 80%).
-        // check_alarms() compares Metrics to Thresholds and, if breached, sends an HTTP POST
-        // to the Cloud CLI (handled inside alarm.c). It returns 1 if an alarm was triggered.
-        if (check_alarms(m, thresholds)) {
+        // check_alarms() evaluates the alarm rules against the metric table and sends an HTTP POST to the
+        // Cloud CLI when an alarm is raised, repeated or cleared (handled inside alarm.c). Rules are debounced
+        // and re-notified per thresholds.conf, so a steady breach is not reported every second.
+        // It returns 1 if an alarm was raised or repeated.
+        if (check_due && check_alarms(&alarm_rules, now)) {
             // Log the alarm with full metrics for debugging.
-            log_message("ALARM: Threshold breached! Metrics - memory: %.1f%%, cpu: %.1f%%, disk: %.1f%%, uptime: %.1f seconds, net_interfaces: %d, processes: %d",
-                        m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
+            log_message("ALARM: Threshold breached! Metrics - memory: %.1f%%, cpu: %.1f%%, disk: %.1f%%, uptime: %.1f seconds, net_interfaces: %.0f, processes: %.0f",
+                        metric_value(METRIC_MEMORY), metric_value(METRIC_CPU), metric_value(METRIC_DISK),
+                        metric_value(METRIC_UPTIME), metric_value(METRIC_NET_INTERFACES), metric_value(METRIC_PROCESSES));
         }
 
-        // Every 10 seconds, log metrics and send them to the Device Agent.
-        // elapsed counts seconds, and when it hits interval (10), we perform these actions.
-        if (elapsed >= interval) {
-            // Log the current metrics to keep a record of system state.
-            log_message("INFO: Collected metrics - memory: %.1f%%, cpu: %.1f%%, disk: %.1f%%, uptime: %.1f seconds, net_interfaces: %d, processes: %d",
-                        m.memory, m.cpu, m.disk, m.uptime, m.net_interfaces, m.processes);
-
-            // Send metrics to the Device Agent via UNIX socket.
-            // send_metrics_to_agent() formats metrics as a string, sends it, and waits for an ACK.
-            // If it fails (no ACK or connection error), log an error. If it succeeds, log success.
-            if (!send_metrics_to_agent(m)) {
-                log_message("ERROR: Failed to send metrics, no ACK received.");
-                printf("ERROR: Failed to send metrics \n");
-            } else {
-                log_message("INFO: Metrics sent and ACK received.");
+        // Every report interval, summarize the window, log it and send it to the Device Agent.
+        if (now >= next_report) {
+            window_summarize(&window, summary);
+
+            if (summary[METRIC_CPU].count > 0) {
+                // Log the window summary to keep a record of system state.
+                log_message("INFO: Collected metrics (%d samples) - memory: %.1f%% (max %.1f%%), cpu: %.1f%% (max %.1f%%, p95 %.1f%%, iowait %.1f%%, steal %.1f%%, busiest core max %.1f%%), disk: %.1f%%, uptime: %.1f seconds, net_interfaces: %.0f, processes: %.0f",
+                            summary[METRIC_CPU].count, summary[METRIC_MEMORY].mean, summary[METRIC_MEMORY].max,
+                            summary[METRIC_CPU].mean, summary[METRIC_CPU].max, summary[METRIC_CPU].p95,
+                            summary[METRIC_CPU_IOWAIT].mean, summary[METRIC_CPU_STEAL].mean, summary[METRIC_CPU_MAX_CORE].max,
+                            metric_value(METRIC_DISK), metric_value(METRIC_UPTIME),
+                            metric_value(METRIC_NET_INTERFACES), metric_value(METRIC_PROCESSES));
+                log_cpu_cores();
+
+                // Send the summary to the Device Agent via UNIX socket.
+                // send_metric_summary_to_agent() formats it as a string, sends it, and waits for an ACK.
+                // If it fails (no ACK or connection error), log an error. If it succeeds, log success.
+                if (!send_metric_summary_to_agent(summary)) {
+                    log_message("ERROR: Failed to send metrics, no ACK received.");
+                    printf("ERROR: Failed to send metrics \n");
+                } else {
+                    log_message("INFO: Metrics sent and ACK received.");
+                }
             }
-            elapsed = 0; // reset the counter to start counting to 10 again
+            window_reset(&window); // start the next window
+            next_report += report_ms;
+            if (next_report <= now) next_report = now + report_ms;
         }
 
-        // increment elapsed to track time since last metric send/log.
-        elapsed++;
-        // Sleep for 1 second to keep the loop running at 1second intervals.
-        // This ensures real-time monitoring without overloading the CPU.
-        sleep(1);
+        // Wait until the next sample is due, keeping a fixed cadence.
+        // Link, mount and pressure events are still handled immediately while waiting.
+        next_sample += sample_ms;
+        now = now_ms();
+        if (next_sample <= now) next_sample = now + sample_ms; // overran, skip missed samples
+        wait_for_events((int)(next_sample - now));
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+// metric table and collector scheduling
+
+#include "metric_registry.h"
+#include "logger.h"
+#include <string.h>
+
+// one registered collector
+typedef struct {
+    char name[METRIC_NAME_LEN];
+    collector_fn fn;
+    int interval_ms;        // 0 = run on every sample
+    long long last_run;     // monotonic ms of the last run
+    int has_run;            // 0 until the first run
+} Collector;
+
+// metric table, values and flags are kept in separate arrays so passes over them stay dense
+static char names[MAX_METRICS][METRIC_NAME_LEN];
+static double values[MAX_METRICS];
+static unsigned char valid[MAX_METRICS];
+static unsigned int stamp[MAX_METRICS];     // round in which the metric was last set
+static int refs[MAX_METRICS];               // metric_register calls not released yet, 0 = free id
+static unsigned int generation[MAX_METRICS];
+static int n_metrics = 0;
+static unsigned int round_id = 1;
+
+static Collector collectors[MAX_COLLECTORS];
+static int n_collectors = 0;
+
+int metric_find(const char *name) {
+    for (int i = 0; i < n_metrics; i++)
+        if (refs[i] > 0 && strcmp(names[i], name) == 0) return i;
+    return -1;
+}
+
+int metric_register(const char *name) {
+    int id = metric_find(name);
+    if (id >= 0) {
+        refs[id]++;
+        return id;
+    }
+    // reuse a released id before growing the table
+    for (int i = 0; i < n_metrics && id < 0; i++)
+        if (refs[i] == 0) id = i;
+    if ((id < 0 && n_metrics >= MAX_METRICS) || strlen(name) >= METRIC_NAME_LEN) {
+        log_message("ERROR: Cannot register metric %s (table full or name too long)", name);
+        return -1;
+    }
+    if (id < 0) id = n_metrics++;
+    strcpy(names[id], name);
+    refs[id] = 1;
+    values[id] = 0;
+    valid[id] = 0;
+    stamp[id] = 0;
+    return id;
+}
+
+void metric_release(int id) {
+    if (id < 0 || id >= n_metrics || refs[id] == 0) return;
+    // whoever still holds the id (an alarm rule) must not see the last value as current
+    valid[id] = 0;
+    metric_unref(id);
+}
+
+void metric_unref(int id) {
+    if (id < 0 || id >= n_metrics || refs[id] == 0 || --refs[id] > 0) return;
+    names[id][0] = '\0';
+    valid[id] = 0;
+    stamp[id] = 0;
+    generation[id]++;
+}
+
+unsigned int metric_generation(int id) {
+    return (id >= 0 && id < n_metrics) ? generation[id] : 0;
+}
+
+int metric_count() {
+    return n_metrics;
+}
+
+const char *metric_name(int id) {
+    return (id >= 0 && id < n_metrics) ? names[id] : "";
+}
+
+void metric_set(int id, double value) {
+    if (id < 0 || id >= n_metrics) return;
+    values[id] = value;
+    valid[id] = 1;
+    stamp[id] = round_id;
+}
+
+void metric_invalidate(int id) {
+    if (id < 0 || id >= n_metrics) return;
+    valid[id] = 0;
+}
+
+double metric_value(int id) {
+    return (id >= 0 && id < n_metrics) ? values[id] : 0;
+}
+
+int metric_valid(int id) {
+    return id >= 0 && id < n_metrics && valid[id];
+}
+
+int metric_updated(int id) {
+    return id >= 0 && id < n_metrics && valid[id] && stamp[id] == round_id;
+}
+
+int metric_published(int id) {
+    return id >= 0 && id < n_metrics && stamp[id] != 0;
+}
+
+const double *metric_values() {
+    return values;
+}
+
+const unsigned char *metric_valid_flags() {
+    return valid;
+}
+
+int collector_register(const char *name, collector_fn fn, int interval_ms) {
+    if (n_collectors >= MAX_COLLECTORS || strlen(name) >= METRIC_NAME_LEN) {
+        log_message("ERROR: Cannot register collector %s", name);
+        return -1;
+    }
+    Collector *c = &collectors[n_collectors++];
+    strcpy(c->name, name);
+    c->fn = fn;
+    c->interval_ms = interval_ms;
+    c->has_run = 0;
+    return 0;
+}
+
+int collector_unregister(const char *name) {
+    for (int i = 0; i < n_collectors; i++) {
+        if (strcmp(collectors[i].name, name) == 0) {
+            memmove(&collectors[i], &collectors[i + 1], (n_collectors - i - 1) * sizeof(Collector));
+            n_collectors--;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int collector_set_interval(const char *name, int interval_ms) {
+    for (int i = 0; i < n_collectors; i++) {
+        if (strcmp(collectors[i].name, name) == 0) {
+            collectors[i].interval_ms = interval_ms;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int run_collectors(long long now_ms) {
+    int failed = 0;
+    round_id++;
+    for (int i = 0; i < n_collectors; i++) {
+        Collector *c = &collectors[i];
+        if (c->has_run && now_ms - c->last_run < c->interval_ms) continue;
+        c->has_run = 1;
+        c->last_run = now_ms;
+        if (c->fn() < 0) {
+            log_message("ERROR: Collector %s failed", c->name);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+void collectors_reset_schedule() {
+    for (int i = 0; i < n_collectors; i++) collectors[i].has_run = 0;
+}
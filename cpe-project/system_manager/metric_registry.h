@@ -0,0 +1,75 @@
+// header file for metric_registry.c : metric table and collector scheduling
+
+#ifndef METRIC_REGISTRY_H
+#define METRIC_REGISTRY_H
+
+// capacity of the metric table and of the collector registry
+#define MAX_METRICS 256
+#define MAX_COLLECTORS 32
+// longest metric or collector name, including the terminator
+#define METRIC_NAME_LEN 48
+
+// built-in metric ids, registered by metrics_init() in this order so they are stable
+enum {
+    METRIC_MEMORY,          // memory usage (%)
+    METRIC_CPU,             // cpu utilisation (%)
+    METRIC_CPU_IOWAIT,      // cpu time waiting for I/O (%)
+    METRIC_CPU_STEAL,       // cpu time stolen by the hypervisor (%)
+    METRIC_CPU_MAX_CORE,    // utilisation of the busiest core (%)
+    METRIC_UPTIME,          // seconds since boot
+    METRIC_DISK,            // root filesystem usage (%)
+    METRIC_NET_INTERFACES,  // interfaces with an address
+    METRIC_PROCESSES,       // process/task count
+    METRIC_BUILTIN_COUNT
+};
+
+// a collector updates its metrics with metric_set() and returns 0, or -1 on failure
+typedef int (*collector_fn)();
+
+// register a metric by name, returns its id (the existing id if already registered) or -1 if full.
+// every call holds a reference on the id: it keeps naming this metric until released as often
+int metric_register(const char *name);
+// drop a reference taken by metric_register and mark the metric invalid; the last reference
+// frees the id for another metric.
+// collectors of devices that come and go release their ids, so the table does not fill up
+void metric_release(int id);
+// drop a reference held by a reader of the metric (an alarm rule), leaving the value to its
+// collector; the last reference frees the id as metric_release does
+void metric_unref(int id);
+// changes whenever an id is released, so per-id state kept elsewhere can tell it is stale
+unsigned int metric_generation(int id);
+// look up a metric id by name, -1 if unknown
+int metric_find(const char *name);
+// number of registered metrics; ids are 0..metric_count()-1, released ones included
+int metric_count();
+// "" for a released id
+const char *metric_name(int id);
+
+// store a fresh value for a metric and mark it valid and updated in the current round
+void metric_set(int id, double value);
+// mark a metric as unusable (its collector failed)
+void metric_invalidate(int id);
+double metric_value(int id);
+int metric_valid(int id);
+// 1 if the metric was set during the last run_collectors() round
+int metric_updated(int id);
+// 1 once the metric has been set at all, even if it is invalid now
+int metric_published(int id);
+// the value and valid arrays indexed by metric id, for dense passes over many metrics
+const double *metric_values();
+const unsigned char *metric_valid_flags();
+
+// register a collector; interval_ms 0 means "every sample"
+int collector_register(const char *name, collector_fn fn, int interval_ms);
+// remove a collector (e.g. to replace a built-in one), returns -1 if the name is unknown
+int collector_unregister(const char *name);
+// change the interval of a registered collector, returns -1 if the name is unknown
+int collector_set_interval(const char *name, int interval_ms);
+// run every collector that is due at now_ms. Pass the scheduled tick time rather than the
+// wake-up time so intervals stay exact multiples of the sample interval.
+// returns the number of collectors that failed
+int run_collectors(long long now_ms);
+// force every collector to run in the next round
+void collectors_reset_schedule();
+
+#endif
@@ -0,0 +1,111 @@
+// streaming ewma and slope per metric, fixed state and O(1) per sample
+
+#include "metric_trend.h"
+#include "metric_registry.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+
+// trend state of one source metric
+typedef struct {
+    int source;             // metric the statistics are computed on
+    int ewma_id;            // <source>.ewma, -1 if not tracked
+    int slope_id;           // <source>.slope, -1 if not tracked
+    int primed;             // 0 until the first sample
+    long long last_ms;      // tick of the last sample
+    double level;           // ewma of the value
+    double slope;           // ewma of d(level)/dt, per minute
+} Trend;
+
+static Trend trends[MAX_TRENDS];
+static int n_trends = 0;
+
+// 1 if name ends with suffix
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name), s = strlen(suffix);
+    return n > s && strcmp(name + n - s, suffix) == 0;
+}
+
+int trend_register(const char *name) {
+    int slope = has_suffix(name, ".slope");
+    if (!slope && !has_suffix(name, ".ewma")) return -1;
+
+    char source_name[METRIC_NAME_LEN];
+    size_t len = strlen(name) - (slope ? 6 : 5);
+    if (len >= sizeof(source_name)) return -1;
+    memcpy(source_name, name, len);
+    source_name[len] = '\0';
+    // the source may not be published yet (an interface that is still down)
+    int source = metric_register(source_name);
+    int id = metric_register(name);
+    if (source < 0 || id < 0) return -1;
+
+    Trend *t = NULL;
+    for (int i = 0; i < n_trends; i++)
+        if (trends[i].source == source) t = &trends[i];
+    if (!t) {
+        if (n_trends >= MAX_TRENDS) {
+            log_message("WARNING: Too many trend metrics, ignoring %s", name);
+            return -1;
+        }
+        t = &trends[n_trends++];
+        memset(t, 0, sizeof(*t));
+        t->source = source;
+        t->ewma_id = -1;
+        t->slope_id = -1;
+    }
+    if (slope) t->slope_id = id;
+    else t->ewma_id = id;
+    return id;
+}
+
+int trend_release(int id) {
+    for (int i = 0; i < n_trends; i++) {
+        Trend *t = &trends[i];
+        if (id < 0 || (t->ewma_id != id && t->slope_id != id)) continue;
+        metric_unref(t->source);
+        metric_unref(id);
+        // still registered by someone else
+        if (metric_name(id)[0]) return 0;
+        if (t->ewma_id == id) t->ewma_id = -1;
+        else t->slope_id = -1;
+        if (t->ewma_id < 0 && t->slope_id < 0) *t = trends[--n_trends];
+        return 0;
+    }
+    return -1;
+}
+
+void trends_update(long long now_ms) {
+    for (int i = 0; i < n_trends; i++) {
+        Trend *t = &trends[i];
+        if (!metric_valid(t->source)) {
+            // start over when the source comes back rather than bridging the gap
+            t->primed = 0;
+            metric_invalidate(t->ewma_id);
+            metric_invalidate(t->slope_id);
+            continue;
+        }
+        if (!metric_updated(t->source)) continue;
+        double v = metric_value(t->source);
+        if (!t->primed) {
+            t->primed = 1;
+            t->last_ms = now_ms;
+            t->level = v;
+            t->slope = 0;
+            // a slope needs two samples
+            if (t->ewma_id >= 0) metric_set(t->ewma_id, v);
+            continue;
+        }
+        long long dt = now_ms - t->last_ms;
+        if (dt <= 0) continue;
+        t->last_ms = now_ms;
+        // first-order smoothing for irregular sampling: the weight of a sample grows with the
+        // time since the previous one, so collectors on any interval give the same time constants
+        double prev = t->level;
+        t->level += (v - t->level) * dt / (TREND_EWMA_TAU_MS + dt);
+        double rate = (t->level - prev) * 60000.0 / dt;
+        t->slope += (rate - t->slope) * dt / (TREND_SLOPE_TAU_MS + dt);
+        if (t->ewma_id >= 0) metric_set(t->ewma_id, t->level);
+        if (t->slope_id >= 0) metric_set(t->slope_id, t->slope);
+    }
+}
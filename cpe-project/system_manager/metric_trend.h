@@ -0,0 +1,28 @@
+// header file for metric_trend.c : streaming trend statistics published as metrics
+
+#ifndef METRIC_TREND_H
+#define METRIC_TREND_H
+
+// metrics with trend statistics
+#define MAX_TRENDS 32
+// time constant of <metric>.ewma
+#define TREND_EWMA_TAU_MS 60000
+// time constant of <metric>.slope: the rate of change is averaged over about 5 minutes
+#define TREND_SLOPE_TAU_MS 300000
+
+// track a derived metric by name: "<metric>.ewma" (exponentially weighted moving average) or
+// "<metric>.slope" (rate of change of the average, in units per minute). Both are registered
+// in the metric table, so thresholds and reports use them like any other metric.
+// returns the id of the derived metric, or -1 if name is not a trend name or the tables are full
+int trend_register(const char *name);
+
+// drop the references a trend_register call that returned id took on the trend and its source
+// (see metric_unref); the trend stops being tracked once its metric is freed.
+// returns -1 if id is not a trend metric
+int trend_release(int id);
+
+// advance every trend whose source metric was set in the last collector round, in O(1) per
+// metric and without allocation. Call after run_collectors() with the same tick time
+void trends_update(long long now_ms);
+
+#endif
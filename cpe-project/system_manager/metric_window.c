@@ -0,0 +1,93 @@
+// windowed aggregation of high-frequency samples
+
+#include "metric_window.h"
+#include <string.h>
+
+// scratch copy for the percentile selection, so the ring itself stays in arrival order
+static float scratch[WINDOW_CAPACITY];
+
+void ring_add(MetricRing *r, float value) {
+    r->samples[r->next] = value;
+    r->next = (r->next + 1) % WINDOW_CAPACITY;
+    if (r->count < WINDOW_CAPACITY) r->count++;
+}
+
+// return the k-th smallest value of a[0..n) (quickselect, reorders a)
+static float select_kth(float *a, int n, int k) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        float pivot = a[(lo + hi) / 2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) {
+                float t = a[i];
+                a[i] = a[j];
+                a[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return a[k];
+}
+
+int ring_summarize(const MetricRing *r, MetricSummary *out) {
+    memset(out, 0, sizeof(*out));
+    if (r->count == 0) return 0;
+
+    // the valid samples are always the first count slots until the ring wraps,
+    // after that every slot is valid, so order does not matter for the summary
+    float min = r->samples[0], max = r->samples[0];
+    double sum = 0;
+    for (int i = 0; i < r->count; i++) {
+        float v = r->samples[i];
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+        sum += v;
+    }
+    memcpy(scratch, r->samples, r->count * sizeof(float));
+    // nearest-rank 95th percentile
+    int rank = (r->count * 95 + 99) / 100 - 1;
+
+    out->count = r->count;
+    out->min = min;
+    out->max = max;
+    out->mean = (float)(sum / r->count);
+    out->p95 = select_kth(scratch, r->count, rank);
+    return 1;
+}
+
+void window_add_updated(MetricsWindow *w) {
+    int n = metric_count();
+    for (int id = 0; id < n; id++) {
+        if (!metric_updated(id)) continue;
+        MetricRing *r = &w->rings[id];
+        // the id was released and now names another metric: its samples start over
+        if (r->generation != metric_generation(id)) {
+            r->next = 0;
+            r->count = 0;
+            r->generation = metric_generation(id);
+        }
+        ring_add(r, (float)metric_value(id));
+    }
+}
+
+void window_summarize(const MetricsWindow *w, MetricSummary out[MAX_METRICS]) {
+    int n = metric_count();
+    for (int id = 0; id < n; id++) {
+        if (w->rings[id].generation == metric_generation(id)) ring_summarize(&w->rings[id], &out[id]);
+        else memset(&out[id], 0, sizeof(out[id]));
+    }
+}
+
+void window_reset(MetricsWindow *w) {
+    for (int id = 0; id < MAX_METRICS; id++) {
+        w->rings[id].next = 0;
+        w->rings[id].count = 0;
+    }
+}
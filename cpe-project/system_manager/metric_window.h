@@ -0,0 +1,50 @@
+// header file for metric_window.c : per-metric sample rings and window summaries
+
+#ifndef METRIC_WINDOW_H
+#define METRIC_WINDOW_H
+
+#include "metric_registry.h"
+
+// samples kept per metric and reporting window (25 s at 100 ms sampling)
+#define WINDOW_CAPACITY 256
+
+// summary of one metric over a window
+typedef struct {
+    int count;      // samples in the window
+    float min;
+    float max;
+    float mean;
+    float p95;
+} MetricSummary;
+
+// fixed-size ring of samples for one metric; when full the oldest sample is overwritten
+typedef struct {
+    float samples[WINDOW_CAPACITY];
+    int next;       // slot for the next sample
+    int count;      // valid samples, at most WINDOW_CAPACITY
+    unsigned int generation;    // metric_generation() of the id the samples belong to
+} MetricRing;
+
+// one ring per registered metric, indexed by metric id
+typedef struct {
+    MetricRing rings[MAX_METRICS];
+} MetricsWindow;
+
+// add one sample to a ring
+void ring_add(MetricRing *r, float value);
+
+// compute min/max/mean/p95 over the samples in a ring
+// returns 0 if the ring is empty
+int ring_summarize(const MetricRing *r, MetricSummary *out);
+
+// add every metric updated in the last collector round to the window
+void window_add_updated(MetricsWindow *w);
+
+// summarize every metric in the window, out is indexed by metric id. Samples of a released id
+// are left out
+void window_summarize(const MetricsWindow *w, MetricSummary out[MAX_METRICS]);
+
+// drop all samples, starting a new window
+void window_reset(MetricsWindow *w);
+
+#endif
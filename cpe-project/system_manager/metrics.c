@@ -1,19 +1,185 @@
+
 // Metric collection
 
 #include "metrics.h"
+#include "metric_registry.h"
+#include "link_monitor.h"
+#include "host_paths.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/statvfs.h>
+#include <sys/sysinfo.h>
 #include <dirent.h>
 #include <ifaddrs.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
+#include <fnmatch.h>
 
-// ccalculate memory usage percentage
-float get_memory_usage() {
+// size of the shared read buffer for /proc files (large enough for the cpu lines of /proc/stat
+// with MAX_CPUS cores, about 100 bytes each)
+#define PROC_BUF_SIZE 65536
+
+// active collector mode (see METRICS_MODE_* in metrics.h)
+static int collector_mode = METRICS_MODE_PREAD;
+
+// persistent descriptors for the pread collector, opened lazily on first use
+static int meminfo_fd = -1;
+static int stat_fd = -1;
+static int uptime_fd = -1;
+static int loadavg_fd = -1;
+static int netdev_fd = -1;
+static int diskstats_fd = -1;
+
+// active process counting mode (see PROCESS_COUNT_* in metrics.h)
+static int process_mode = PROCESS_COUNT_FAST;
+
+// reused read buffer so the pread collector never allocates
+static char proc_buf[PROC_BUF_SIZE];
+
+// previous CPU usage values for delta calculation (stdio collector)
+static long long prev_total = 0, prev_idle = 0;
+
+// per-slot cpu counters for the pread collector: slot 0 is the aggregate "cpu" line and
+// slot i+1 the i-th "cpuN" line. Kept as flat arrays so the delta math runs over contiguous memory
+#define CPU_SLOTS (MAX_CPUS + 1)
+static unsigned long long cpu_total[CPU_SLOTS], cpu_idle[CPU_SLOTS], cpu_iowait[CPU_SLOTS], cpu_steal[CPU_SLOTS];
+static unsigned long long prev_cpu_total[CPU_SLOTS], prev_cpu_idle[CPU_SLOTS];
+static unsigned long long prev_cpu_iowait[CPU_SLOTS], prev_cpu_steal[CPU_SLOTS];
+// cpu number owning each slot (-1 = aggregate, -2 = never filled)
+static int cpu_id[CPU_SLOTS] = { [0 ... CPU_SLOTS - 1] = -2 };
+
+// last computed per-core breakdown
+static CpuStats cpu_stats;
+
+// per-interface counters from /proc/net/dev, in NETDEV_* order
+static const char *netdev_counter_names[NETDEV_COUNTERS] = {
+    "rx_bytes", "rx_packets", "rx_errors", "rx_drops",
+    "tx_bytes", "tx_packets", "tx_errors", "tx_drops"
+};
+
+// one interface seen in /proc/net/dev
+typedef struct {
+    char name[IFNAME_LEN];          // "" = free slot
+    int seen;                       // present in the latest read
+    int have_prev;                  // prev[] holds a reading to compute rates against
+    unsigned long long prev[NETDEV_COUNTERS];
+    int ids[NETDEV_COUNTERS];       // metric ids of the per-second rates
+} NetDev;
+
+static NetDev netdevs[MAX_NETDEVS];
+static long long netdev_prev_ms = 0;
+
+// per-device I/O statistics from /proc/diskstats, in DISKSTAT_* order
+static const char *diskstat_names[DISKSTAT_METRICS] = {
+    "read_iops", "write_iops", "read_bps", "write_bps", "queue_depth", "await_ms"
+};
+
+// counters of one /proc/diskstats line used for the rates
+enum { DS_READS, DS_READ_SECTORS, DS_READ_MS, DS_WRITES, DS_WRITE_SECTORS, DS_WRITE_MS, DS_WEIGHTED_MS, DS_COUNTERS };
+
+// one tracked block device
+typedef struct {
+    char name[DISK_NAME_LEN];       // "" = free slot
+    int seen;
+    int have_prev;
+    unsigned long long prev[DS_COUNTERS];
+    int ids[DISKSTAT_METRICS];
+} DiskDev;
+
+static DiskDev disks[MAX_DISKS];
+static long long diskstats_prev_ms = 0;
+
+// device include list: comma separated patterns (fnmatch syntax), split in place
+static char disk_patterns_buf[DISK_PATTERNS_LEN] = DISK_DEVICES_DEFAULT;
+static const char *disk_patterns[MAX_DISK_PATTERNS];
+static int n_disk_patterns = -1;        // -1 = not split yet
+
+// select how /proc files are read
+void metrics_set_mode(int mode) {
+    collector_mode = (mode == METRICS_MODE_STDIO) ? METRICS_MODE_STDIO : METRICS_MODE_PREAD;
+}
+
+// close the persistent /proc descriptors
+void metrics_cleanup() {
+    if (meminfo_fd >= 0) close(meminfo_fd);
+    if (stat_fd >= 0) close(stat_fd);
+    if (uptime_fd >= 0) close(uptime_fd);
+    if (loadavg_fd >= 0) close(loadavg_fd);
+    if (netdev_fd >= 0) close(netdev_fd);
+    if (diskstats_fd >= 0) close(diskstats_fd);
+    meminfo_fd = stat_fd = uptime_fd = loadavg_fd = netdev_fd = diskstats_fd = -1;
+}
+
+// read a whole /proc file (name relative to the proc root) into buf through a descriptor that
+// stays open between calls. procfs regenerates the content on every read at offset 0, so no
+// lseek/reopen is needed. returns number of bytes read (buf is NUL-terminated), or -1 on failure
+static ssize_t read_proc_file(int *fd, const char *name, char *buf, size_t size) {
+    if (*fd < 0) {
+        char path[HOST_ROOT_LEN + 32];
+        *fd = open(proc_path(path, sizeof(path), name), O_RDONLY | O_CLOEXEC);
+        if (*fd < 0) return -1;
+    }
+    ssize_t len = pread(*fd, buf, size - 1, 0);
+    if (len < 0) {
+        // descriptor went bad, drop it so the next call reopens
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// skip spaces and tabs
+static const char *skip_blanks(const char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+// parse an unsigned decimal number, returns pointer past the digits (or NULL if there are none)
+static const char *parse_ull(const char *p, unsigned long long *out) {
+    unsigned long long v = 0;
+    const char *start = p = skip_blanks(p);
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (unsigned long long)(*p - '0');
+        p++;
+    }
+    if (p == start) return NULL;
+    *out = v;
+    return p;
+}
+
+// advance to the first character of the next line
+static const char *next_line(const char *p) {
+    while (*p && *p != '\n') p++;
+    return *p ? p + 1 : p;
+}
+
+// monotonic clock in milliseconds, for rates computed from counter deltas
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// counter delta, allowing for 32-bit counters wrapping on older drivers. A wrap starts close to
+// 2^32 and moves less than half the range; any other step back is a reset (device re-created).
+// returns -1 on a reset: the caller takes cur as a fresh baseline
+static double counter_delta(unsigned long long cur, unsigned long long prev) {
+    if (cur >= prev) return (double)(cur - prev);
+    unsigned long long wrapped = cur + 0x100000000ULL - prev;
+    if (prev <= 0xffffffffULL && prev >= 0x80000000ULL && wrapped < 0x80000000ULL) return (double)wrapped;
+    return -1;
+}
+
+// ccalculate memory usage percentage (stdio collector)
+static float get_memory_usage_stdio() {
     // Open /proc/meminfo to read memory information
-    FILE *fp = fopen("/proc/meminfo", "r");
+    char path[HOST_ROOT_LEN + 32];
+    FILE *fp = fopen(proc_path(path, sizeof(path), "meminfo"), "r");
     if (!fp) return -1; // Return -1 if file cannot be opened
 
     char line[256];
@@ -30,23 +196,32 @@ float get_memory_usage() {
     return 100.0 * (1 - ((float)free / total));
 }
 
-// calculate CPU load percentage
-float get_cpu_load() {
-    // Static variables to store previous CPU usage values for delta calculation
-    static long long prev_total = 0, prev_idle = 0;
-    // Open /proc/stat to read CPU statistics
-    FILE *fp = fopen("/proc/stat", "r");
-    if (!fp) return -1.0; // Return -1 if file cannot be opened
+// calculate memory usage percentage (pread collector)
+static float get_memory_usage_pread() {
+    if (read_proc_file(&meminfo_fd, "meminfo", proc_buf, sizeof(proc_buf)) < 0) return -1;
 
-    long long user, nice, system, idle, iowait, irq, softirq;
-    // Read CPU usage data from first line
-    fscanf(fp, "cpu %lld %lld %lld %lld %lld %lld %lld", &user, &nice, &system, &idle, &iowait, &irq, &softirq);
-    fclose(fp);
+    unsigned long long total = 0, avail = 0;
+    int found = 0;
+    // walk the lines once, only looking at the two keys we need
+    for (const char *p = proc_buf; *p && found < 2; p = next_line(p)) {
+        if (p[0] != 'M' || p[1] != 'e' || p[2] != 'm') continue;
+        if (strncmp(p + 3, "Total:", 6) == 0) {
+            if (parse_ull(p + 9, &total)) found++;
+        } else if (strncmp(p + 3, "Available:", 10) == 0) {
+            if (parse_ull(p + 13, &avail)) found++;
+        }
+    }
+    if (total == 0) return -1;
+    return 100.0 * (1 - ((float)avail / total));
+}
 
-    // calculate total and idle CPU time
-    long long total = user + nice + system + idle + iowait + irq + softirq;
-    long long idle_total = idle + iowait;
+// calculate memory usage percentage
+float get_memory_usage() {
+    return collector_mode == METRICS_MODE_STDIO ? get_memory_usage_stdio() : get_memory_usage_pread();
+}
 
+// turn raw cpu counters into a load percentage using the previous reading (stdio collector)
+static float cpu_load_from_counters(long long total, long long idle_total) {
     // if this is the first reading, store values and return 0
     if (prev_total == 0) {
         prev_total = total;
@@ -66,19 +241,160 @@ float get_cpu_load() {
     return 100.0 * (total_diff - idle_diff) / total_diff;
 }
 
-// get system uptime in seconds
-float get_uptime() {
+// calculate CPU load percentage (stdio collector, aggregate line only)
+static float get_cpu_load_stdio() {
+    // Open /proc/stat to read CPU statistics
+    char path[HOST_ROOT_LEN + 32];
+    FILE *fp = fopen(proc_path(path, sizeof(path), "stat"), "r");
+    if (!fp) return -1.0; // Return -1 if file cannot be opened
+
+    long long user, nice, system, idle, iowait, irq, softirq;
+    // Read CPU usage data from first line
+    if (fscanf(fp, "cpu %lld %lld %lld %lld %lld %lld %lld", &user, &nice, &system, &idle, &iowait, &irq, &softirq) != 7) {
+        fclose(fp);
+        return -1.0;
+    }
+    fclose(fp);
+
+    // calculate total and idle CPU time
+    float load = cpu_load_from_counters(user + nice + system + idle + iowait + irq + softirq, idle + iowait);
+    // the legacy path has no per-core or iowait/steal breakdown
+    memset(&cpu_stats, 0, sizeof(cpu_stats));
+    cpu_stats.usage[0] = load;
+    return load;
+}
+
+// parse every "cpu"/"cpuN" line of /proc/stat in one pass into the current counter arrays.
+// returns the number of slots filled (aggregate + cores), or -1 on a malformed file
+static int parse_cpu_lines(const char *buf) {
+    int slots = 0;
+    const char *p = buf;
+    // the cpu lines are always the first lines of /proc/stat
+    while (slots < CPU_SLOTS && p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+        int id = -1;
+        const char *q = p + 3;
+        if (*q >= '0' && *q <= '9') {
+            unsigned long long n = 0;
+            // a digit follows, so parse_ull cannot fail here
+            q = parse_ull(q, &n);
+            id = (int)n;
+        }
+        // user nice system idle iowait irq softirq steal guest guest_nice
+        // (fields missing on older kernels read as 0)
+        unsigned long long v[10] = {0};
+        for (int i = 0; i < 10; i++) {
+            const char *r = parse_ull(q, &v[i]);
+            if (!r) break;
+            q = r;
+        }
+        if (slots == 0 && id != -1) return -1; // aggregate line must come first
+
+        // guest and guest_nice are already included in user and nice, so they are not added again
+        cpu_total[slots] = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        cpu_idle[slots] = v[3] + v[4];
+        cpu_iowait[slots] = v[4];
+        cpu_steal[slots] = v[7];
+        if (cpu_id[slots] != id) {
+            // new core or cores went offline/online: restart the delta for this slot
+            cpu_id[slots] = id;
+            prev_cpu_total[slots] = cpu_total[slots];
+            prev_cpu_idle[slots] = cpu_idle[slots];
+            prev_cpu_iowait[slots] = cpu_iowait[slots];
+            prev_cpu_steal[slots] = cpu_steal[slots];
+        }
+        slots++;
+        p = next_line(p);
+    }
+    return slots > 0 ? slots : -1;
+}
+
+// compute utilisation, iowait and steal percentages for every slot from the counter deltas.
+// the loop is branch-free over flat arrays so the compiler vectorizes it; per-interval deltas
+// always fit in 32 bits, which lets the int->float conversion use packed instructions too
+static void compute_cpu_deltas(int slots) {
+    for (int i = 0; i < slots; i++) {
+        float total = (float)(int)(cpu_total[i] - prev_cpu_total[i]);
+        float idle = (float)(int)(cpu_idle[i] - prev_cpu_idle[i]);
+        float iowait = (float)(int)(cpu_iowait[i] - prev_cpu_iowait[i]);
+        float steal = (float)(int)(cpu_steal[i] - prev_cpu_steal[i]);
+        float scale = total > 0.0f ? 100.0f / total : 0.0f;
+        cpu_stats.usage[i] = (total - idle) * scale;
+        cpu_stats.iowait[i] = iowait * scale;
+        cpu_stats.steal[i] = steal * scale;
+    }
+    memcpy(prev_cpu_total, cpu_total, slots * sizeof(cpu_total[0]));
+    memcpy(prev_cpu_idle, cpu_idle, slots * sizeof(cpu_idle[0]));
+    memcpy(prev_cpu_iowait, cpu_iowait, slots * sizeof(cpu_iowait[0]));
+    memcpy(prev_cpu_steal, cpu_steal, slots * sizeof(cpu_steal[0]));
+
+    // busiest single core, so one pinned core is visible on many-core boxes
+    float max_core = 0.0f;
+    for (int i = 1; i < slots; i++)
+        max_core = cpu_stats.usage[i] > max_core ? cpu_stats.usage[i] : max_core;
+    cpu_stats.max_core = max_core;
+    cpu_stats.count = slots - 1;
+}
+
+// calculate CPU load percentage (pread collector, all cpu lines and all fields)
+static float get_cpu_load_pread() {
+    if (read_proc_file(&stat_fd, "stat", proc_buf, sizeof(proc_buf)) < 0) return -1.0;
+
+    int slots = parse_cpu_lines(proc_buf);
+    if (slots < 0) return -1.0;
+    compute_cpu_deltas(slots);
+    return cpu_stats.usage[0];
+}
+
+// calculate CPU load percentage
+float get_cpu_load() {
+    return collector_mode == METRICS_MODE_STDIO ? get_cpu_load_stdio() : get_cpu_load_pread();
+}
+
+// per-core breakdown from the last get_cpu_load() call
+const CpuStats *get_cpu_stats() {
+    return &cpu_stats;
+}
+
+// get system uptime in seconds (stdio collector)
+static float get_uptime_stdio() {
     // Open /proc/uptime to read system uptime
-    FILE *fp = fopen("/proc/uptime", "r");
+    char path[HOST_ROOT_LEN + 32];
+    FILE *fp = fopen(proc_path(path, sizeof(path), "uptime"), "r");
     float uptime = 0.0;
     if (fp) {
         // Read uptime value
-        fscanf(fp, "%f", &uptime);
+        if (fscanf(fp, "%f", &uptime) != 1) uptime = 0.0;
         fclose(fp);
     }
     return uptime; // Return uptime in seconds
 }
 
+// get system uptime in seconds (pread collector)
+static float get_uptime_pread() {
+    if (read_proc_file(&uptime_fd, "uptime", proc_buf, sizeof(proc_buf)) < 0) return 0.0;
+
+    // "<seconds>.<hundredths> <idle>" - parse the first field by hand
+    unsigned long long secs = 0, frac = 0;
+    const char *p = parse_ull(proc_buf, &secs);
+    if (!p) return 0.0;
+    double uptime = (double)secs;
+    if (*p == '.') {
+        const char *f = p + 1;
+        const char *end = parse_ull(f, &frac);
+        if (end) {
+            double scale = 1.0;
+            for (const char *d = f; d < end; d++) scale *= 10.0;
+            uptime += frac / scale;
+        }
+    }
+    return (float)uptime;
+}
+
+// get system uptime in seconds
+float get_uptime() {
+    return collector_mode == METRICS_MODE_STDIO ? get_uptime_stdio() : get_uptime_pread();
+}
+
 // calculate disk usage percentage for root filesystem
 float get_disk_usage() {
     struct statvfs stat;
@@ -88,45 +404,377 @@ float get_disk_usage() {
     return 100.0 * (1.0 - ((float)stat.f_bavail / stat.f_blocks));
 }
 
-// count active network interfaces
+// select the block devices tracked by update_diskstats()
+void metrics_set_disk_devices(const char *list) {
+    snprintf(disk_patterns_buf, sizeof(disk_patterns_buf), "%s", list);
+    n_disk_patterns = -1;
+    // start over, so devices of the old list neither report nor hold slots or metric ids
+    for (int i = 0; i < MAX_DISKS; i++) {
+        if (!disks[i].name[0]) continue;
+        for (int c = 0; c < DISKSTAT_METRICS; c++) metric_release(disks[i].ids[c]);
+        disks[i].name[0] = '\0';
+    }
+}
+
+// split the include list into patterns, once
+static void split_disk_patterns() {
+    n_disk_patterns = 0;
+    char *p = disk_patterns_buf;
+    while (*p && n_disk_patterns < MAX_DISK_PATTERNS) {
+        while (*p == ',' || *p == ' ') *p++ = '\0';
+        if (!*p) break;
+        disk_patterns[n_disk_patterns++] = p;
+        while (*p && *p != ',' && *p != ' ') p++;
+    }
+}
+
+// 1 if the device name (not NUL-terminated) matches the include list
+static int disk_included(const char *name, size_t len) {
+    char dev[DISK_NAME_LEN];
+    if (len >= sizeof(dev)) return 0;
+    memcpy(dev, name, len);
+    dev[len] = '\0';
+    if (n_disk_patterns < 0) split_disk_patterns();
+    for (int i = 0; i < n_disk_patterns; i++)
+        if (fnmatch(disk_patterns[i], dev, 0) == 0) return 1;
+    return 0;
+}
+
+// find the slot of a device, allocating one (and its metrics) for new devices
+static DiskDev *find_disk(const char *name, size_t len) {
+    DiskDev *free_slot = NULL;
+    for (int i = 0; i < MAX_DISKS; i++) {
+        if (disks[i].name[0] && strncmp(disks[i].name, name, len) == 0 && disks[i].name[len] == '\0')
+            return &disks[i];
+        if (!free_slot && !disks[i].name[0]) free_slot = &disks[i];
+    }
+    if (!free_slot) return NULL; // table full, device is not tracked
+    memset(free_slot, 0, sizeof(*free_slot));
+    memcpy(free_slot->name, name, len);
+    char metric[METRIC_NAME_LEN];
+    for (int c = 0; c < DISKSTAT_METRICS; c++) {
+        snprintf(metric, sizeof(metric), "io.%s.%s", free_slot->name, diskstat_names[c]);
+        free_slot->ids[c] = metric_register(metric);
+    }
+    return free_slot;
+}
+
+// parse /proc/diskstats and publish I/O rates for the included devices.
+// line format: "major minor name reads reads_merged sectors_read ms_reading
+//               writes writes_merged sectors_written ms_writing in_flight ms_io weighted_ms ..."
+int update_diskstats() {
+    if (read_proc_file(&diskstats_fd, "diskstats", proc_buf, sizeof(proc_buf)) <= 0) return -1;
+    long long now = monotonic_ms();
+    double elapsed_ms = (double)(now - diskstats_prev_ms);
+    int have_interval = diskstats_prev_ms > 0 && elapsed_ms >= 1;
+
+    for (int i = 0; i < MAX_DISKS; i++) disks[i].seen = 0;
+
+    for (const char *p = proc_buf; *p; p = next_line(p)) {
+        unsigned long long major, minor;
+        const char *q = parse_ull(p, &major);
+        if (!q || !(q = parse_ull(q, &minor))) continue;
+        const char *name = skip_blanks(q);
+        const char *end = name;
+        while (*end && *end != ' ' && *end != '\n') end++;
+        if (end == name || !disk_included(name, end - name)) continue;
+
+        unsigned long long v[11];
+        int n = 0;
+        q = end;
+        while (n < 11 && (q = parse_ull(q, &v[n])) != NULL) n++;
+        if (n < 11) continue;
+
+        DiskDev *d = find_disk(name, end - name);
+        if (!d) continue;
+        d->seen = 1;
+        unsigned long long cur[DS_COUNTERS] = { v[0], v[2], v[3], v[4], v[6], v[7], v[10] };
+        if (d->have_prev && have_interval) {
+            double delta[DS_COUNTERS];
+            int reset = 0;
+            for (int c = 0; c < DS_COUNTERS; c++) {
+                delta[c] = counter_delta(cur[c], d->prev[c]);
+                if (delta[c] < 0) reset = 1;
+            }
+            // counters restarted: no rates this interval, cur becomes the baseline below
+            if (reset) {
+                for (int c = 0; c < DISKSTAT_METRICS; c++) metric_invalidate(d->ids[c]);
+            } else {
+                double ios = delta[DS_READS] + delta[DS_WRITES];
+                // sectors are always 512 bytes in /proc/diskstats
+                metric_set(d->ids[DISKSTAT_READ_IOPS], delta[DS_READS] * 1000.0 / elapsed_ms);
+                metric_set(d->ids[DISKSTAT_WRITE_IOPS], delta[DS_WRITES] * 1000.0 / elapsed_ms);
+                metric_set(d->ids[DISKSTAT_READ_BPS], delta[DS_READ_SECTORS] * 512.0 * 1000.0 / elapsed_ms);
+                metric_set(d->ids[DISKSTAT_WRITE_BPS], delta[DS_WRITE_SECTORS] * 512.0 * 1000.0 / elapsed_ms);
+                // time-weighted ms spent doing I/O per ms elapsed is the average number of requests in flight
+                metric_set(d->ids[DISKSTAT_QUEUE_DEPTH], delta[DS_WEIGHTED_MS] / elapsed_ms);
+                metric_set(d->ids[DISKSTAT_AWAIT_MS],
+                           ios > 0 ? (delta[DS_READ_MS] + delta[DS_WRITE_MS]) / ios : 0);
+            }
+        }
+        if (have_interval || !d->have_prev) {
+            memcpy(d->prev, cur, sizeof(cur));
+            d->have_prev = 1;
+        }
+    }
+
+    // devices that disappeared or no longer match stop reporting and give their metric ids back
+    for (int i = 0; i < MAX_DISKS; i++) {
+        if (!disks[i].name[0] || disks[i].seen) continue;
+        for (int c = 0; c < DISKSTAT_METRICS; c++) metric_release(disks[i].ids[c]);
+        disks[i].name[0] = '\0';
+    }
+    if (have_interval || diskstats_prev_ms == 0) diskstats_prev_ms = now;
+    return 0;
+}
+
+// count active network interfaces (interfaces with at least one address)
 int get_network_interfaces() {
+    // the rtnetlink monitor keeps an up-to-date table, no enumeration needed
+    if (link_monitor_active()) return link_monitor_count();
+
     struct ifaddrs *ifaddr, *ifa;
     int count = 0;
     // Get list of network interfaces
     if (getifaddrs(&ifaddr) == -1) return -1; // Return -1 if getifaddrs fails
-    // Iterate through interfaces and count those with valid addresses
-    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next)
-        if (ifa->ifa_addr) count++;
+    // Iterate through addresses and count each interface name once
+    // (an interface with IPv4 and IPv6 addresses appears several times in the list)
+    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family == AF_PACKET) continue;
+        struct ifaddrs *prev;
+        for (prev = ifaddr; prev != ifa; prev = prev->ifa_next)
+            if (prev->ifa_addr && prev->ifa_addr->sa_family != AF_PACKET && strcmp(prev->ifa_name, ifa->ifa_name) == 0) break;
+        if (prev == ifa) count++;
+    }
     // free allocated interface list
     freeifaddrs(ifaddr);
     return count; // Return number of active interfaces
 }
 
-// count running processes
-int get_process_count() {
+// count running processes by walking /proc (exact mode)
+static int get_process_count_exact() {
     // Open /proc directory to read process information
-    DIR *dir = opendir("/proc");
+    DIR *dir = opendir(proc_root());
+    if (!dir) return -1; // Return -1 if /proc cannot be opened
     struct dirent *entry;
     int count = 0;
     // iterate through /proc directory entries
     while ((entry = readdir(dir)) != NULL) {
         // count directories with numeric names (process IDs)
-        if (entry->d_type == DT_DIR && atoi(entry->d_name) > 0)
+        if (entry->d_type == DT_DIR && entry->d_name[0] > '0' && entry->d_name[0] <= '9')
             count++;
     }
     closedir(dir);
     return count; // Return number of processes
 }
 
+// count kernel tasks from the "running/total" field of /proc/loadavg (fast mode).
+// the kernel counts every task here, so threads are included in the total
+static int get_process_count_fast() {
+    if (read_proc_file(&loadavg_fd, "loadavg", proc_buf, sizeof(proc_buf)) >= 0) {
+        // "0.00 0.01 0.05 1/123 4567"
+        const char *p = strchr(proc_buf, '/');
+        unsigned long long total;
+        if (p && parse_ull(p + 1, &total)) return (int)total;
+    }
+    // fall back to sysinfo(), whose 16-bit counter is fine on small boxes
+    struct sysinfo info;
+    if (sysinfo(&info) != 0) return -1;
+    return info.procs;
+}
+
+// select how get_process_count() counts
+void metrics_set_process_mode(int mode) {
+    process_mode = (mode == PROCESS_COUNT_EXACT) ? PROCESS_COUNT_EXACT : PROCESS_COUNT_FAST;
+}
+
+// count running processes
+int get_process_count() {
+    return process_mode == PROCESS_COUNT_EXACT ? get_process_count_exact() : get_process_count_fast();
+}
+
+// find the slot of an interface, allocating one (and its rate metrics) for new interfaces
+static NetDev *find_netdev(const char *name, size_t len) {
+    NetDev *free_slot = NULL;
+    for (int i = 0; i < MAX_NETDEVS; i++) {
+        if (netdevs[i].name[0] && strncmp(netdevs[i].name, name, len) == 0 && netdevs[i].name[len] == '\0')
+            return &netdevs[i];
+        if (!free_slot && !netdevs[i].name[0]) free_slot = &netdevs[i];
+    }
+    if (!free_slot) return NULL; // table full, interface is not tracked
+    memset(free_slot, 0, sizeof(*free_slot));
+    memcpy(free_slot->name, name, len);
+    char metric[METRIC_NAME_LEN];
+    for (int c = 0; c < NETDEV_COUNTERS; c++) {
+        snprintf(metric, sizeof(metric), "net.%s.%s_ps", free_slot->name, netdev_counter_names[c]);
+        free_slot->ids[c] = metric_register(metric);
+    }
+    return free_slot;
+}
+
+// parse /proc/net/dev and publish per-second rates for every interface but loopback.
+// line format: "  eth0: rx_bytes rx_packets rx_errs rx_drop fifo frame compressed multicast
+//               tx_bytes tx_packets tx_errs tx_drop fifo colls carrier compressed"
+int update_net_dev_rates() {
+    if (read_proc_file(&netdev_fd, "net/dev", proc_buf, sizeof(proc_buf)) <= 0) return -1;
+    long long now = monotonic_ms();
+    double elapsed = (now - netdev_prev_ms) / 1000.0;
+    // two reads within the same millisecond would give meaningless rates
+    int have_interval = netdev_prev_ms > 0 && now - netdev_prev_ms >= 1;
+
+    for (int i = 0; i < MAX_NETDEVS; i++) netdevs[i].seen = 0;
+
+    // skip the two header lines
+    const char *p = next_line(next_line(proc_buf));
+    for (; *p; p = next_line(p)) {
+        const char *name = skip_blanks(p);
+        const char *colon = name;
+        while (*colon && *colon != ':' && *colon != '\n') colon++;
+        if (*colon != ':' || colon == name || colon - name >= IFNAME_LEN) continue;
+        if (colon - name == 2 && strncmp(name, "lo", 2) == 0) continue;
+
+        unsigned long long v[16];
+        const char *q = colon + 1;
+        int n = 0;
+        while (n < 16 && (q = parse_ull(q, &v[n])) != NULL) n++;
+        if (n < 16) continue;
+
+        NetDev *d = find_netdev(name, colon - name);
+        if (!d) continue;
+        d->seen = 1;
+        // receive counters are fields 0-3, transmit counters fields 8-11
+        unsigned long long cur[NETDEV_COUNTERS] = { v[0], v[1], v[2], v[3], v[8], v[9], v[10], v[11] };
+        if (d->have_prev && have_interval) {
+            double delta[NETDEV_COUNTERS];
+            int reset = 0;
+            for (int c = 0; c < NETDEV_COUNTERS; c++) {
+                delta[c] = counter_delta(cur[c], d->prev[c]);
+                if (delta[c] < 0) reset = 1;
+            }
+            // the interface was re-created: no rates this interval, cur becomes the baseline below
+            for (int c = 0; c < NETDEV_COUNTERS; c++) {
+                if (reset) metric_invalidate(d->ids[c]);
+                else metric_set(d->ids[c], delta[c] / elapsed);
+            }
+        }
+        if (have_interval || !d->have_prev) {
+            memcpy(d->prev, cur, sizeof(cur));
+            d->have_prev = 1;
+        }
+    }
+
+    // interfaces that disappeared stop reporting, free their slot and give their metric ids back
+    for (int i = 0; i < MAX_NETDEVS; i++) {
+        if (!netdevs[i].name[0] || netdevs[i].seen) continue;
+        for (int c = 0; c < NETDEV_COUNTERS; c++) metric_release(netdevs[i].ids[c]);
+        netdevs[i].name[0] = '\0';
+    }
+    if (have_interval || netdev_prev_ms == 0) netdev_prev_ms = now;
+    return 0;
+}
+
 // collect all system metrics
 Metrics collect_metrics() {
     Metrics m;
     // populate Metrics structure with collected values
     m.memory = get_memory_usage();
     m.cpu = get_cpu_load();
+    m.cpu_iowait = cpu_stats.iowait[0];
+    m.cpu_steal = cpu_stats.steal[0];
+    m.cpu_max_core = cpu_stats.max_core;
     m.uptime = get_uptime();
     m.disk = get_disk_usage();
     m.net_interfaces = get_network_interfaces();
     m.processes = get_process_count();
     return m; // Return metrics
-}
\ No newline at end of file
+}
+
+// built-in collectors: each one publishes its values into the metric table
+
+static int collect_memory() {
+    float v = get_memory_usage();
+    if (v < 0) {
+        metric_invalidate(METRIC_MEMORY);
+        return -1;
+    }
+    metric_set(METRIC_MEMORY, v);
+    return 0;
+}
+
+static int collect_cpu() {
+    float v = get_cpu_load();
+    if (v < 0) {
+        metric_invalidate(METRIC_CPU);
+        metric_invalidate(METRIC_CPU_IOWAIT);
+        metric_invalidate(METRIC_CPU_STEAL);
+        metric_invalidate(METRIC_CPU_MAX_CORE);
+        return -1;
+    }
+    metric_set(METRIC_CPU, v);
+    metric_set(METRIC_CPU_IOWAIT, cpu_stats.iowait[0]);
+    metric_set(METRIC_CPU_STEAL, cpu_stats.steal[0]);
+    metric_set(METRIC_CPU_MAX_CORE, cpu_stats.max_core);
+    return 0;
+}
+
+static int collect_uptime() {
+    metric_set(METRIC_UPTIME, get_uptime());
+    return 0;
+}
+
+static int collect_disk() {
+    float v = get_disk_usage();
+    if (v < 0) {
+        metric_invalidate(METRIC_DISK);
+        return -1;
+    }
+    metric_set(METRIC_DISK, v);
+    return 0;
+}
+
+static int collect_diskstats() {
+    return update_diskstats();
+}
+
+static int collect_net_interfaces() {
+    int v = get_network_interfaces();
+    if (v < 0) {
+        metric_invalidate(METRIC_NET_INTERFACES);
+        return -1;
+    }
+    metric_set(METRIC_NET_INTERFACES, v);
+    return 0;
+}
+
+static int collect_net_dev() {
+    return update_net_dev_rates();
+}
+
+static int collect_processes() {
+    int v = get_process_count();
+    if (v < 0) {
+        metric_invalidate(METRIC_PROCESSES);
+        return -1;
+    }
+    metric_set(METRIC_PROCESSES, v);
+    return 0;
+}
+
+// register the built-in metrics (in METRIC_* order) and their collectors.
+// cheap, fast-moving values run on every sample; slow-moving ones less often
+void metrics_init() {
+    const char *builtin[METRIC_BUILTIN_COUNT] = {
+        "memory", "cpu", "cpu_iowait", "cpu_steal", "cpu_max_core",
+        "uptime", "disk", "net_interfaces", "processes"
+    };
+    for (int i = 0; i < METRIC_BUILTIN_COUNT; i++) metric_register(builtin[i]);
+
+    collector_register("memory", collect_memory, 0);
+    collector_register("cpu", collect_cpu, 0);
+    collector_register("uptime", collect_uptime, 1000);
+    collector_register("processes", collect_processes, 1000);
+    collector_register("net_interfaces", collect_net_interfaces, 5000);
+    collector_register("net_dev", collect_net_dev, 1000);
+    collector_register("disk", collect_disk, 30000);
+    collector_register("diskstats", collect_diskstats, 1000);
+}
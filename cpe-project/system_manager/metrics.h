@@ -3,15 +3,102 @@
 #ifndef METRICS_H
 #define METRICS_H
 
+// maximum number of cores tracked individually
+#define MAX_CPUS 256
+// maximum number of interfaces tracked in /proc/net/dev (loopback is skipped)
+#define MAX_NETDEVS 16
+// longest interface name, including the terminator (IFNAMSIZ)
+#define IFNAME_LEN 16
+
+// maximum number of block devices tracked in /proc/diskstats
+#define MAX_DISKS 8
+#define DISK_NAME_LEN 32
+// include list of block devices (comma separated fnmatch patterns): whole disks only,
+// so partitions, loop and ram devices are not tracked
+#define DISK_DEVICES_DEFAULT "mmcblk[0-9],mmcblk[0-9][0-9],sd[a-z],vd[a-z],nvme[0-9]n[0-9]"
+#define DISK_PATTERNS_LEN 256
+#define MAX_DISK_PATTERNS 16
+
+// per-device I/O metrics: io.<device>.<metric>
+enum {
+    DISKSTAT_READ_IOPS,     // completed reads per second
+    DISKSTAT_WRITE_IOPS,    // completed writes per second
+    DISKSTAT_READ_BPS,      // bytes read per second
+    DISKSTAT_WRITE_BPS,     // bytes written per second
+    DISKSTAT_QUEUE_DEPTH,   // average number of requests in flight
+    DISKSTAT_AWAIT_MS,      // average time per completed request (ms), queueing included
+    DISKSTAT_METRICS
+};
+
+// per-interface counters turned into per-second rates: net.<ifname>.<counter>_ps
+enum {
+    NETDEV_RX_BYTES, NETDEV_RX_PACKETS, NETDEV_RX_ERRORS, NETDEV_RX_DROPS,
+    NETDEV_TX_BYTES, NETDEV_TX_PACKETS, NETDEV_TX_ERRORS, NETDEV_TX_DROPS,
+    NETDEV_COUNTERS
+};
+
+// snapshot of the built-in metrics, returned by collect_metrics()
 typedef struct {
     float memory;
     float cpu;
+    float cpu_iowait;   // share of cpu time spent waiting for I/O (%)
+    float cpu_steal;    // share of cpu time stolen by the hypervisor (%)
+    float cpu_max_core; // utilisation of the busiest core (%)
     float uptime;
     float disk;
     int net_interfaces;
     int processes;
 } Metrics; // Structure to store collected metrices
 
+// per-core cpu breakdown, index 0 is the aggregate of all cores and 1..count are cpu0..cpuN
+typedef struct {
+    int count;                  // number of cores listed in /proc/stat
+    float max_core;             // utilisation of the busiest core (%)
+    float usage[MAX_CPUS + 1];  // utilisation (%)
+    float iowait[MAX_CPUS + 1]; // iowait (%)
+    float steal[MAX_CPUS + 1];  // steal (%)
+} CpuStats;
+
+// collector modes for /proc based metrics
+#define METRICS_MODE_STDIO 0   // fopen/fscanf/fclose on every sample
+#define METRICS_MODE_PREAD 1   // keep /proc files open, pread at offset 0 into a reused buffer (default)
+
+// process counting modes
+#define PROCESS_COUNT_FAST 0   // task total from /proc/loadavg, one read per sample (default, includes threads)
+#define PROCESS_COUNT_EXACT 1  // walk /proc and count numeric directories
+
+// register the built-in metrics and collectors with the metric registry
+void metrics_init();
+// select the collector mode
+void metrics_set_mode(int mode);
+// select the process counting mode
+void metrics_set_process_mode(int mode);
+// release descriptors held by the pread collector
+void metrics_cleanup();
+
+// individual collectors (used by collect_metrics and the benchmarks)
+float get_memory_usage();
+float get_cpu_load();
+float get_uptime();
+float get_disk_usage();
+int get_network_interfaces();
+int get_process_count();
+
+// select the block devices tracked from /proc/diskstats (comma separated fnmatch patterns)
+void metrics_set_disk_devices(const char *list);
+// read /proc/diskstats and publish io.<device>.* computed against the previous call.
+// returns 0, or -1 if the file cannot be read
+int update_diskstats();
+
+// read /proc/net/dev and publish net.<ifname>.{rx,tx}_{bytes,packets,errors,drops}_ps
+// computed against the previous call. returns 0, or -1 if the file cannot be read
+int update_net_dev_rates();
+
+// per-core breakdown computed by the last get_cpu_load() call (pread mode only)
+const CpuStats *get_cpu_stats();
+
+// run every built-in collector once and return the values directly (tests and benchmarks;
+// system_manager itself schedules collectors through the metric registry)
 Metrics collect_metrics();
 
 #endif
@@ -0,0 +1,364 @@
+// per-mount disk usage with cached mount list and an off-loop statvfs worker. A worker stuck on
+// a hung filesystem is abandoned: a replacement takes over and skips that mount until it answers
+
+#include "mount_monitor.h"
+#include "metric_registry.h"
+#include "logger.h"
+#include "host_paths.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/statvfs.h>
+
+#define MOUNT_PATH_LEN 128
+// mountinfo on a CPE is a few KB; larger tables are read in several chunks
+#define MOUNTINFO_BUF_SIZE 65536
+
+// one tracked filesystem
+typedef struct {
+    char path[MOUNT_PATH_LEN];
+    unsigned int dev;           // major:minor, used to skip bind mounts of the same filesystem
+    int used_id, free_id, inodes_id;
+    int have_result;            // values below come from a finished statvfs
+    int hung;                   // statvfs on it never returned: skipped until it does
+    unsigned int result_round;  // round that produced the values
+    double used_pct, free_bytes, inodes_pct;
+} Mount;
+
+// mount list shared with the worker, protected by lock
+static Mount mounts[MAX_MOUNTS];
+static int n_mounts = 0;
+static unsigned int list_gen = 0;       // bumped on every reload
+
+// worker state, protected by lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static int round_requested = 0;
+static int worker_busy = 0;
+static long long busy_since = 0;        // monotonic ms when the current round started
+static char busy_path[MOUNT_PATH_LEN];  // mount currently being queried
+static unsigned int round_no = 0;       // rounds started so far
+static unsigned int worker_id = 0;      // the live worker; abandoned ones exit once statvfs returns
+static int stopping = 0;
+
+static int mountinfo_fd = -1;
+static char mountinfo_buf[MOUNTINFO_BUF_SIZE];
+
+// filesystems that never hold user data
+static const char *pseudo_fs[] = {
+    "proc", "sysfs", "devtmpfs", "devpts", "cgroup", "cgroup2", "securityfs", "pstore",
+    "debugfs", "tracefs", "bpf", "mqueue", "hugetlbfs", "configfs", "fusectl", "autofs",
+    "binfmt_misc", "rpc_pipefs", "nsfs", "efivarfs", "selinuxfs", "ramfs", "squashfs", NULL
+};
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int is_pseudo_fs(const char *type) {
+    for (int i = 0; pseudo_fs[i]; i++)
+        if (strcmp(type, pseudo_fs[i]) == 0) return 1;
+    return 0;
+}
+
+// copy a space-terminated mountinfo field, decoding the \ooo octal escapes
+static const char *copy_field(const char *p, char *out, size_t size) {
+    size_t n = 0;
+    while (*p && *p != ' ' && *p != '\n') {
+        char c = *p++;
+        if (c == '\\' && p[0] >= '0' && p[0] <= '7' && p[1] && p[2]) {
+            c = (char)(((p[0] - '0') << 6) | ((p[1] - '0') << 3) | (p[2] - '0'));
+            p += 3;
+        }
+        if (n + 1 < size) out[n++] = c;
+    }
+    out[n] = '\0';
+    return *p == ' ' ? p + 1 : p;
+}
+
+// skip n space-separated fields
+static const char *skip_fields(const char *p, int n) {
+    while (n-- > 0) {
+        while (*p && *p != ' ' && *p != '\n') p++;
+        if (*p == ' ') p++;
+    }
+    return p;
+}
+
+// metric base name for a mountpoint: "/" -> "root", "/var/log" -> "var_log"
+static void mount_metric_base(const char *path, char *out, size_t size) {
+    if (strcmp(path, "/") == 0) {
+        snprintf(out, size, "root");
+        return;
+    }
+    size_t n = 0;
+    for (const char *p = path + 1; *p && n + 1 < size; p++)
+        out[n++] = (*p == '/' || *p == ' ' || *p == ',' || *p == '=') ? '_' : *p;
+    out[n] = '\0';
+}
+
+// register the three metrics for a mount
+static void register_mount_metrics(Mount *m) {
+    char base[24], name[METRIC_NAME_LEN];
+    mount_metric_base(m->path, base, sizeof(base));
+    snprintf(name, sizeof(name), "disk.%s.used_pct", base);
+    m->used_id = metric_register(name);
+    snprintf(name, sizeof(name), "disk.%s.free_bytes", base);
+    m->free_id = metric_register(name);
+    snprintf(name, sizeof(name), "disk.%s.inodes_pct", base);
+    m->inodes_id = metric_register(name);
+}
+
+// read the whole mountinfo file from offset 0
+static int read_mountinfo() {
+    size_t used = 0;
+    ssize_t n;
+    while (used < sizeof(mountinfo_buf) - 1 &&
+           (n = pread(mountinfo_fd, mountinfo_buf + used, sizeof(mountinfo_buf) - 1 - used, used)) > 0)
+        used += n;
+    if (used == 0) return -1;
+    mountinfo_buf[used] = '\0';
+    return 0;
+}
+
+// parse mountinfo into the mount list, keeping results of mounts that are still present
+static void load_mounts() {
+    if (read_mountinfo() < 0) {
+        log_message("ERROR: Failed to read /proc/self/mountinfo");
+        return;
+    }
+
+    Mount fresh[MAX_MOUNTS];
+    int n = 0;
+    for (const char *line = mountinfo_buf; *line && n < MAX_MOUNTS; ) {
+        // "36 35 98:0 /root /mnt/point opts [optional fields] - fstype source superopts"
+        unsigned int major = 0, minor = 0;
+        char path[MOUNT_PATH_LEN], type[32];
+        const char *p = skip_fields(line, 2);
+        if (sscanf(p, "%u:%u", &major, &minor) != 2) break;
+        p = skip_fields(p, 2);
+        p = copy_field(p, path, sizeof(path));
+        const char *sep = strstr(p, " - ");
+        const char *eol = strchr(line, '\n');
+        line = eol ? eol + 1 : line + strlen(line);
+        if (!sep) continue;
+        copy_field(sep + 3, type, sizeof(type));
+
+        // skip pseudo filesystems and anything under /proc, /sys and /dev
+        if (is_pseudo_fs(type) || strncmp(path, "/proc", 5) == 0 ||
+            strncmp(path, "/sys", 4) == 0 || strncmp(path, "/dev", 4) == 0)
+            continue;
+        // bind mounts show the same device again, keep the first mountpoint
+        unsigned int dev = (major << 20) | minor;
+        int dup = 0;
+        for (int i = 0; i < n; i++)
+            if (fresh[i].dev == dev) dup = 1;
+        if (dup) continue;
+
+        memset(&fresh[n], 0, sizeof(Mount));
+        strcpy(fresh[n].path, path);
+        fresh[n].dev = dev;
+        n++;
+    }
+
+    pthread_mutex_lock(&lock);
+    // carry over the metric ids and last results of mounts that did not change; only new
+    // mounts register their metrics
+    int kept[MAX_MOUNTS] = { 0 };
+    for (int i = 0; i < n; i++) {
+        int j = 0;
+        while (j < n_mounts && (kept[j] || mounts[j].dev != fresh[i].dev || strcmp(mounts[j].path, fresh[i].path) != 0)) j++;
+        if (j < n_mounts) {
+            fresh[i] = mounts[j];
+            kept[j] = 1;
+        } else {
+            register_mount_metrics(&fresh[i]);
+        }
+    }
+    // mounts that went away stop reporting and give their metric ids back
+    for (int j = 0; j < n_mounts; j++) {
+        if (kept[j]) continue;
+        metric_release(mounts[j].used_id);
+        metric_release(mounts[j].free_id);
+        metric_release(mounts[j].inodes_id);
+    }
+    memcpy(mounts, fresh, n * sizeof(Mount));
+    n_mounts = n;
+    list_gen++;
+    pthread_mutex_unlock(&lock);
+}
+
+// worker thread: run statvfs over the mount list whenever a round is requested, storing each
+// result as it comes. a hung filesystem (e.g. a dead network mount) only blocks this thread
+static void *statvfs_worker(void *arg) {
+    unsigned int self = (unsigned int)(uintptr_t)arg;
+    char path[MOUNT_PATH_LEN];
+
+    pthread_mutex_lock(&lock);
+    while (!stopping && self == worker_id) {
+        while (!round_requested && !stopping && self == worker_id) pthread_cond_wait(&wake, &lock);
+        if (stopping || self != worker_id) break;
+        round_requested = 0;
+        unsigned int gen = list_gen;
+        unsigned int round = ++round_no;
+        worker_busy = 1;
+        busy_since = now_ms();
+
+        // stop early if the mount list changes underneath the round
+        for (int i = 0; i < n_mounts && gen == list_gen; i++) {
+            if (mounts[i].hung) continue;
+            strcpy(path, mounts[i].path);
+            strcpy(busy_path, path);
+            pthread_mutex_unlock(&lock);
+
+            struct statvfs st;
+            int ok = statvfs(path, &st) == 0 && st.f_blocks > 0;
+
+            pthread_mutex_lock(&lock);
+            if (self != worker_id) {
+                // abandoned while blocked: the mount answers again, let the live worker query it
+                for (int j = 0; j < n_mounts; j++)
+                    if (strcmp(mounts[j].path, path) == 0) mounts[j].hung = 0;
+                if (!stopping) log_message("INFO: statvfs on %s returned, tracking it again", path);
+                pthread_mutex_unlock(&lock);
+                return NULL;
+            }
+            if (gen != list_gen) break;
+            Mount *m = &mounts[i];
+            m->have_result = ok;
+            m->result_round = round;
+            if (!ok) continue;
+            m->used_pct = 100.0 * (1.0 - ((double)st.f_bavail / st.f_blocks));
+            m->free_bytes = (double)st.f_bavail * st.f_frsize;
+            // some filesystems (e.g. vfat, overlay on some kernels) report no inodes
+            m->inodes_pct = st.f_files > 0 ? 100.0 * (1.0 - ((double)st.f_ffree / st.f_files)) : 0.0;
+        }
+
+        worker_busy = 0;
+        pthread_cond_broadcast(&done);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// start a worker that replaces the current one, under lock. returns 0, or -1 if no thread
+static int start_worker() {
+    pthread_t thread;
+    worker_id++;
+    worker_busy = 0;
+    if (pthread_create(&thread, NULL, statvfs_worker, (void *)(uintptr_t)worker_id) != 0) return -1;
+    // never joined: a thread stuck in statvfs cannot be interrupted anyway
+    pthread_detach(thread);
+    return 0;
+}
+
+// "disk" collector: publish the results of the last finished round and request the next one.
+// never calls statvfs itself, so it cannot block the sampling loop
+static int collect_mounts() {
+    int failed = 0;
+    pthread_mutex_lock(&lock);
+    if (worker_busy && now_ms() - busy_since > STATVFS_STALL_MS) {
+        log_message("ERROR: statvfs on %s has been blocked for over %d ms, skipping it until it returns",
+                    busy_path, STATVFS_STALL_MS);
+        for (int i = 0; i < n_mounts; i++)
+            if (strcmp(mounts[i].path, busy_path) == 0) mounts[i].hung = 1;
+        // the stuck worker never comes back to the other mounts: hand them to a new one
+        if (start_worker() < 0) log_message("ERROR: Failed to start a new statvfs worker");
+        failed = 1;
+    }
+    for (int i = 0; i < n_mounts; i++) {
+        Mount *m = &mounts[i];
+        // a stalled round left every mount it did not reach with an old result
+        int stale = m->hung || (failed && m->result_round != round_no);
+        if (!m->have_result || stale) {
+            metric_invalidate(m->used_id);
+            metric_invalidate(m->free_id);
+            metric_invalidate(m->inodes_id);
+            if (strcmp(m->path, "/") == 0) metric_invalidate(METRIC_DISK);
+            continue;
+        }
+        metric_set(m->used_id, m->used_pct);
+        metric_set(m->free_id, m->free_bytes);
+        metric_set(m->inodes_id, m->inodes_pct);
+        if (strcmp(m->path, "/") == 0) metric_set(METRIC_DISK, m->used_pct);
+    }
+    if (!worker_busy && !stopping) {
+        round_requested = 1;
+        pthread_cond_signal(&wake);
+    }
+    pthread_mutex_unlock(&lock);
+    return failed ? -1 : 0;
+}
+
+int mount_monitor_start() {
+    if (mountinfo_fd >= 0) return mountinfo_fd;
+    char path[HOST_ROOT_LEN + 32];
+    mountinfo_fd = open(proc_path(path, sizeof(path), "self/mountinfo"), O_RDONLY | O_CLOEXEC);
+    if (mountinfo_fd < 0) return -1;
+    load_mounts();
+
+    pthread_mutex_lock(&lock);
+    stopping = 0;
+    int started = start_worker();
+    pthread_mutex_unlock(&lock);
+    if (started < 0) {
+        close(mountinfo_fd);
+        mountinfo_fd = -1;
+        return -1;
+    }
+
+    // take over the built-in "disk" collector, keeping its name so interval.disk still applies
+    collector_unregister("disk");
+    collector_register("disk", collect_mounts, 30000);
+
+    // run the first round now so the first publish has data, but give up waiting
+    // after a short while if some filesystem does not answer
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 500 * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&lock);
+    round_requested = 1;
+    pthread_cond_signal(&wake);
+    while (round_requested || worker_busy) {
+        if (pthread_cond_timedwait(&done, &lock, &deadline) != 0) break;
+    }
+    pthread_mutex_unlock(&lock);
+    return mountinfo_fd;
+}
+
+void mount_monitor_reload() {
+    if (mountinfo_fd < 0) return;
+    load_mounts();
+    log_message("INFO: Mount table changed, tracking %d filesystems", n_mounts);
+}
+
+int mount_monitor_count() {
+    return n_mounts;
+}
+
+void mount_monitor_stop() {
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    for (int i = 0; i < n_mounts; i++) {
+        metric_release(mounts[i].used_id);
+        metric_release(mounts[i].free_id);
+        metric_release(mounts[i].inodes_id);
+    }
+    n_mounts = 0;
+    list_gen++;
+    pthread_mutex_unlock(&lock);
+    if (mountinfo_fd >= 0) close(mountinfo_fd);
+    mountinfo_fd = -1;
+}
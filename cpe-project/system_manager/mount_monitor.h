@@ -0,0 +1,27 @@
+// header file for mount_monitor.c : per-mount disk usage
+
+#ifndef MOUNT_MONITOR_H
+#define MOUNT_MONITOR_H
+
+// maximum number of filesystems tracked
+#define MAX_MOUNTS 32
+// a statvfs running longer than this is reported as hung: its mount is skipped until it returns
+// and the other mounts go to a new worker thread
+#define STATVFS_STALL_MS 5000
+
+// read /proc/self/mountinfo, start the statvfs worker thread and take over the "disk"
+// collector. publishes disk.<mount>.used_pct, disk.<mount>.free_bytes and
+// disk.<mount>.inodes_pct for every real filesystem, and the built-in "disk" metric for "/".
+// returns the mountinfo fd to poll for POLLPRI (mount table changed), or -1 on failure
+int mount_monitor_start();
+
+// re-read the mount list after the mountinfo fd signalled a change
+void mount_monitor_reload();
+
+// number of filesystems currently tracked
+int mount_monitor_count();
+
+// stop the worker thread, release the metric ids of the mounts and close the mountinfo fd
+void mount_monitor_stop();
+
+#endif
@@ -0,0 +1,158 @@
+// pressure stall (PSI) triggers: the kernel wakes us when tasks stall on cpu, memory or io,
+// instead of the sampling loop having to catch the breach
+
+#include "psi_monitor.h"
+#include "host_paths.h"
+#include "metric_registry.h"
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+static const char *psi_names[PSI_RESOURCES] = { "cpu", "memory", "io" };
+static int psi_fds[PSI_RESOURCES] = { -1, -1, -1 };
+static float psi_thresholds[PSI_RESOURCES];
+
+// watched resources: plain read-only fds, so sampling works without the right to set triggers
+static int watch_fds[PSI_RESOURCES] = { -1, -1, -1 };
+static int watch_ids[PSI_RESOURCES] = { -1, -1, -1 };
+static unsigned long long prev_total[PSI_RESOURCES];    // "some" stall time in us at the last sample
+static long long prev_ms[PSI_RESOURCES];                // when it was taken, 0 = no sample yet
+
+// a trigger firing right after a sample would give a share over a few ms: too noisy to publish
+#define PSI_MIN_SAMPLE_MS 100
+
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// read the "some" total of a watched resource and publish the stall share since the last sample.
+// returns 0, or -1 if the file could not be read
+static int sample(int r) {
+    char buf[256];
+    ssize_t n = pread(watch_fds[r], buf, sizeof(buf) - 1, 0);
+    const char *p = NULL;
+    if (n > 0) {
+        buf[n] = '\0';
+        p = strstr(buf, "total=");
+    }
+    if (!p) {
+        metric_invalidate(watch_ids[r]);
+        return -1;
+    }
+    unsigned long long total = strtoull(p + 6, NULL, 10);
+    long long now = monotonic_ms();
+    if (prev_ms[r] > 0 && now - prev_ms[r] < PSI_MIN_SAMPLE_MS) return 0;
+    if (prev_ms[r] > 0 && total >= prev_total[r]) {
+        double share = (total - prev_total[r]) / 10.0 / (now - prev_ms[r]);
+        metric_set(watch_ids[r], share > 100 ? 100 : share);
+    }
+    prev_total[r] = total;
+    prev_ms[r] = now;
+    return 0;
+}
+
+int psi_monitor_open(int resource, float threshold_pct) {
+    if (resource < 0 || resource >= PSI_RESOURCES || threshold_pct <= 0 || threshold_pct > 100) {
+        errno = EINVAL;
+        return -1;
+    }
+    psi_monitor_close(resource);
+
+    char name[32], path[HOST_ROOT_LEN + 32];
+    snprintf(name, sizeof(name), "pressure/%s", psi_names[resource]);
+    int fd = open(proc_path(path, sizeof(path), name), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    // "some <stall us> <window us>", the kernel expects the terminating NUL to be written too
+    char trigger[64];
+    long stall_us = (long)(threshold_pct / 100.0f * PSI_WINDOW_US);
+    int len = snprintf(trigger, sizeof(trigger), "some %ld %d", stall_us, PSI_WINDOW_US);
+    if (write(fd, trigger, len + 1) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    psi_fds[resource] = fd;
+    psi_thresholds[resource] = threshold_pct;
+    return fd;
+}
+
+int psi_monitor_handle(int fd, short revents, psi_event_fn on_event) {
+    int r;
+    for (r = 0; r < PSI_RESOURCES; r++)
+        if (psi_fds[r] == fd) break;
+    if (r == PSI_RESOURCES) return -1;
+
+    if (revents & (POLLERR | POLLNVAL)) {
+        // the pressure file went away (e.g. cgroup removed), stop polling it
+        psi_monitor_close(r);
+        return -1;
+    }
+
+    // the trigger fd reads like the plain file: "some avg10=1.23 avg60=..."
+    char buf[256];
+    float avg10 = 0;
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n > 0) {
+        buf[n] = '\0';
+        const char *p = strstr(buf, "avg10=");
+        if (p) avg10 = strtof(p + 6, NULL);
+    }
+    if (watch_fds[r] >= 0) sample(r);
+    if (on_event) on_event(psi_names[r], avg10, psi_thresholds[r]);
+    return 0;
+}
+
+int psi_monitor_watch(int resource) {
+    if (resource < 0 || resource >= PSI_RESOURCES) return -1;
+    if (watch_fds[resource] >= 0) return 0;
+    char name[32], path[HOST_ROOT_LEN + 32];
+    snprintf(name, sizeof(name), "pressure/%s", psi_names[resource]);
+    int fd = open(proc_path(path, sizeof(path), name), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    snprintf(name, sizeof(name), "pressure.%s", psi_names[resource]);
+    watch_ids[resource] = metric_register(name);
+    watch_fds[resource] = fd;
+    prev_ms[resource] = 0;
+    // baseline for the first share
+    sample(resource);
+    return 0;
+}
+
+void psi_monitor_unwatch(int resource) {
+    if (resource < 0 || resource >= PSI_RESOURCES || watch_fds[resource] < 0) return;
+    close(watch_fds[resource]);
+    watch_fds[resource] = -1;
+    metric_release(watch_ids[resource]);
+    watch_ids[resource] = -1;
+}
+
+int psi_monitor_collect() {
+    int failed = 0;
+    for (int r = 0; r < PSI_RESOURCES; r++)
+        if (watch_fds[r] >= 0 && sample(r) < 0) failed = 1;
+    return failed ? -1 : 0;
+}
+
+const char *psi_monitor_name(int resource) {
+    return resource >= 0 && resource < PSI_RESOURCES ? psi_names[resource] : "unknown";
+}
+
+int psi_monitor_fd(int resource) {
+    if (resource < 0 || resource >= PSI_RESOURCES) return -1;
+    return psi_fds[resource];
+}
+
+void psi_monitor_close(int resource) {
+    if (resource < 0 || resource >= PSI_RESOURCES || psi_fds[resource] < 0) return;
+    close(psi_fds[resource]);
+    psi_fds[resource] = -1;
+}
@@ -0,0 +1,51 @@
+// header file for psi_monitor.c : kernel pressure stall (PSI) triggers
+
+#ifndef PSI_MONITOR_H
+#define PSI_MONITOR_H
+
+// resources with a /proc/pressure file
+enum {
+    PSI_CPU,
+    PSI_MEMORY,
+    PSI_IO,
+    PSI_RESOURCES
+};
+
+// trigger window in microseconds. Unprivileged triggers need a multiple of 2 s
+#define PSI_WINDOW_US 2000000
+
+// called when a trigger fires: resource name ("cpu", "memory", "io"), the 10 s average
+// share of time some task was stalled (%) and the configured trigger threshold (%)
+typedef void (*psi_event_fn)(const char *resource, float avg10, float threshold);
+
+// register a "some" trigger on /proc/pressure/<resource> that fires when tasks are stalled for
+// more than threshold_pct percent of a PSI_WINDOW_US window. Replaces an existing trigger.
+// returns the fd to poll for POLLPRI, or -1 if PSI is not available (errno is preserved)
+int psi_monitor_open(int resource, float threshold_pct);
+
+// start publishing metric pressure.<resource>: the share of time (%) some task was stalled on
+// it since the previous sample, from the "total" stall time in /proc/pressure/<resource>.
+// The alarm rules on the pressure thresholds watch it. returns 0, or -1 if PSI is not available
+int psi_monitor_watch(int resource);
+
+// stop publishing pressure.<resource> and release its metric id
+void psi_monitor_unwatch(int resource);
+
+// "pressure" collector: sample every watched resource. returns 0, or -1 if one could not be read
+int psi_monitor_collect();
+
+// handle POLLPRI/POLLERR on a trigger fd. A watched resource is sampled right away, so its
+// alarm rule sees the stall on the next check. returns 0, or -1 if fd is not a trigger or
+// the trigger broke (it is closed and must no longer be polled)
+int psi_monitor_handle(int fd, short revents, psi_event_fn on_event);
+
+// name of a resource ("cpu", "memory", "io")
+const char *psi_monitor_name(int resource);
+
+// fd of the trigger on a resource, -1 if none
+int psi_monitor_fd(int resource);
+
+// close the trigger on a resource
+void psi_monitor_close(int resource);
+
+#endif
@@ -0,0 +1,98 @@
+// collector benchmark against captured or generated procfs/sysfs trees
+// usage: bench_collectors [-n iterations] <fixture dir>...
+// each fixture dir holds a proc/ and a sys/ tree (see test/fixtures and test/gen_proc_fixture.sh)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+#include "metric_registry.h"
+#include "cgroup_monitor.h"
+#include "top_processes.h"
+#include "host_paths.h"
+
+// default number of calls per collector
+#define BENCH_ITERATIONS 2000
+
+// monotonic clock in nanoseconds
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static volatile double sink;
+
+static double bench_memory() { return get_memory_usage(); }
+static double bench_cpu() { return get_cpu_load(); }
+static double bench_uptime() { return get_uptime(); }
+static double bench_process_count() { return get_process_count(); }
+static double bench_net_dev() { return update_net_dev_rates(); }
+static double bench_diskstats() { return update_diskstats(); }
+static double bench_cgroups() { return update_cgroups(); }
+
+static TopProcesses top;
+static double bench_top() {
+    top_processes_scan(&top);
+    return top.scanned;
+}
+
+// average cost of one call
+static void run(const char *label, double (*fn)(), int iterations) {
+    sink += fn(); // warm up: opens descriptors, fills delta state
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) sink += fn();
+    long long elapsed = now_ns() - start;
+    printf("  %-24s %10lld ns/call\n", label, elapsed / iterations);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = BENCH_ITERATIONS;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        iterations = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-n iterations] <fixture dir>...\n", argv[0]);
+        return 1;
+    }
+
+    for (int f = first; f < argc; f++) {
+        char proc[HOST_ROOT_LEN], sys[HOST_ROOT_LEN];
+        snprintf(proc, sizeof(proc), "%s/proc", argv[f]);
+        snprintf(sys, sizeof(sys), "%s/sys", argv[f]);
+        host_paths_set(proc, sys);
+        // drop descriptors and delta state of the previous tree
+        metrics_cleanup();
+        top_processes_cleanup();
+
+        metrics_set_mode(METRICS_MODE_PREAD);
+        metrics_set_process_mode(PROCESS_COUNT_EXACT);
+        int processes = get_process_count();
+        get_cpu_load();
+        printf("%s: %d cpus, %d processes (%d iterations)\n", argv[f], get_cpu_stats()->count, processes, iterations);
+
+        run("memory (pread)", bench_memory, iterations);
+        metrics_set_mode(METRICS_MODE_STDIO);
+        run("cpu (stdio)", bench_cpu, iterations);
+        metrics_set_mode(METRICS_MODE_PREAD);
+        run("cpu (pread, per core)", bench_cpu, iterations);
+        run("uptime (pread)", bench_uptime, iterations);
+        metrics_set_process_mode(PROCESS_COUNT_FAST);
+        run("processes (fast)", bench_process_count, iterations);
+        metrics_set_process_mode(PROCESS_COUNT_EXACT);
+        run("processes (exact)", bench_process_count, iterations / 20 + 1);
+        run("net_dev", bench_net_dev, iterations);
+        run("diskstats", bench_diskstats, iterations);
+        cgroup_monitor_start("system.slice/dataplane.service");
+        run("cgroups (1 service)", bench_cgroups, iterations);
+        cgroup_monitor_stop();
+        run("top processes", bench_top, iterations / 20 + 1);
+        printf("  %-24s %10d processes%s\n", "top processes scanned", top.scanned,
+               top.truncated ? " (time budget hit)" : "");
+    }
+    metrics_cleanup();
+    return 0;
+}
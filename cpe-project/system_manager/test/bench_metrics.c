@@ -0,0 +1,226 @@
+// benchmark of the sampling and alarm path on the live system: collectors, rule evaluation,
+// alarm encoding, posting and logging
+// usage: bench_metrics [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "metrics.h"
+#include "metric_registry.h"
+#include "alarm_rules.h"
+#include "json_writer.h"
+#include "http_client.h"
+#include "logger.h"
+#include "test_server.h"
+
+// default number of samples per benchmark run
+#define BENCH_ITERATIONS 20000
+// scratch log for the logging benchmark
+#define BENCH_LOG "/tmp/bench_metrics.log"
+
+// sample the three /proc file collectors (meminfo, stat, uptime) in a tight loop
+// and print the average cost per sample
+static void bench_proc_collectors(const char *label, int mode, int iterations) {
+    volatile float sink = 0;
+    metrics_set_mode(mode);
+    // warm up so lazily opened descriptors are not part of the measurement
+    sink += get_memory_usage() + get_cpu_load() + get_uptime();
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        sink += get_memory_usage();
+        sink += get_cpu_load();
+        sink += get_uptime();
+    }
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample\n", label, elapsed / iterations);
+    (void)sink;
+}
+
+// cost of one get_process_count() call in the given counting mode
+static void bench_process_count(const char *label, int mode, int iterations) {
+    volatile int sink = 0;
+    metrics_set_process_mode(mode);
+    sink += get_process_count();
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        sink += get_process_count();
+    }
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample\n", label, elapsed / iterations);
+    metrics_set_process_mode(PROCESS_COUNT_FAST);
+    (void)sink;
+}
+
+// full collect_metrics() cost, including statvfs, getifaddrs and the /proc walk
+static void bench_collect_metrics(const char *label, int mode, int iterations) {
+    volatile int sink = 0;
+    metrics_set_mode(mode);
+    sink += collect_metrics().processes;
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        sink += collect_metrics().processes;
+    }
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample\n", label, elapsed / iterations);
+    (void)sink;
+}
+
+// cost of a log message, its share of the batched file write included
+static void bench_log_message(const char *label, int iterations) {
+    log_flush();
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        log_message("INFO: benchmark message %d of %d", i, iterations);
+        if (i % (LOG_RING_SLOTS / 2) == LOG_RING_SLOTS / 2 - 1) log_flush();
+    }
+    log_flush();
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/message\n", label, elapsed / iterations);
+}
+
+// cost of one scheduler tick at 1 s cadence with the default collector intervals
+static void bench_registry_tick(const char *label, int iterations) {
+    static long long tick = 1000000;
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        run_collectors(tick);
+        tick += 1000;
+    }
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample\n", label, elapsed / iterations);
+}
+
+// cost of a rule table of compound conditions, three comparisons each
+static void bench_conditions(const char *label, int iterations) {
+    Thresholds t = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_exprs = MAX_THRESHOLD_EXPRS};
+    for (int i = 0; i < MAX_THRESHOLD_EXPRS; i++) {
+        snprintf(t.exprs[i].name, sizeof(t.exprs[i].name), "bench%d", i);
+        snprintf(t.exprs[i].text, sizeof(t.exprs[i].text),
+                 "cpu > %d && (memory > 70 || bench.rule%d < 3) for 30s", 50 + i, i);
+    }
+    static AlarmRuleSet rules;
+    alarm_rules_compile(&t, &rules);
+    AlarmEvent events[MAX_ALARM_RULES];
+    volatile int sink = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) sink += alarm_rules_evaluate(&rules, i * 1000LL, events);
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample (%d rules, %d conditions)\n", label, elapsed / iterations, rules.count, rules.n_exprs);
+    (void)sink;
+}
+
+// cost of encoding the metrics object of an alarm
+static void bench_json_metrics(const char *label, int iterations) {
+    char storage[8192];
+    JsonWriter w;
+    json_init(&w, storage, sizeof(storage));
+    int n = metric_count();
+    volatile size_t sink = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        json_reset(&w);
+        json_object_begin(&w);
+        for (int id = 0; id < n; id++) {
+            json_key(&w, metric_name(id));
+            json_double(&w, metric_value(id) + i, 2);
+        }
+        json_object_end(&w);
+        sink += json_len(&w);
+    }
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample (%d metrics, %zu bytes)\n", label, elapsed / iterations, n, json_len(&w));
+    json_free(&w);
+    (void)sink;
+}
+
+// cost of posting an alarm on a kept connection, and on a new client per request
+static void bench_http_post(const char *label, int iterations) {
+    char url[64];
+    char payload[512];
+    int connections = -1;
+    int count_pipe[2];
+    if (pipe(count_pipe) < 0) return;
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[0] = '"';
+    payload[sizeof(payload) - 2] = '"';
+    payload[sizeof(payload) - 1] = '\0';
+    pid_t server = start_server(0, 2 * iterations, -1, count_pipe[1], url, sizeof(url));
+    close(count_pipe[1]);
+    if (server < 0) return;
+
+    HttpAsync client;
+    long long start = now_ns();
+    http_async_init(&client, url);
+    for (int i = 0; i < iterations; i++) post_and_wait(&client, payload);
+    http_async_cleanup(&client);
+    long long reused = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        http_async_init(&client, url);
+        post_and_wait(&client, payload);
+        http_async_cleanup(&client);
+    }
+    long long fresh = now_ns() - start;
+
+    waitpid(server, NULL, 0);
+    read(count_pipe[0], &connections, sizeof(connections));
+    close(count_pipe[0]);
+    printf("  %-28s %8lld ns/alarm kept, %lld ns/alarm new client (%d connections)\n",
+           label, reused / iterations, fresh / iterations, connections);
+}
+
+// cost of one pass over a full rule table
+static void bench_alarm_rules(const char *label, int iterations) {
+    Thresholds t = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_metrics = 0};
+    for (int i = 0; i < MAX_METRIC_THRESHOLDS; i++) {
+        snprintf(t.metrics[i].name, sizeof(t.metrics[i].name), "bench.rule%d", i);
+        t.metrics[i].value = i;
+        metric_set(metric_register(t.metrics[i].name), i % 2 ? 2 * i : 0);
+    }
+    t.n_metrics = MAX_METRIC_THRESHOLDS;
+    static AlarmRuleSet rules;
+    alarm_rules_compile(&t, &rules);
+    AlarmEvent events[MAX_ALARM_RULES];
+    volatile int sink = 0;
+
+    long long start = now_ns();
+    for (int i = 0; i < iterations; i++) sink += alarm_rules_evaluate(&rules, i * 1000LL, events);
+    long long elapsed = now_ns() - start;
+    printf("  %-28s %8lld ns/sample (%d rules)\n", label, elapsed / iterations, rules.count);
+    (void)sink;
+}
+
+int main(int argc, char *argv[]) {
+    // optional iteration count, e.g. "./bench_metrics 100000"
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_ITERATIONS;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    logger_set_path(BENCH_LOG);
+    metrics_init();
+    printf("Benchmark (%d samples):\n", iterations);
+    bench_proc_collectors("proc files, stdio", METRICS_MODE_STDIO, iterations);
+    bench_proc_collectors("proc files, pread", METRICS_MODE_PREAD, iterations);
+    bench_process_count("process count, fast", PROCESS_COUNT_FAST, iterations);
+    bench_process_count("process count, exact", PROCESS_COUNT_EXACT, iterations / 10 + 1);
+    bench_collect_metrics("collect_metrics, stdio", METRICS_MODE_STDIO, iterations / 10 + 1);
+    bench_collect_metrics("collect_metrics, pread", METRICS_MODE_PREAD, iterations / 10 + 1);
+    bench_registry_tick("registry tick, 1 s cadence", iterations / 10 + 1);
+    bench_alarm_rules("alarm rules, full table", iterations);
+    bench_conditions("alarm rules, conditions", iterations);
+    bench_json_metrics("alarm metrics JSON", iterations / 10 + 1);
+    bench_http_post("alarm post, loopback", iterations / 100 + 1);
+    bench_log_message("log message", iterations / 10 + 1);
+    metrics_cleanup();
+    log_flush();
+    unlink(BENCH_LOG);
+    return 0;
+}
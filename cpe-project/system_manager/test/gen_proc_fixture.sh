@@ -0,0 +1,72 @@
+#!/bin/sh
+# generate a synthetic procfs/sysfs tree for the collector benchmark
+# usage: gen_proc_fixture.sh <dir> <cpus> <processes>
+# the tree has the same layout as test/fixtures/cpe-small: <dir>/proc and <dir>/sys
+
+set -e
+dir=$1
+cpus=$2
+procs=$3
+if [ -z "$dir" ] || [ -z "$cpus" ] || [ -z "$procs" ]; then
+    echo "usage: $0 <dir> <cpus> <processes>" >&2
+    exit 1
+fi
+# already generated with the same parameters
+if [ -f "$dir/.params" ] && [ "$(cat "$dir/.params")" = "$cpus $procs" ]; then
+    exit 0
+fi
+rm -rf "$dir"
+mkdir -p "$dir/proc/net" "$dir/proc/self" "$dir/sys/fs/cgroup/system.slice/dataplane.service"
+# files whose size does not depend on the box come from the captured CPE tree
+small="$(dirname "$0")/fixtures/cpe-small"
+cp -r "$small/proc/pressure" "$dir/proc/"
+cp "$small/proc/meminfo" "$small/proc/uptime" "$dir/proc/"
+cp "$small/proc/self/mountinfo" "$dir/proc/self/"
+cp "$small"/sys/fs/cgroup/system.slice/dataplane.service/* "$dir/sys/fs/cgroup/system.slice/dataplane.service/"
+
+# /proc/stat: aggregate line, one line per cpu, and an intr line with one counter per irq
+# as on a large box (the part real parsers have to skip)
+awk -v cpus="$cpus" 'BEGIN {
+    printf "cpu  %d 0 %d %d %d 0 %d 0 0 0\n", cpus * 9000, cpus * 4000, cpus * 300000, cpus * 150, cpus * 600
+    for (i = 0; i < cpus; i++)
+        printf "cpu%d %d %d %d %d %d 0 %d %d 0 0\n", i, 9000 + i, i % 7, 4000 + i, 300000 - i, 150, 600, i % 3
+    printf "intr 1203312"
+    for (i = 0; i < cpus * 16 + 512; i++) printf " %d", (i * 7919) % 100000
+    printf "\nctxt 44120337\nbtime 1760000000\nprocesses %d\nprocs_running 2\nprocs_blocked 0\n", procs * 10
+    printf "softirq 9023312 0 3310201 12 1820331 0 0 402110 2019320 0 1471338\n"
+}' > "$dir/proc/stat"
+
+echo "1.42 1.37 1.31 3/$((procs * 2)) 99999" > "$dir/proc/loadavg"
+
+# one ethernet port per 8 cpus plus a bridge
+awk -v cpus="$cpus" 'BEGIN {
+    print "Inter-|   Receive                                                |  Transmit"
+    print " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed"
+    print "    lo:  1203312    12031    0    0    0     0          0         0  1203312    12031    0    0    0     0       0          0"
+    ports = int(cpus / 8) + 1
+    if (ports > 12) ports = 12
+    for (i = 0; i < ports; i++)
+        printf "  eth%d: %.0f %d 0 %d 0 0 0 0 %.0f %d 0 0 0 0 0 0\n", i, 8210331201 + i, 6120331 + i, i, 1203312001 + i, 2910331 + i
+    print "br-lan: 2110331201 2610331    0    0    0     0          0     10331 9820331201 7120331    0    0    0     0       0          0"
+}' > "$dir/proc/net/dev"
+
+# a few disks with partitions and loop devices
+awk 'BEGIN {
+    for (d = 0; d < 4; d++) {
+        printf "   8 %7d sd%c 21031 1203 1620312 82031 41203 12031 3120312 410231 0 402310 492310 0 0 0 0 0 0\n", d * 16, 97 + d
+        for (p = 1; p <= 3; p++)
+            printf "   8 %7d sd%c%d 7010 401 540104 27343 13734 4010 1040104 136743 0 134103 164103 0 0 0 0 0 0\n", d * 16 + p, 97 + d, p
+    }
+    for (l = 0; l < 8; l++) printf "   7 %7d loop%d 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n", l, l
+}' > "$dir/proc/diskstats"
+
+# process directories, one stat file each
+cd "$dir/proc"
+pid=1
+while [ $pid -le "$procs" ]; do
+    mkdir $pid
+    echo "$pid (worker-$pid) S 1 $pid $pid 0 -1 4194560 1203 0 0 0 $((pid * 7 % 1000)) $((pid * 3 % 500)) 0 0 20 0 1 0 $((pid % 900 + 100)) 9412608 $((pid * 13 % 4096 + 64)) 18446744073709551615 1 1 0 0 0 0 0 4096 1260 0 0 0 17 0 0 0 0 0 0" > $pid/stat
+    pid=$((pid + 1))
+done
+cd - > /dev/null
+echo "$cpus $procs" > "$dir/.params"
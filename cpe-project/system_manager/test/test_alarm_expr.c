@@ -0,0 +1,83 @@
+// alarm condition test: compound expressions compiled once and evaluated on the metric arrays
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "metric_registry.h"
+#include "alarm_expr.h"
+#include "logger.h"
+
+#define TEST_LOG "/tmp/test_alarm_expr.log"
+
+int main() {
+    logger_set_path(TEST_LOG);
+    metrics_init();
+
+    // compound conditions: compiled once, evaluated on the metric arrays
+    const struct { const char *text; int holds; long long hold_ms; } conditions[] = {
+        { "cpu > 80 && memory > 70 for 30s", 1, 30000 },
+        { "cpu > 80 && memory > 95", 0, 0 },
+        { "(cpu < 10 || memory >= 75) && !(disk > 50)", 1, 0 },
+        { "test.missing > 0 || cpu<=90 for 2m", 1, 120000 },
+        { "!(test.missing <= 0)", 1, 0 },
+        { "cpu > 8.5e1 && memory >= -.5 for 1.5e1", 1, 15000 },
+    };
+    metric_set(METRIC_CPU, 90);
+    metric_set(METRIC_MEMORY, 75);
+    metric_set(METRIC_DISK, 10);
+    for (size_t c = 0; c < sizeof(conditions) / sizeof(conditions[0]); c++) {
+        AlarmExpr expr;
+        long long hold_ms;
+        char err[96];
+        int rc = alarm_expr_compile(conditions[c].text, &expr, &hold_ms, err, sizeof(err));
+        int holds = rc == 0 ? alarm_expr_eval(&expr, metric_values(), metric_valid_flags()) : -1;
+        if (rc < 0 || holds != conditions[c].holds || hold_ms != conditions[c].hold_ms) {
+            printf("FAIL: condition \"%s\" gives %d (hold %lld ms) %s\n", conditions[c].text, holds, hold_ms, rc < 0 ? err : "");
+            return 1;
+        }
+    }
+    const char *bad[] = { "cpu >", "cpu > 80 &&", "(cpu > 80", "cpu 80", "cpu > 80 for", "cpu > nan",
+                          "cpu > inf", "cpu < -infinity", "cpu > 0x50", "cpu > 1e999", "cpu > 80 for nan s" };
+    for (size_t c = 0; c < sizeof(bad) / sizeof(bad[0]); c++) {
+        AlarmExpr expr;
+        long long hold_ms;
+        char err[96];
+        if (alarm_expr_compile(bad[c], &expr, &hold_ms, err, sizeof(err)) == 0) {
+            printf("FAIL: condition \"%s\" compiled\n", bad[c]);
+            return 1;
+        }
+    }
+    printf("Conditions: %d evaluated, %d rejected\n", (int)(sizeof(conditions) / sizeof(conditions[0])),
+           (int)(sizeof(bad) / sizeof(bad[0])));
+
+    // longest expressions: 16 fused "cpu > N" clauses and their 15 ands fit in EXPR_MAX_OPS, a 17th
+    // is rejected without writing past the program
+    struct { AlarmExpr expr; double canary; } guarded;
+    char text[512] = "";
+    char err[96];
+    long long hold_ms;
+    int fits = -1, too_long = -1;
+    for (int clauses = 1; clauses <= 17; clauses++) {
+        size_t len = strlen(text);
+        snprintf(text + len, sizeof(text) - len, "%scpu > %d", clauses > 1 ? " && " : "", clauses);
+        guarded.canary = 42;
+        int rc = alarm_expr_compile(text, &guarded.expr, &hold_ms, err, sizeof(err));
+        if (guarded.canary != 42) {
+            printf("FAIL: compiling %d clauses wrote past the expression\n", clauses);
+            return 1;
+        }
+        if (clauses == 16) fits = rc == 0 && alarm_expr_eval(&guarded.expr, metric_values(), metric_valid_flags()) == 1;
+        if (clauses == 17) too_long = rc < 0 && strstr(err, "too long") != NULL;
+    }
+    printf("Long conditions: 16 clauses %s, 17 clauses %s\n", fits ? "compiled" : "failed", too_long ? "rejected" : "accepted");
+    if (fits != 1 || too_long != 1) {
+        printf("FAIL: expression length limit\n");
+        return 1;
+    }
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+// alarm queue test: eviction and coalescing policy, batching of pending alarms into one post and
+// link alarms of a flapping port
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "alarm_queue.h"
+#include "alarm.h"
+#include "alarm_rules.h"
+#include "logger.h"
+#include "test_server.h"
+
+#define TEST_LOG "/tmp/test_alarm_queue.log"
+
+int main() {
+    logger_set_path(TEST_LOG);
+    // alarm queue without a sender: full queue evicts the lowest priority, same key coalesces
+    char text[32];
+    for (int i = 0; i < ALARM_QUEUE_SIZE; i++) {
+        snprintf(text, sizeof(text), "warning %d", i);
+        alarm_queue_push(NULL, SEVERITY_WARNING, text, "{}");
+    }
+    int critical_queued = alarm_queue_push(NULL, SEVERITY_CRITICAL, "critical", "{}");
+    int info_queued = alarm_queue_push(NULL, SEVERITY_INFO, "info", "{}");
+    alarm_queue_push("cpu", SEVERITY_WARNING, "repeat 1", "{}");
+    alarm_queue_push("cpu", SEVERITY_WARNING, "repeat 2", "{}");
+    printf("Alarm queue: %d pending, %d dropped\n", alarm_queue_pending(), alarm_queue_dropped());
+    if (!critical_queued || info_queued || alarm_queue_pending() != ALARM_QUEUE_SIZE || alarm_queue_dropped() != 4) {
+        printf("FAIL: alarm queue policy\n");
+        return 1;
+    }
+    alarm_queue_stop();
+
+    // alarms pending together leave in one request, arrays flattened into it
+    int body_pipe[2];
+    char url[64];
+    char batch_body[256] = "";
+    pid_t server = pipe(body_pipe) < 0 ? -1 : start_server(0, 1, body_pipe[1], -1, url, sizeof(url));
+    if (server < 0) {
+        printf("FAIL: alarm batch server\n");
+        return 1;
+    }
+    close(body_pipe[1]);
+    alarm_queue_push(NULL, SEVERITY_WARNING, "a", "{\"a\":1}");
+    alarm_queue_push(NULL, SEVERITY_WARNING, "b and c", "[{\"b\":2},{\"c\":3}]");
+    alarm_queue_push(NULL, SEVERITY_WARNING, "d", "{\"d\":4}");
+    alarm_queue_start(url, 0);
+    if (drive_alarm_queue(body_pipe[0], 10000)) {
+        int n = read(body_pipe[0], batch_body, sizeof(batch_body) - 1);
+        batch_body[n > 0 ? n : 0] = '\0';
+    }
+    alarm_queue_stop();
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+    close(body_pipe[0]);
+    printf("Alarm batch: %s\n", batch_body);
+    if (strcmp(batch_body, "[{\"a\":1},{\"b\":2},{\"c\":3},{\"d\":4}]") != 0) {
+        printf("FAIL: alarm batch\n");
+        return 1;
+    }
+
+    // link alarms: changes of a flapping port are held back and sent once per hold with the
+    // latest state, under one key so a newer state replaces one still pending
+    int first_down = send_link_alarm("eth9", 0, 0);
+    int held = 0;
+    for (int i = 1; i <= 6; i++) held += send_link_alarm("eth9", i % 2, i * 100);
+    int early = send_held_link_alarms(LINK_HOLD_MS - 1);
+    int flushed = send_held_link_alarms(LINK_HOLD_MS);
+    int quiet = send_held_link_alarms(2 * LINK_HOLD_MS);
+    int steady_up = send_link_alarm("eth9", 1, 3 * LINK_HOLD_MS);
+    int link_pending = alarm_queue_pending();
+    alarm_queue_stop();
+    printf("Link flaps: %d held of 6, %d sent after the hold, %d pending\n", 6 - held, flushed, link_pending);
+    if (!first_down || held != 0 || early != 0 || flushed != 1 || quiet != 0 || !steady_up || link_pending != 1) {
+        printf("FAIL: link flap hold\n");
+        return 1;
+    }
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
+    return 0;
+}
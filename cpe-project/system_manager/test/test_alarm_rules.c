@@ -0,0 +1,184 @@
+// alarm rule test: debounce, hysteresis, renotify, reload, pressure and trend rules on the metric table
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "metric_registry.h"
+#include "metric_trend.h"
+#include "alarm_rules.h"
+#include "logger.h"
+
+#define TEST_LOG "/tmp/test_alarm_rules.log"
+
+int main() {
+    unlink(TEST_LOG);
+    logger_set_path(TEST_LOG);
+    metrics_init();
+
+    // alarm rules: one row per threshold, raised after the debounce, cleared at the clear point
+    Thresholds th = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_metrics = 1,
+                     .alarm_debounce = 2, .alarm_renotify = 60, .n_clears = 1};
+    strcpy(th.metrics[0].name, "test.free");
+    th.metrics[0].value = 20;
+    th.metrics[0].below = 1;
+    strcpy(th.clears[0].name, "cpu");
+    th.clears[0].value = 70;
+    static AlarmRuleSet rules;
+    AlarmEvent events[MAX_ALARM_RULES];
+    char message[256];
+    alarm_rules_compile(&th, &rules);
+    metric_set(METRIC_MEMORY, 10);
+    metric_set(METRIC_CPU, 90);
+    metric_set(METRIC_DISK, 10);
+    metric_set(METRIC_UPTIME, 1);
+    metric_set(METRIC_NET_INTERFACES, 1);
+    metric_set(METRIC_PROCESSES, 1);
+    metric_set(metric_find("test.free"), 10);
+    int first = alarm_rules_evaluate(&rules, 0, events);
+    int n_events = alarm_rules_evaluate(&rules, 1000, events);
+    alarm_rule_message(&rules, &events[0], message, sizeof(message));
+    printf("Alarm rules: %d rules, %d then %d events, first: %s\n", rules.count, first, n_events, message);
+    if (rules.count != 7 || first != 0 || n_events != 2 || events[0].type != ALARM_RAISE ||
+        strcmp(message, "CPU usage (90.0%) exceeds threshold (75.0%)") != 0 ||
+        rules.metric[events[1].rule] != metric_find("test.free")) {
+        printf("FAIL: alarm raise\n");
+        return 1;
+    }
+    // between clear point and threshold, or without data, the alarm stays up silently
+    metric_set(METRIC_CPU, 72);
+    int held = alarm_rules_evaluate(&rules, 2000, events);
+    metric_invalidate(METRIC_CPU);
+    held += alarm_rules_evaluate(&rules, 3000, events);
+    metric_set(METRIC_CPU, 72);
+    int repeated = alarm_rules_evaluate(&rules, 61000, events);
+    metric_set(METRIC_CPU, 65);
+    int cleared = alarm_rules_evaluate(&rules, 62000, events);
+    alarm_rule_message(&rules, &events[0], message, sizeof(message));
+    printf("Alarm clear: %s\n", message);
+    if (held != 0 || repeated != 2 || events[0].type != ALARM_CLEAR || cleared != 1 ||
+        strcmp(message, "CPU usage (65.0%) back below 70.0%") != 0) {
+        printf("FAIL: alarm hysteresis/renotify (held %d, repeated %d, cleared %d)\n", held, repeated, cleared);
+        return 1;
+    }
+    // a reload keeps the active alarm instead of raising it again
+    alarm_rules_compile(&th, &rules);
+    if (alarm_rules_evaluate(&rules, 63000, events) != 0 || !rules.active[rules.count - 1]) {
+        printf("FAIL: alarm state lost on reload\n");
+        return 1;
+    }
+
+    // pressure: a two minute stall sampled every second raises once, repeats at the renotify
+    // interval and clears when the stall is over
+    Thresholds psi_th = {80.0, 75.0, 90.0, 86400.0, 5, 200, .cpu_pressure = 20, .alarm_debounce = 2, .alarm_renotify = 60};
+    static AlarmRuleSet psi_rules;
+    alarm_rules_compile(&psi_th, &psi_rules);
+    int pressure = metric_find("pressure.cpu");
+    int psi_counts[3] = { 0 };
+    for (long long t = 0; t <= 130; t++) {
+        metric_set(pressure, t < 120 ? 40 : 2);
+        for (int e = alarm_rules_evaluate(&psi_rules, t * 1000, events) - 1; e >= 0; e--)
+            if (psi_rules.metric[events[e].rule] == pressure) psi_counts[events[e].type]++;
+    }
+    printf("Pressure: %d rules, %d raise, %d renotify, %d clear\n", psi_rules.count,
+           psi_counts[ALARM_RAISE], psi_counts[ALARM_RENOTIFY], psi_counts[ALARM_CLEAR]);
+    if (pressure < 0 || psi_rules.count != 7 || psi_counts[ALARM_RAISE] != 1 || psi_counts[ALARM_RENOTIFY] != 1 ||
+        psi_counts[ALARM_CLEAR] != 1) {
+        printf("FAIL: pressure rule\n");
+        return 1;
+    }
+
+    // trends: a leak of 1 per minute gives slope 1 and an ewma one time constant behind;
+    // the slope rule fires once the slope has stayed above 0.5 for 10 minutes
+    Thresholds leak_th = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_metrics = 1, .alarm_debounce = 1, .n_holds = 1};
+    strcpy(leak_th.metrics[0].name, "test.leak.slope");
+    leak_th.metrics[0].value = 0.5;
+    strcpy(leak_th.holds[0].name, "test.leak.slope");
+    leak_th.holds[0].value = 600;
+    static AlarmRuleSet leak_rules;
+    alarm_rules_compile(&leak_th, &leak_rules);
+    int leak = metric_find("test.leak");
+    int leak_ewma = trend_register("test.leak.ewma");
+    int leak_slope = metric_find("test.leak.slope");
+    long long breached_at = -1, raised_at = -1;
+    for (long long t = 0; t <= 1800; t++) {
+        metric_set(leak, 50 + t / 60.0);
+        trends_update(t * 1000);
+        if (breached_at < 0 && metric_valid(leak_slope) && metric_value(leak_slope) > 0.5) breached_at = t;
+        for (int e = alarm_rules_evaluate(&leak_rules, t * 1000, events) - 1; e >= 0; e--) {
+            if (leak_rules.metric[events[e].rule] == leak_slope && events[e].type == ALARM_RAISE) {
+                raised_at = t;
+                alarm_rule_message(&leak_rules, &events[e], message, sizeof(message));
+            }
+        }
+    }
+    printf("Trends: slope %.3f/min, ewma %.2f, slope above 0.5 at %llds, raised at %llds: %s\n",
+           metric_value(leak_slope), metric_value(leak_ewma), breached_at, raised_at, message);
+    if (leak < 0 || leak_ewma < 0 || metric_value(leak_slope) < 0.95 || metric_value(leak_slope) > 1.05 ||
+        metric_value(leak_ewma) < 78.9 || metric_value(leak_ewma) > 79.1 || breached_at < 0 || raised_at != breached_at + 600 ||
+        strstr(message, "for 600 s") == NULL) {
+        printf("FAIL: trends\n");
+        return 1;
+    }
+
+    // a threshold and a condition on names no collector publishes are reported once the collectors
+    // have had their time; the rules on published metrics are not
+    Thresholds typo_th = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_metrics = 2, .n_exprs = 1};
+    strcpy(typo_th.metrics[0].name, "test.typo");
+    strcpy(typo_th.metrics[1].name, "test.leak.slope");
+    strcpy(typo_th.exprs[0].name, "typo");
+    strcpy(typo_th.exprs[0].text, "cpu > 80 && test.tpyo > 1");
+    static AlarmRuleSet typo_rules;
+    alarm_rules_compile(&typo_th, &typo_rules);
+    alarm_rules_evaluate(&typo_rules, 0, events);
+    alarm_rules_evaluate(&typo_rules, ALARM_NAME_CHECK_MS - 1, events);
+    log_flush();
+    int early = 0, late = 0, wrong = 0;
+    char log_line[512];
+    FILE *log_file = fopen(TEST_LOG, "r");
+    while (log_file && fgets(log_line, sizeof(log_line), log_file)) early += strstr(log_line, "check the name") != NULL;
+    if (log_file) fclose(log_file);
+    alarm_rules_evaluate(&typo_rules, ALARM_NAME_CHECK_MS, events);
+    alarm_rules_evaluate(&typo_rules, 2 * ALARM_NAME_CHECK_MS, events);
+    log_flush();
+    log_file = fopen(TEST_LOG, "r");
+    while (log_file && fgets(log_line, sizeof(log_line), log_file)) {
+        if (!strstr(log_line, "check the name")) continue;
+        if (strstr(log_line, "test.typo") || strstr(log_line, "test.tpyo")) late++;
+        else wrong++;
+    }
+    if (log_file) fclose(log_file);
+    printf("Unpublished metrics: %d warnings before the check, %d after, %d on published metrics\n", early, late, wrong);
+    if (early != 0 || late != 2 || wrong != 0) {
+        printf("FAIL: rules on unpublished metrics\n");
+        return 1;
+    }
+
+    // reloads: ids of names dropped from the thresholds are given back, a name kept keeps its id
+    Thresholds reload_th = {80.0, 75.0, 90.0, 86400.0, 5, 200, .n_metrics = 2, .n_exprs = 1};
+    static AlarmRuleSet reload_rules;
+    strcpy(reload_th.metrics[1].name, "test.kept");
+    strcpy(reload_th.exprs[0].name, "reload");
+    int metrics_before = metric_count();
+    int kept_id = -1, kept_moved = 0;
+    for (int r = 0; r < 50; r++) {
+        snprintf(reload_th.metrics[0].name, sizeof(reload_th.metrics[0].name), "test.reload%d.slope", r);
+        snprintf(reload_th.exprs[0].text, sizeof(reload_th.exprs[0].text), "test.cond%d > 1 && test.kept < 5", r);
+        alarm_rules_compile(&reload_th, &reload_rules);
+        if (kept_id < 0) kept_id = metric_find("test.kept");
+        kept_moved += metric_find("test.kept") != kept_id;
+    }
+    int reload_new = metric_count() - metrics_before;
+    int reload_stale = metric_find("test.reload0.slope") >= 0 || metric_find("test.reload0") >= 0 ||
+                       metric_find("test.cond0") >= 0;
+    printf("Reloads: %d new metric ids over 50 reloads, kept id moved %d times\n", reload_new, kept_moved);
+    if (reload_new > 8 || reload_stale || kept_id < 0 || kept_moved != 0 || metric_find("test.reload49.slope") < 0) {
+        printf("FAIL: metric ids across reloads\n");
+        return 1;
+    }
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,162 @@
+// alarm spool test: group commit, torn tail recovery, replay through the alarm queue, rejected
+// replays, compaction and the delivered position across a restart
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "alarm_spool.h"
+#include "alarm_queue.h"
+#include "logger.h"
+#include "test_server.h"
+
+#define TEST_LOG "/tmp/test_alarm_spool.log"
+
+int main() {
+    logger_set_path(TEST_LOG);
+    // alarm spool: appends share one fsync, a torn tail is cut off on reopen and a replay through
+    // the alarm queue delivers every record in one request and empties the file
+    char spool_path[] = "/tmp/test_alarm_spool.XXXXXX";
+    int spool_fd = mkstemp(spool_path);
+    if (spool_fd < 0) {
+        printf("FAIL: spool file\n");
+        return 1;
+    }
+    close(spool_fd);
+    char spool_body[2048] = "";
+    char record[64];
+    struct stat spool_stat;
+    unlink(spool_path);
+    alarm_spool_open(spool_path);
+    for (int i = 0; i < 50; i++) {
+        snprintf(record, sizeof(record), "{\"id\":\"t-%d\"}", i);
+        alarm_spool_append(record);
+    }
+    alarm_spool_sync(0);
+    int early_syncs = alarm_spool_syncs();
+    alarm_spool_close();
+    int torn_fd = open(spool_path, O_WRONLY | O_APPEND);
+    if (torn_fd >= 0) {
+        write(torn_fd, "POOL\x20\x00", 6);
+        close(torn_fd);
+    }
+    int recovered = alarm_spool_open(spool_path);
+    long spool_pos = alarm_spool_start();
+    int first_ok = alarm_spool_next(&spool_pos, record, sizeof(record)) && strcmp(record, "{\"id\":\"t-0\"}") == 0;
+    int body_pipe[2];
+    char url[64];
+    pid_t server = pipe(body_pipe) < 0 ? -1 : start_server(0, 1, body_pipe[1], -1, url, sizeof(url));
+    if (server < 0) {
+        printf("FAIL: spool replay server\n");
+        return 1;
+    }
+    close(body_pipe[1]);
+    alarm_queue_start(url, 0);
+    if (drive_alarm_queue(body_pipe[0], 10000)) {
+        int n = read(body_pipe[0], spool_body, sizeof(spool_body) - 1);
+        spool_body[n > 0 ? n : 0] = '\0';
+    }
+    for (int i = 0; i < 20 && alarm_spool_records() > 0; i++) drive_alarm_queue(-1, 100);
+    alarm_queue_stop();
+    waitpid(server, NULL, 0);
+    close(body_pipe[0]);
+    int left_records = alarm_spool_records();
+    alarm_spool_close();
+    stat(spool_path, &spool_stat);
+    size_t body_len = strlen(spool_body);
+    printf("Alarm spool: %d syncs before due, %d recovered, replay %zu bytes, %d left, file %ld bytes\n",
+           early_syncs, recovered, body_len, left_records, (long)spool_stat.st_size);
+    if (early_syncs != 0 || recovered != 50 || !first_ok || strncmp(spool_body, "[{\"id\":\"t-0\"},{", 15) != 0 ||
+        body_len < 14 || strcmp(spool_body + body_len - 14, "{\"id\":\"t-49\"}]") != 0 ||
+        left_records != 0 || spool_stat.st_size != 0) {
+        printf("FAIL: alarm spool\n");
+        return 1;
+    }
+
+    // a replay the Cloud Manager rejects with a 400 is dropped instead of being retried forever
+    alarm_spool_open(spool_path);
+    for (int i = 0; i < 5; i++) {
+        snprintf(record, sizeof(record), "{\"id\":\"r-%d\"}", i);
+        alarm_spool_append(record);
+    }
+    server_status = 400;
+    server = start_server(0, 1, -1, -1, url, sizeof(url));
+    server_status = 200;
+    if (server < 0) {
+        printf("FAIL: spool reject server\n");
+        return 1;
+    }
+    alarm_queue_start(url, 0);
+    for (int i = 0; i < 50 && alarm_spool_records() > 0; i++) drive_alarm_queue(-1, 100);
+    alarm_queue_stop();
+    waitpid(server, NULL, 0);
+    int rejected_left = alarm_spool_records();
+    alarm_spool_close();
+    stat(spool_path, &spool_stat);
+    printf("Rejected replay: %d records left, file %ld bytes\n", rejected_left, (long)spool_stat.st_size);
+    if (rejected_left != 0 || spool_stat.st_size != 0) {
+        printf("FAIL: rejected spool replay\n");
+        return 1;
+    }
+
+    // compaction: with a quarter of a full spool delivered, an append still fits, the file
+    // shrinks and a position taken before the compaction still reads the next record
+    static char big[1000];
+    memset(big, 'x', sizeof(big) - 1);
+    alarm_spool_open(spool_path);
+    int filled = 0;
+    char id[16];
+    while (1) {
+        memcpy(big, id, snprintf(id, sizeof(id), "{\"id\":%05d,", filled));
+        if (!alarm_spool_append(big)) break;
+        filled++;
+    }
+    long pos = alarm_spool_start();
+    for (int i = 0; i < filled / 4; i++) alarm_spool_next(&pos, big, sizeof(big));
+    alarm_spool_consume(pos, filled / 4);
+    memcpy(big, id, snprintf(id, sizeof(id), "{\"id\":%05d,", filled));
+    memset(big + strlen(id), 'x', sizeof(big) - 1 - strlen(id));
+    int appended = alarm_spool_append(big);
+    alarm_spool_sync(1);
+    int compacted_records = alarm_spool_records();
+    int id_len = snprintf(id, sizeof(id), "{\"id\":%05d,", filled / 4);
+    int next_ok = alarm_spool_next(&pos, big, sizeof(big)) && strncmp(big, id, id_len) == 0;
+    alarm_spool_close();
+    stat(spool_path, &spool_stat);
+    printf("Compaction: %d records filled the spool, %d after a quarter was delivered, file %ld bytes\n",
+           filled, compacted_records, (long)spool_stat.st_size);
+    if (filled < 100 || !appended || compacted_records != filled - filled / 4 + 1 || !next_ok ||
+        spool_stat.st_size > ALARM_SPOOL_MAX_BYTES * 4 / 5) {
+        printf("FAIL: alarm spool compaction\n");
+        return 1;
+    }
+
+    // records delivered before a restart are not replayed again after it
+    alarm_spool_open(spool_path);
+    pos = alarm_spool_start();
+    for (int i = 0; i < 10; i++) alarm_spool_next(&pos, big, sizeof(big));
+    alarm_spool_consume(pos, 10);
+    alarm_spool_close();
+    int reopened = alarm_spool_open(spool_path);
+    pos = alarm_spool_start();
+    id_len = snprintf(id, sizeof(id), "{\"id\":%05d,", filled / 4 + 10);
+    int resume_ok = alarm_spool_next(&pos, big, sizeof(big)) && strncmp(big, id, id_len) == 0;
+    alarm_spool_close();
+    printf("Restart: %d records waiting after 10 of %d were delivered\n", reopened, compacted_records);
+    if (reopened != compacted_records - 10 || !resume_ok) {
+        printf("FAIL: alarm spool position across a restart\n");
+        return 1;
+    }
+    unlink(spool_path);
+    char pos_path[sizeof(spool_path) + 8];
+    snprintf(pos_path, sizeof(pos_path), "%s.pos", spool_path);
+    unlink(pos_path);
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
+    return 0;
+}
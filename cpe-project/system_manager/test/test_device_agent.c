@@ -19,8 +19,8 @@ int main() {
     //int server_sock, client_sock; // Server and client socket descriptors
     struct sockaddr_un addr;
     //struct sockaddr_un addr; // Unix socket address structure
-    char buffer[256];
-    //char buffer[256]; // Buffer for received data
+    char buffer[1024];
+    //char buffer[1024]; // Buffer for received data
 
     unlink(SOCKET_PATH);
     //unlink(SOCKET_PATH); // Remove existing socket file
@@ -0,0 +1,140 @@
+// non-blocking HTTP client test: posts in flight, circuit breaker, rejected requests and keep-alive connections
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "http_client.h"
+#include "logger.h"
+#include "test_server.h"
+
+#define TEST_LOG "/tmp/test_http_client.log"
+
+int main() {
+    char url[64];
+    logger_set_path(TEST_LOG);
+    // non-blocking posts: a server that never answers holds several requests in flight, and
+    // driving them never waits on the network
+    int silent_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in silent_addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t silent_len = sizeof(silent_addr);
+    if (silent_fd < 0 || bind(silent_fd, (struct sockaddr *)&silent_addr, sizeof(silent_addr)) < 0 ||
+        listen(silent_fd, 8) < 0 || getsockname(silent_fd, (struct sockaddr *)&silent_addr, &silent_len) < 0) {
+        printf("FAIL: silent server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/alarm", ntohs(silent_addr.sin_port));
+    HttpAsync async;
+    int silent_done = 0;
+    long long slowest_run = 0;
+    int started = http_async_init(&async, url) == 0;
+    for (int i = 0; i < 3 && started; i++) started = http_async_post(&async, "{}", count_done, &silent_done) == 0;
+    long long until = now_ns() + 200000000LL;
+    while (started && now_ns() < until) {
+        struct pollfd pfds[HTTP_MAX_SOCKETS];
+        int n = http_async_pollfds(&async, pfds, HTTP_MAX_SOCKETS);
+        int wait = http_async_timeout(&async);
+        poll(pfds, n, wait < 0 || wait > 20 ? 20 : wait);
+        long long start = now_ns();
+        http_async_run(&async, pfds, n);
+        if (now_ns() - start > slowest_run) slowest_run = now_ns() - start;
+    }
+    int in_flight = started ? http_async_in_flight(&async) : 0;
+    http_async_cleanup(&async);
+    close(silent_fd);
+    printf("HTTP async: %d requests in flight, slowest run %lld us\n", in_flight, slowest_run / 1000);
+    if (in_flight != 3 || silent_done != 0 || slowest_run > 50000000LL) {
+        printf("FAIL: non-blocking http client\n");
+        return 1;
+    }
+
+    // circuit breaker: failures against a closed port open it and posts fail fast; once the backoff
+    // is over a single probe goes through and its success closes it
+    int probe_port = closed_port();
+    if (probe_port < 0) {
+        printf("FAIL: breaker port\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/alarm", probe_port);
+    pid_t server = -1;
+    int failed = 0, refused = 0, probe = 0, wait_open = 0, wait_probe = 0, state_open = 0;
+    if (http_async_init(&async, url) == 0) {
+        async.breaker.base_ms = 20;
+        async.breaker.max_ms = 80;
+        http_async_post(&async, "{}", store_result, &failed);
+        drive_http(&async, &failed, 2000);
+        state_open = async.breaker.state;
+        refused = http_async_post(&async, "{}", store_result, &probe);
+        wait_open = http_async_wait_ms(&async);
+        server = start_server(probe_port, 1, -1, -1, url, sizeof(url));
+        while (http_async_wait_ms(&async) > 0) usleep(5000);
+        http_async_post(&async, "{}", store_result, &probe);
+        wait_probe = http_async_wait_ms(&async);
+        drive_http(&async, &probe, 2000);
+        if (server > 0) waitpid(server, NULL, 0);
+    }
+    printf("Circuit breaker: first post %s, opened %d, refused %d, open for %d ms, probe %s, closed %d\n",
+           failed == 1 ? "failed" : "?", state_open == HTTP_BREAKER_OPEN, refused != 0, wait_open,
+           probe == 2 ? "sent" : "?", async.breaker.state == HTTP_BREAKER_CLOSED);
+    if (failed != 1 || state_open != HTTP_BREAKER_OPEN || refused == 0 || wait_open <= 0 || wait_open > 80 ||
+        wait_probe != -1 || probe != 2 || async.breaker.state != HTTP_BREAKER_CLOSED) {
+        printf("FAIL: circuit breaker\n");
+        return 1;
+    }
+    http_async_cleanup(&async);
+
+    // a 400 is final: the request ends rejected on its first attempt and the breaker stays closed
+    int reject_pipe[2];
+    int reject_connections = -1, rejection = 0;
+    server_status = 400;
+    server = pipe(reject_pipe) < 0 ? -1 : start_server(0, 1, -1, reject_pipe[1], url, sizeof(url));
+    server_status = 200;
+    if (server < 0) {
+        printf("FAIL: http reject server\n");
+        return 1;
+    }
+    close(reject_pipe[1]);
+    long long reject_start = now_ns();
+    if (http_async_init(&async, url) == 0 && http_async_post(&async, "{}", store_result, &rejection) == 0)
+        drive_http(&async, &rejection, 5000);
+    long long reject_ms = (now_ns() - reject_start) / 1000000;
+    int reject_closed = async.breaker.state == HTTP_BREAKER_CLOSED;
+    http_async_cleanup(&async);
+    waitpid(server, NULL, 0);
+    read(reject_pipe[0], &reject_connections, sizeof(reject_connections));
+    close(reject_pipe[0]);
+    printf("HTTP reject: result %d after %lld ms, breaker closed %d\n", rejection, reject_ms, reject_closed);
+    if (rejection != HTTP_REJECTED + 1 || reject_connections != 1 || !reject_closed || reject_ms > 1000) {
+        printf("FAIL: http client rejected request\n");
+        return 1;
+    }
+
+    // one client keeps its connection: three posts, one accept
+    int count_pipe[2];
+    int connections = -1;
+    server = pipe(count_pipe) < 0 ? -1 : start_server(0, 3, -1, count_pipe[1], url, sizeof(url));
+    if (server < 0) {
+        printf("FAIL: http client server\n");
+        return 1;
+    }
+    close(count_pipe[1]);
+    int posted = http_async_init(&async, url) == 0;
+    for (int i = 0; i < 3; i++) posted &= post_and_wait(&async, "{\"n\":1}");
+    http_async_cleanup(&async);
+    waitpid(server, NULL, 0);
+    read(count_pipe[0], &connections, sizeof(connections));
+    close(count_pipe[0]);
+    printf("HTTP client: 3 posts on %d connection(s)\n", connections);
+    if (!posted || connections != 1) {
+        printf("FAIL: http client connection reuse\n");
+        return 1;
+    }
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,37 @@
+// JSON writer test: escaping, number formatting, nesting and growth past the caller's buffer
+
+#include <stdio.h>
+#include <string.h>
+#include "json_writer.h"
+
+int main() {
+    char small[16];
+    JsonWriter jw;
+    json_init(&jw, small, sizeof(small));
+    json_object_begin(&jw);
+    json_member_string(&jw, "name", "a \"quoted\" \\path\n\x01");
+    json_member_double(&jw, "pct", 12.345, 2);
+    json_member_double(&jw, "neg", -0.001, 2);
+    json_member_double(&jw, "low", -3.5, 1);
+    json_member_double(&jw, "nan", 0.0 / 0.0, 2);
+    json_member_int(&jw, "min", -9223372036854775807LL - 1);
+    json_key(&jw, "list");
+    json_array_begin(&jw);
+    json_int(&jw, 0);
+    json_bool(&jw, 1);
+    json_object_begin(&jw);
+    json_object_end(&jw);
+    json_array_end(&jw);
+    json_object_end(&jw);
+    const char *expected_json = "{\"name\":\"a \\\"quoted\\\" \\\\path\\n\\u0001\",\"pct\":12.35,\"neg\":0.00,"
+                                "\"low\":-3.5,\"nan\":null,\"min\":-9223372036854775808,\"list\":[0,true,{}]}";
+    printf("JSON writer: %s\n", json_text(&jw));
+    if (json_failed(&jw) || json_len(&jw) <= sizeof(small) || strcmp(json_text(&jw), expected_json) != 0) {
+        printf("FAIL: JSON writer\n");
+        return 1;
+    }
+    json_free(&jw);
+
+    printf("PASS\n");
+    return 0;
+}
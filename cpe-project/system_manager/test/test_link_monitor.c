@@ -0,0 +1,85 @@
+// rtnetlink link monitor test
+// runs in a private network namespace and flaps the loopback interface there,
+// so it needs root (CAP_SYS_ADMIN + CAP_NET_ADMIN) and the "ip" tool
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <poll.h>
+#include <time.h>
+#include "link_monitor.h"
+
+static int events_up = 0, events_down = 0;
+
+// monotonic clock in microseconds
+static long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void on_event(const char *ifname, int up) {
+    printf("  event: %s %s\n", ifname, up ? "up" : "down");
+    if (up) events_up++;
+    else events_down++;
+}
+
+// run an ip command and wait up to one second for the monitor to see the resulting event
+static long long run_and_wait(int fd, const char *cmd, int *counter) {
+    int before = *counter;
+    long long start = now_us();
+    if (system(cmd) != 0) return -1;
+    while (*counter == before && now_us() - start < 1000000) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 100) > 0) link_monitor_process(on_event);
+    }
+    return *counter == before ? -1 : now_us() - start;
+}
+
+int main() {
+    if (unshare(CLONE_NEWNET) != 0) {
+        printf("SKIP: cannot create a network namespace (needs root)\n");
+        return 0;
+    }
+
+    int fd = link_monitor_open();
+    if (fd < 0) {
+        printf("FAIL: link_monitor_open\n");
+        return 1;
+    }
+    // a fresh namespace only has a loopback interface, down and without addresses
+    printf("Interfaces with addresses: %d\n", link_monitor_count());
+    if (link_monitor_count() != 0) {
+        printf("FAIL: expected no addressed interfaces in a new namespace\n");
+        return 1;
+    }
+
+    long long up_us = run_and_wait(fd, "ip link set lo up", &events_up);
+    if (up_us < 0) {
+        printf("FAIL: no link up event\n");
+        return 1;
+    }
+    // collect the 127.0.0.1 and ::1 notifications that follow the link change
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (poll(&pfd, 1, 200) > 0) link_monitor_process(on_event);
+
+    // lo now has an IPv4 and an IPv6 address but must be counted once
+    printf("Interfaces with addresses: %d\n", link_monitor_count());
+    if (link_monitor_count() != 1) {
+        printf("FAIL: expected lo to be counted once\n");
+        return 1;
+    }
+
+    long long down_us = run_and_wait(fd, "ip link set lo down", &events_down);
+    if (down_us < 0) {
+        printf("FAIL: no link down event\n");
+        return 1;
+    }
+    printf("Link event latency: up %lld us, down %lld us\n", up_us, down_us);
+
+    link_monitor_close();
+    printf("PASS\n");
+    return 0;
+}
@@ -1,17 +1,415 @@
-// Initial metric collection test file
+// metric collection test: live collectors, the registry, monitors and the captured CPE tree
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 #include "metrics.h"
+#include "metric_window.h"
+#include "metric_registry.h"
+#include "mount_monitor.h"
+#include "psi_monitor.h"
+#include "cgroup_monitor.h"
+#include "top_processes.h"
+#include "host_paths.h"
+#include "logger.h"
+
+// scratch log, so test runs leave logs/system_manager.log alone
+#define TEST_LOG "/tmp/test_metrics.log"
+
+// test collector counting its runs
+static int test_runs = 0;
+static int test_collector() {
+    test_runs++;
+    return 0;
+}
+
+// write a /proc/net/dev with one interface whose 16 counters all read value
+static void write_net_dev(const char *path, const char *name, unsigned long long value) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return;
+    fprintf(fp, "Inter-|   Receive\n face |bytes\n%6s:", name);
+    for (int i = 0; i < 16; i++) fprintf(fp, " %llu", value);
+    fprintf(fp, "\n");
+    fclose(fp);
+}
+
+// pressure trigger callback
+static float psi_avg10 = -1;
+static void on_pressure(const char *resource, float avg10, float threshold) {
+    psi_avg10 = avg10;
+}
 
 int main() {
+    logger_set_path(TEST_LOG);
     Metrics m = collect_metrics();
 
     printf("Memory Usage: %.2f%%\n", m.memory);
     printf("CPU Load: %.2f%%\n", m.cpu);
+    printf("CPU iowait/steal: %.2f%% / %.2f%%\n", m.cpu_iowait, m.cpu_steal);
     printf("Uptime: %.2f seconds\n", m.uptime);
     printf("Disk Usage: %.2f%%\n", m.disk);
     printf("Network Interfaces: %d\n", m.net_interfaces);
     printf("Running Processes: %d\n", m.processes);
 
+    // both collector modes must agree on the slow-moving values
+    metrics_set_mode(METRICS_MODE_STDIO);
+    float mem_stdio = get_memory_usage(), up_stdio = get_uptime();
+    metrics_set_mode(METRICS_MODE_PREAD);
+    float mem_pread = get_memory_usage(), up_pread = get_uptime();
+    if (mem_pread < 0 || mem_pread - mem_stdio > 5 || mem_stdio - mem_pread > 5 ||
+        up_pread < up_stdio || up_pread - up_stdio > 5) {
+        printf("FAIL: pread collector disagrees (memory %.2f vs %.2f, uptime %.2f vs %.2f)\n",
+               mem_pread, mem_stdio, up_pread, up_stdio);
+        return 1;
+    }
+
+    // the fast counter includes threads, so it can never be below the exact /proc walk
+    metrics_set_process_mode(PROCESS_COUNT_EXACT);
+    int procs_exact = get_process_count();
+    metrics_set_process_mode(PROCESS_COUNT_FAST);
+    int procs_fast = get_process_count();
+    printf("Processes: %d (exact), %d tasks (fast)\n", procs_exact, procs_fast);
+    if (procs_exact <= 0 || procs_fast < procs_exact / 2) {
+        printf("FAIL: process counters disagree\n");
+        return 1;
+    }
+
+    // per-core breakdown needs two readings for a delta
+    usleep(100000);
+    get_cpu_load();
+    const CpuStats *cs = get_cpu_stats();
+    printf("Cores: %d, busiest core: %.2f%%\n", cs->count, cs->max_core);
+    for (int i = 1; i <= cs->count; i++) {
+        printf("  cpu%d: %.2f%% (iowait %.2f%%, steal %.2f%%)\n", i - 1, cs->usage[i], cs->iowait[i], cs->steal[i]);
+        if (cs->usage[i] < 0 || cs->usage[i] > 100.5) {
+            printf("FAIL: cpu%d utilisation out of range\n", i - 1);
+            return 1;
+        }
+    }
+    if (cs->count < 1) {
+        printf("FAIL: no per-core cpu lines parsed\n");
+        return 1;
+    }
+
+    // window summary over 1..100: min 1, max 100, mean 50.5, nearest-rank p95 = 95
+    MetricRing ring = {0};
+    MetricSummary sum;
+    for (int i = 100; i >= 1; i--) ring_add(&ring, (float)i);
+    ring_summarize(&ring, &sum);
+    if (sum.count != 100 || sum.min != 1 || sum.max != 100 || sum.mean != 50.5f || sum.p95 != 95) {
+        printf("FAIL: window summary (count %d min %.1f max %.1f mean %.2f p95 %.1f)\n",
+               sum.count, sum.min, sum.max, sum.mean, sum.p95);
+        return 1;
+    }
+
+    // registry: built-in collectors fill the table, intervals are honoured per collector
+    metrics_init();
+    collector_register("test", test_collector, 300);
+    for (long long t = 0; t <= 1000; t += 100) run_collectors(t);
+    if (test_runs != 4 || !metric_valid(METRIC_CPU) || !metric_valid(METRIC_DISK) ||
+        metric_find("processes") != METRIC_PROCESSES) {
+        printf("FAIL: collector registry (test collector ran %d times, expected 4)\n", test_runs);
+        return 1;
+    }
+
+    // per-mount usage: the worker's first round must have published the root filesystem
+    if (mount_monitor_start() < 0 || mount_monitor_count() < 1) {
+        printf("FAIL: mount monitor found no filesystems\n");
+        return 1;
+    }
+    run_collectors(2000000);
+    int root_used = metric_find("disk.root.used_pct");
+    printf("Filesystems: %d, root used %.2f%% (free %.0f bytes, inodes %.2f%%)\n", mount_monitor_count(),
+           metric_value(root_used), metric_value(metric_find("disk.root.free_bytes")),
+           metric_value(metric_find("disk.root.inodes_pct")));
+    if (!metric_valid(root_used) || !metric_valid(METRIC_DISK) || metric_value(METRIC_DISK) - m.disk > 1 ||
+        m.disk - metric_value(METRIC_DISK) > 1) {
+        printf("FAIL: root filesystem usage not published by the mount monitor\n");
+        return 1;
+    }
+    mount_monitor_stop();
+
+    // per-interface rates need two /proc/net/dev reads some time apart
+    update_net_dev_rates();
+    usleep(100000);
+    if (update_net_dev_rates() < 0) {
+        printf("FAIL: /proc/net/dev not readable\n");
+        return 1;
+    }
+    for (int id = METRIC_BUILTIN_COUNT; id < metric_count(); id++) {
+        const char *name = metric_name(id);
+        if (strncmp(name, "net.", 4) != 0 || !strstr(name, "_bytes_ps")) continue;
+        printf("  %-28s %12.0f\n", name, metric_value(id));
+        if (!metric_valid(id) || metric_value(id) < 0) {
+            printf("FAIL: %s not published\n", name);
+            return 1;
+        }
+    }
+
+    // block device statistics: track every device so the check works in containers too
+    metrics_set_disk_devices("*");
+    update_diskstats();
+    usleep(100000);
+    if (update_diskstats() < 0) {
+        printf("FAIL: /proc/diskstats not readable\n");
+        return 1;
+    }
+    for (int id = METRIC_BUILTIN_COUNT; id < metric_count(); id++) {
+        const char *name = metric_name(id);
+        if (strncmp(name, "io.", 3) != 0 || !metric_valid(id)) continue;
+        if (metric_value(id) < 0) {
+            printf("FAIL: %s negative (%.2f)\n", name, metric_value(id));
+            return 1;
+        }
+    }
+    metrics_set_disk_devices(DISK_DEVICES_DEFAULT);
+
+    // interface churn and counter resets on a scratch /proc/net/dev: interfaces that come and go
+    // hand their metric ids back, a 32-bit wrap still gives a rate and a reset starts a new baseline
+    char net_dev[] = "/tmp/test_metrics_proc/net/dev";
+    mkdir("/tmp/test_metrics_proc", 0700);
+    mkdir("/tmp/test_metrics_proc/net", 0700);
+    host_paths_set("/tmp/test_metrics_proc", "/sys");
+    metrics_cleanup();
+    write_net_dev(net_dev, "veth0", 1);
+    update_net_dev_rates();
+    int churn_before = metric_count();
+    char ifname[16];
+    for (int i = 1; i <= 100; i++) {
+        snprintf(ifname, sizeof(ifname), "veth%d", i);
+        write_net_dev(net_dev, ifname, i);
+        update_net_dev_rates();
+    }
+    int churn_ids = metric_count() - churn_before;
+    int veth_gone = metric_find("net.veth0.rx_bytes_ps") < 0 && metric_find("net.veth99.rx_bytes_ps") < 0;
+    unsigned long long steps[] = { 0xfffff000ULL, 0x1000ULL, 1000000000ULL, 500, 600 };
+    int step_valid[5];
+    int rx = -1;
+    for (int i = 0; i < 5; i++) {
+        write_net_dev(net_dev, "eth0", steps[i]);
+        usleep(2000);
+        update_net_dev_rates();
+        rx = metric_find("net.eth0.rx_bytes_ps");
+        step_valid[i] = metric_updated(rx) && metric_value(rx) > 0;
+    }
+    // mounts that come and go (USB sticks, tmp mounts) give their ids back on a reload too
+    char mountinfo[] = "/tmp/test_metrics_proc/self/mountinfo";
+    mkdir("/tmp/test_metrics_proc/self", 0700);
+    int mount_before = -1, mount_ids = -1;
+    for (int i = 0; i <= 50; i++) {
+        FILE *fp = fopen(mountinfo, "w");
+        if (fp) {
+            fprintf(fp, "21 1 8:1 / / rw - ext4 /dev/sda1 rw\n22 21 8:%d / /media/usb%d rw - vfat /dev/sdb1 rw\n", 16 + i, i);
+            fclose(fp);
+        }
+        if (i == 0 && mount_monitor_start() >= 0) mount_before = metric_count();
+        else mount_monitor_reload();
+    }
+    if (mount_before >= 0) mount_ids = metric_count() - mount_before;
+    int usb_gone = metric_find("disk.media_usb0.used_pct") < 0 && metric_find("disk.media_usb50.used_pct") >= 0;
+    mount_monitor_stop();
+    usb_gone &= metric_find("disk.media_usb50.used_pct") < 0;
+
+    // pressure sampling: the share of stall time between two reads of the "some" total
+    char pressure_cpu[] = "/tmp/test_metrics_proc/pressure/cpu";
+    mkdir("/tmp/test_metrics_proc/pressure", 0700);
+    FILE *psi_fp = fopen(pressure_cpu, "w");
+    if (psi_fp) {
+        fprintf(psi_fp, "some avg10=0.00 avg60=0.00 avg300=0.00 total=1000000\n");
+        fclose(psi_fp);
+    }
+    int psi_watched = psi_monitor_watch(PSI_CPU) == 0;
+    usleep(200000);
+    psi_fp = fopen(pressure_cpu, "w");
+    if (psi_fp) {
+        // 100 ms stalled in about 200 ms
+        fprintf(psi_fp, "some avg10=0.00 avg60=0.00 avg300=0.00 total=1100000\n");
+        fclose(psi_fp);
+    }
+    psi_monitor_collect();
+    int psi_id = metric_find("pressure.cpu");
+    double psi_share = metric_valid(psi_id) ? metric_value(psi_id) : -1;
+    psi_monitor_unwatch(PSI_CPU);
+    int psi_released = metric_find("pressure.cpu") < 0;
+    unlink(pressure_cpu);
+    rmdir("/tmp/test_metrics_proc/pressure");
+    printf("Pressure sampling: cpu stalled %.1f%%, released %d\n", psi_share, psi_released);
+    if (!psi_watched || psi_share < 30 || psi_share > 55 || !psi_released) {
+        printf("FAIL: pressure sampling\n");
+        return 1;
+    }
+
+    // cgroup cpu share: a usage counter that went backwards (cgroup re-created) gives no share,
+    // and restarting the monitor does not take new ids
+    char cg_stat[] = "/tmp/test_metrics_proc/app.service/cpu.stat";
+    mkdir("/tmp/test_metrics_proc/app.service", 0700);
+    int cg_before = metric_count();
+    int cg_valid[3] = { 0, 0, 0 };
+    for (int restart = 0; restart < 20; restart++) {
+        cgroup_monitor_start("/tmp/test_metrics_proc/app.service");
+        const unsigned long long usage[3] = { 2000000, 2010000, 1000 };
+        for (int step = 0; step < 3; step++) {
+            FILE *fp = fopen(cg_stat, "w");
+            if (fp) {
+                fprintf(fp, "usage_usec %llu\nuser_usec 0\nsystem_usec 0\n", usage[step]);
+                fclose(fp);
+            }
+            update_cgroups();
+            cg_valid[step] = metric_valid(metric_find("cgroup.app.cpu_pct"));
+            usleep(2000);
+        }
+        cgroup_monitor_stop();
+    }
+    int cg_ids = metric_count() - cg_before;
+    int cg_released = metric_find("cgroup.app.cpu_pct") < 0;
+    unlink(cg_stat);
+    rmdir("/tmp/test_metrics_proc/app.service");
+    printf("cgroup counters: share valid %d after a step, %d after going backwards, 20 restarts took %d ids, released %d\n",
+           cg_valid[1], cg_valid[2], cg_ids, cg_released);
+    if (!cg_valid[1] || cg_valid[2] || cg_ids > CGROUP_METRICS || !cg_released) {
+        printf("FAIL: cgroup counter reset or restart\n");
+        return 1;
+    }
+
+    // block devices that come and go (loop devices, USB sticks) give their ids back the same way
+    char diskstats[] = "/tmp/test_metrics_proc/diskstats";
+    metrics_set_disk_devices("*");
+    int disk_before = metric_count();
+    for (int i = 0; i < 100; i++) {
+        FILE *fp = fopen(diskstats, "w");
+        if (fp) {
+            fprintf(fp, "   7       %d loop%d 1 0 2 3 4 0 5 6 0 7 8\n", i, i);
+            fclose(fp);
+        }
+        update_diskstats();
+    }
+    int disk_ids = metric_count() - disk_before;
+    metrics_set_disk_devices(DISK_DEVICES_DEFAULT);
+    printf("Device churn: 100 interfaces took %d new ids, 100 disks %d, 50 mounts %d; wrap %d, reset %d, after reset %d\n",
+           churn_ids, disk_ids, mount_ids, step_valid[1], step_valid[3], step_valid[4]);
+    host_paths_set("/proc", "/sys");
+    metrics_cleanup();
+    unlink(diskstats);
+    unlink(mountinfo);
+    rmdir("/tmp/test_metrics_proc/self");
+    unlink(net_dev);
+    rmdir("/tmp/test_metrics_proc/net");
+    rmdir("/tmp/test_metrics_proc");
+    if (churn_ids > NETDEV_COUNTERS || disk_ids > DISKSTAT_METRICS || mount_ids < 0 || mount_ids > 3 || !usb_gone ||
+        !veth_gone || !step_valid[1] || step_valid[3] || !step_valid[4]) {
+        printf("FAIL: device churn or counter reset\n");
+        return 1;
+    }
+
+    // cgroup accounting on our own cgroup: needs two reads for the cpu share
+    char own_cgroup[256] = "";
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (fp) {
+        char line[256];
+        // the unified hierarchy line is "0::/path"
+        while (fgets(line, sizeof(line), fp))
+            if (strncmp(line, "0::", 3) == 0) snprintf(own_cgroup, sizeof(own_cgroup), "%.*s", (int)strcspn(line + 4, "\n"), line + 4);
+        fclose(fp);
+    }
+    // hybrid hierarchies mount cgroup v2 under "unified"
+    if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) != 0 && access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0) {
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/fs/cgroup/unified/%s", own_cgroup);
+        snprintf(own_cgroup, sizeof(own_cgroup), "%s", path);
+    }
+    if (cgroup_monitor_start(own_cgroup[0] ? own_cgroup : ".") != 1) {
+        printf("FAIL: cgroup monitor did not take the cgroup\n");
+        return 1;
+    }
+    if (update_cgroups() < 0) {
+        printf("cgroup: %s is not a cgroup v2 directory, skipping\n", own_cgroup);
+    } else {
+        usleep(100000);
+        update_cgroups();
+        int cpu_id = -1;
+        for (int id = METRIC_BUILTIN_COUNT; id < metric_count(); id++)
+            if (strncmp(metric_name(id), "cgroup.", 7) == 0 && strstr(metric_name(id), ".cpu_pct")) cpu_id = id;
+        printf("cgroup: %s cpu %.2f%%\n", cpu_id >= 0 ? metric_name(cpu_id) : "?", metric_value(cpu_id));
+        if (cpu_id < 0 || !metric_valid(cpu_id) || metric_value(cpu_id) < 0) {
+            printf("FAIL: cgroup cpu share not published\n");
+            return 1;
+        }
+    }
+    cgroup_monitor_stop();
+
+    // top processes: a busy child must lead the cpu ranking of the second scan
+    TopProcesses top;
+    pid_t busy = fork();
+    if (busy == 0) {
+        for (;;) { }
+    }
+    top_processes_scan(&top);
+    usleep(200000);
+    if (top_processes_scan(&top) < 0 || top.n_cpu < 1 || top.n_rss < 1) {
+        printf("FAIL: top processes scan\n");
+        kill(busy, SIGKILL);
+        return 1;
+    }
+    printf("Top cpu: %d %s %.1f%%, top rss: %d %s %lu kB (%d scanned%s)\n", top.cpu[0].pid, top.cpu[0].name,
+           top.cpu[0].cpu, top.rss[0].pid, top.rss[0].name, top.rss[0].rss_kb, top.scanned,
+           top.truncated ? ", truncated" : "");
+    kill(busy, SIGKILL);
+    waitpid(busy, NULL, 0);
+    if (!top.truncated && (top.cpu[0].pid != busy || top.cpu[0].cpu < 50 || top.rss[0].rss_kb < top.rss[top.n_rss - 1].rss_kb)) {
+        printf("FAIL: top processes ranking\n");
+        return 1;
+    }
+
+    // pressure triggers: register one and run the handler as if it had fired
+    int psi_fd = psi_monitor_open(PSI_CPU, 10);
+    if (psi_fd < 0) {
+        printf("PSI: not available, skipping trigger check\n");
+    } else {
+        if (psi_monitor_handle(psi_fd, POLLPRI, on_pressure) < 0 || psi_avg10 < 0 || psi_avg10 > 100) {
+            printf("FAIL: pressure trigger handler (avg10 %.2f)\n", psi_avg10);
+            return 1;
+        }
+        printf("PSI: cpu trigger armed, some avg10 %.2f%%\n", psi_avg10);
+        psi_monitor_close(PSI_CPU);
+    }
+
+    // replay the captured CPE tree: every collector must give the values computed by hand
+    host_paths_set("test/fixtures/cpe-small/proc", "test/fixtures/cpe-small/sys");
+    metrics_cleanup();
+    top_processes_cleanup();
+    metrics_set_process_mode(PROCESS_COUNT_EXACT);
+    int fixture_exact = get_process_count();
+    metrics_set_process_mode(PROCESS_COUNT_FAST);
+    get_cpu_load();
+    update_net_dev_rates();
+    update_diskstats();
+    cgroup_monitor_start("system.slice/dataplane.service");
+    update_cgroups();
+    top_processes_scan(&top);
+    printf("Fixture cpe-small: memory %.2f%%, uptime %.2f, processes %d/%d, cores %d, top %s/%s\n",
+           get_memory_usage(), get_uptime(), get_process_count(), fixture_exact, get_cpu_stats()->count,
+           top.cpu[0].name, top.rss[0].name);
+    if (get_memory_usage() != 50.0f || get_uptime() < 63144.7f || get_uptime() > 63144.8f ||
+        get_process_count() != 97 || fixture_exact != 11 || get_cpu_stats()->count != 2 ||
+        metric_find("net.eth0.rx_bytes_ps") < 0 || metric_find("net.lo.rx_bytes_ps") >= 0 ||
+        metric_find("io.mmcblk0.await_ms") < 0 || metric_find("io.mmcblk0p1.await_ms") >= 0 ||
+        metric_value(metric_find("cgroup.dataplane.memory_bytes")) != 83886080 ||
+        strcmp(top.cpu[0].name, "dataplane") != 0 || strcmp(top.rss[0].name, "dataplane") != 0) {
+        printf("FAIL: collectors disagree with the cpe-small fixture\n");
+        return 1;
+    }
+    cgroup_monitor_stop();
+    host_paths_set("/proc", "/sys");
+    metrics_cleanup();
+    top_processes_cleanup();
+
+    log_flush();
+    unlink(TEST_LOG);
+    printf("PASS\n");
     return 0;
 }
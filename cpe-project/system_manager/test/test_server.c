@@ -0,0 +1,129 @@
+// loopback HTTP server and main-loop drivers shared by the HTTP, alarm queue and spool tests
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "test_server.h"
+#include "alarm_queue.h"
+
+int server_status = 200;
+
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// accept one HTTP request on listen_fd, answer server_status and write its body to out_fd
+static int serve_requests(int listen_fd, int out_fd, int count) {
+    char request[ALARM_BATCH_SIZE + 1024];
+    int used = 0;
+    int connections = 0;
+    int client = -1;
+    while (count > 0) {
+        if (client < 0) {
+            client = accept(listen_fd, NULL, NULL);
+            if (client < 0) break;
+            connections++;
+        }
+        int n = recv(client, request + used, sizeof(request) - 1 - used, 0);
+        if (n <= 0) {
+            // the client hung up: the next request comes on a new connection
+            close(client);
+            client = -1;
+            used = 0;
+            continue;
+        }
+        used += n;
+        request[used] = '\0';
+        char *body = strstr(request, "\r\n\r\n");
+        char *length = strstr(request, "Content-Length:");
+        if ((body && length && (int)(request + used - body - 4) >= atoi(length + 15)) || used == sizeof(request) - 1) {
+            char reply[64];
+            int reply_len = snprintf(reply, sizeof(reply), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n\r\n",
+                                     server_status, server_status == 200 ? "OK" : "Error");
+            send(client, reply, reply_len, 0);
+            if (out_fd >= 0 && body) write(out_fd, body + 4, strlen(body + 4));
+            used = 0;
+            count--;
+        }
+    }
+    if (client >= 0) close(client);
+    return connections;
+}
+
+int closed_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+pid_t start_server(int port, int count, int out_fd, int count_fd, char *url, size_t url_size) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0 ||
+        getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+        if (listen_fd >= 0) close(listen_fd);
+        return -1;
+    }
+    snprintf(url, url_size, "http://127.0.0.1:%d/alarm", ntohs(addr.sin_port));
+    pid_t server = fork();
+    if (server == 0) {
+        int connections = serve_requests(listen_fd, out_fd, count);
+        if (count_fd >= 0) write(count_fd, &connections, sizeof(connections));
+        _exit(0);
+    }
+    close(listen_fd);
+    return server;
+}
+
+void count_done(void *ctx, int success) {
+    (*(int *)ctx)++;
+}
+
+void store_result(void *ctx, int result) {
+    *(int *)ctx = result + 1;
+}
+
+void drive_http(HttpAsync *client, int *result, int timeout_ms) {
+    long long until = now_ns() + timeout_ms * 1000000LL;
+    while (!*result && now_ns() < until) {
+        struct pollfd pfds[HTTP_MAX_SOCKETS];
+        int n = http_async_pollfds(client, pfds, HTTP_MAX_SOCKETS);
+        int wait = http_async_timeout(client);
+        poll(pfds, n, wait < 0 || wait > 20 ? 20 : wait);
+        http_async_run(client, pfds, n);
+    }
+}
+
+int post_and_wait(HttpAsync *client, const char *payload) {
+    int result = 0;
+    if (http_async_post(client, payload, store_result, &result) != 0) return 0;
+    drive_http(client, &result, 5000);
+    return result == HTTP_SENT + 1;
+}
+
+int drive_alarm_queue(int wait_fd, int timeout_ms) {
+    struct pollfd pfds[1 + HTTP_MAX_SOCKETS] = { { .fd = wait_fd, .events = POLLIN } };
+    long long until = now_ns() + timeout_ms * 1000000LL;
+    while (now_ns() < until) {
+        int n = alarm_queue_pollfds(pfds + 1, HTTP_MAX_SOCKETS);
+        int wait = alarm_queue_timeout();
+        int ready = poll(pfds, n + 1, wait < 0 || wait > 100 ? 100 : wait);
+        alarm_queue_run(pfds + 1, n);
+        if (ready > 0 && (pfds[0].revents & POLLIN)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+// loopback HTTP server and main-loop drivers shared by the HTTP, alarm queue and spool tests
+
+#ifndef TEST_SERVER_H
+#define TEST_SERVER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "http_client.h"
+
+// monotonic clock in nanoseconds
+long long now_ns();
+
+// status the servers started from now on answer with
+extern int server_status;
+
+// start a server on loopback port (0 = any free one) answering count requests, each body written to out_fd,
+// then the number of connections it accepted written to count_fd as one int. Returns the server's pid
+pid_t start_server(int port, int count, int out_fd, int count_fd, char *url, size_t url_size);
+
+// a loopback port nothing listens on
+int closed_port();
+
+// done callback counting finished requests
+void count_done(void *ctx, int success);
+
+// done callback keeping the outcome: 1 failed, 2 sent, 3 rejected
+void store_result(void *ctx, int result);
+
+// run client the way the main loop does until *result is set or timeout_ms passed
+void drive_http(HttpAsync *client, int *result, int timeout_ms);
+
+// post payload and run client until the request has ended. returns 1 if it was sent
+int post_and_wait(HttpAsync *client, const char *payload);
+
+// run the alarm queue the way the main loop does until wait_fd is readable or timeout_ms passed.
+// returns 1 if wait_fd became readable
+int drive_alarm_queue(int wait_fd, int timeout_ms);
+
+#endif
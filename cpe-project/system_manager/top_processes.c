@@ -0,0 +1,202 @@
+// heaviest processes by cpu and memory, for attaching to alarms
+
+#include "top_processes.h"
+#include "host_paths.h"
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+// cpu ticks of each process seen by the previous scan, open addressing on the pid
+#define PREV_SLOTS 4096
+// a previous scan older than this is not used for cpu deltas
+#define PREV_MAX_AGE_MS 5000
+
+typedef struct {
+    int pid;                    // 0 = free
+    unsigned long long ticks;   // utime + stime
+} PrevTicks;
+
+static PrevTicks prev[2][PREV_SLOTS];   // previous and current scan, swapped after each scan
+static int prev_cur = 0;
+static long long prev_scan_ms = 0;
+static DIR *proc_dir = NULL;            // kept open, rewound for every scan
+static char stat_buf[1024];
+
+static long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static PrevTicks *prev_slot(PrevTicks *table, int pid) {
+    unsigned int h = (unsigned int)pid * 2654435761u % PREV_SLOTS;
+    for (int i = 0; i < PREV_SLOTS; i++) {
+        PrevTicks *e = &table[(h + i) % PREV_SLOTS];
+        if (e->pid == pid || e->pid == 0) return e;
+    }
+    return NULL;
+}
+
+// min-heaps of size TOP_N, the root is the smallest kept entry
+static int cmp_cpu(const ProcessUsage *a, const ProcessUsage *b) {
+    return a->cpu < b->cpu ? -1 : a->cpu > b->cpu;
+}
+
+static int cmp_rss(const ProcessUsage *a, const ProcessUsage *b) {
+    return a->rss_kb < b->rss_kb ? -1 : a->rss_kb > b->rss_kb;
+}
+
+static void heap_sift_down(ProcessUsage *heap, int n, int i, int (*cmp)(const ProcessUsage *, const ProcessUsage *)) {
+    while (1) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && cmp(&heap[l], &heap[smallest]) < 0) smallest = l;
+        if (r < n && cmp(&heap[r], &heap[smallest]) < 0) smallest = r;
+        if (smallest == i) return;
+        ProcessUsage tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void heap_push(ProcessUsage *heap, int *n, const ProcessUsage *p,
+                      int (*cmp)(const ProcessUsage *, const ProcessUsage *)) {
+    if (*n < TOP_N) {
+        // sift the new entry up
+        int i = (*n)++;
+        heap[i] = *p;
+        while (i > 0 && cmp(&heap[i], &heap[(i - 1) / 2]) < 0) {
+            ProcessUsage tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    } else if (cmp(p, &heap[0]) > 0) {
+        heap[0] = *p;
+        heap_sift_down(heap, *n, 0, cmp);
+    }
+}
+
+// turn a min-heap into a list sorted heaviest first
+static void heap_sort_desc(ProcessUsage *heap, int n, int (*cmp)(const ProcessUsage *, const ProcessUsage *)) {
+    for (int end = n - 1; end > 0; end--) {
+        ProcessUsage tmp = heap[0];
+        heap[0] = heap[end];
+        heap[end] = tmp;
+        heap_sift_down(heap, end, 0, cmp);
+    }
+}
+
+// parse "pid (comm) state ppid ... utime stime ... starttime vsize rss" from /proc/[pid]/stat
+static int parse_stat(const char *buf, ProcessUsage *p, unsigned long long *ticks, unsigned long long *start) {
+    const char *open_paren = strchr(buf, '(');
+    const char *close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren) return -1;
+
+    // comm may contain anything, keep it safe to embed in JSON
+    size_t n = 0;
+    for (const char *c = open_paren + 1; c < close_paren && n + 1 < sizeof(p->name); c++)
+        p->name[n++] = (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20) ? '?' : *c;
+    p->name[n] = '\0';
+
+    // fields after comm, numbered from 3 (state) as in proc(5)
+    unsigned long long utime = 0, stime = 0, rss = 0;
+    int field = 3;
+    for (const char *c = close_paren + 2; *c && field <= 24; field++) {
+        unsigned long long v = 0;
+        while (*c >= '0' && *c <= '9') v = v * 10 + (unsigned long long)(*c++ - '0');
+        if (field == 14) utime = v;
+        else if (field == 15) stime = v;
+        else if (field == 22) *start = v;
+        else if (field == 24) rss = v;
+        while (*c && *c != ' ') c++;
+        if (*c == ' ') c++;
+    }
+    if (field <= 24) return -1;
+    *ticks = utime + stime;
+    p->rss_kb = rss * (unsigned long)(sysconf(_SC_PAGESIZE) / 1024);
+    return 0;
+}
+
+void top_processes_cleanup() {
+    if (proc_dir) closedir(proc_dir);
+    proc_dir = NULL;
+    prev_scan_ms = 0;
+}
+
+int top_processes_scan(TopProcesses *out) {
+    memset(out, 0, sizeof(*out));
+    if (!proc_dir) {
+        proc_dir = opendir(proc_root());
+        if (!proc_dir) return -1;
+    } else {
+        rewinddir(proc_dir);
+    }
+
+    long long start_ms = now_ms();
+    double elapsed_ticks = (start_ms - prev_scan_ms) / 1000.0 * sysconf(_SC_CLK_TCK);
+    int have_prev = prev_scan_ms > 0 && start_ms - prev_scan_ms <= PREV_MAX_AGE_MS && elapsed_ticks > 0;
+
+    // uptime in ticks, for the lifetime average of processes the previous scan did not see
+    struct timespec boot;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    double uptime_ticks = (boot.tv_sec + boot.tv_nsec / 1e9) * sysconf(_SC_CLK_TCK);
+
+    PrevTicks *old = prev[prev_cur];
+    PrevTicks *cur = prev[!prev_cur];
+    memset(cur, 0, sizeof(prev[0]));
+
+    struct dirent *entry;
+    while ((entry = readdir(proc_dir)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        // check the budget every 64 processes, a clock read per process would cost more than it saves
+        if ((out->scanned & 63) == 63 && now_ms() - start_ms > TOP_SCAN_BUDGET_MS) {
+            out->truncated = 1;
+            break;
+        }
+
+        char path[HOST_ROOT_LEN + 32];
+        snprintf(path, sizeof(path), "%s/%.16s/stat", proc_root(), entry->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue; // exited meanwhile
+        ssize_t len = read(fd, stat_buf, sizeof(stat_buf) - 1);
+        close(fd);
+        if (len <= 0) continue;
+        stat_buf[len] = '\0';
+
+        ProcessUsage p;
+        unsigned long long ticks, started = 0;
+        p.pid = 0;
+        for (const char *c = entry->d_name; *c >= '0' && *c <= '9'; c++) p.pid = p.pid * 10 + (*c - '0');
+        if (parse_stat(stat_buf, &p, &ticks, &started) < 0) continue;
+        out->scanned++;
+
+        PrevTicks *seen = have_prev ? prev_slot(old, p.pid) : NULL;
+        if (seen && seen->pid == p.pid && ticks >= seen->ticks) {
+            p.cpu = (float)(100.0 * (ticks - seen->ticks) / elapsed_ticks);
+        } else {
+            p.cpu = uptime_ticks > started ? (float)(100.0 * ticks / (uptime_ticks - started)) : 0;
+        }
+        PrevTicks *slot = prev_slot(cur, p.pid);
+        if (slot) {
+            slot->pid = p.pid;
+            slot->ticks = ticks;
+        }
+
+        // idle processes and kernel threads (no rss) would only pad the rankings
+        if (p.cpu > 0) heap_push(out->cpu, &out->n_cpu, &p, cmp_cpu);
+        if (p.rss_kb > 0) heap_push(out->rss, &out->n_rss, &p, cmp_rss);
+    }
+
+    heap_sort_desc(out->cpu, out->n_cpu, cmp_cpu);
+    heap_sort_desc(out->rss, out->n_rss, cmp_rss);
+    // a truncated scan only has part of the ticks, don't use it as the next baseline
+    if (!out->truncated) {
+        prev_cur = !prev_cur;
+        prev_scan_ms = start_ms;
+    }
+    return 0;
+}
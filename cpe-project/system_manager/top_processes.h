@@ -0,0 +1,36 @@
+// header file for top_processes.c : heaviest processes by cpu and memory
+
+#ifndef TOP_PROCESSES_H
+#define TOP_PROCESSES_H
+
+// number of processes kept per ranking
+#define TOP_N 5
+// wall time one scan may spend walking /proc before it stops with partial results
+#define TOP_SCAN_BUDGET_MS 20
+// scan when a cpu or memory value is above this share of its threshold
+#define TOP_NEAR_RATIO 0.9f
+
+typedef struct {
+    int pid;
+    char name[16];          // comm, with characters unsafe in JSON replaced by '?'
+    float cpu;              // % of one core since the previous scan (lifetime average if no previous scan)
+    unsigned long rss_kb;   // resident set size
+} ProcessUsage;
+
+// result of a scan, each ranking sorted heaviest first
+typedef struct {
+    int scanned;            // processes looked at
+    int truncated;          // 1 if the time budget ran out before /proc was fully walked
+    int n_cpu, n_rss;
+    ProcessUsage cpu[TOP_N];
+    ProcessUsage rss[TOP_N];
+} TopProcesses;
+
+// walk /proc/[pid]/stat and rank processes by cpu and rss. Costs one open/read/close per process,
+// so it is meant to run only while a threshold is near or breached. returns 0, or -1 on failure
+int top_processes_scan(TopProcesses *out);
+
+// close /proc and forget the previous scan
+void top_processes_cleanup();
+
+#endif